@@ -2,15 +2,29 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
-#include <time.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
 #include "imagefunc.h"
+#include "parallel.h"
+#include "isa.h"
+#include "transform.h"
+#include "memusage.h"
+#include "trace.h"
 
 /**
  * @file
  * @brief A kép módosításához használt függvények
  */
 
+#define CONV_TILE 64 /**< a convolve csempéinek mérete pixelben */
+#define CONV_MAX_DEPTH 8 /**< a convolve egy menetben legfeljebb ennyi iterációt végez el egy csempén */
+#define CONV_EXTRA_SLOTS 2 /**< a szálak számán felül ennyi csempe munkaterület, mert a párhuzamos lépést hívó szálak (pl. a --sequence olvasója) is besegíthetnek */
+#define MEDIAN_STRIP 128 /**< a medián szűrő oszlopsávjainak szélessége pixelben */
+
 /**
  * @brief beállítja egy filter értékét amit a convolve használ
  * @param[in] *filter a Filter egy példánya pointerként
@@ -235,12 +249,92 @@ void set_white(unsigned char pixel[], int treshold) {
     }
 }
 
+/**
+ * @brief a detect_edges szűrési lépései, a végső küszöbölés nélkül
+ * @param[in] ***image a kép amin keresni kell
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[out] edgeimage a szűrt kép channels csatornán, vagy NULL ha nem sikerült lefoglalni a memóriát
+ * @see detect_edges
+ * @see edge_pixel
+ */
+static unsigned char ***filter_edges(unsigned char ***image, int size_x, int size_y, int channels) {
+    unsigned char ***edgeimage = allocateimage_channels (size_x, size_y, channels);
+    if (edgeimage == NULL)
+        return NULL;
+
+    for (int i = 0; i < size_y; i++) {
+        memcpy(edgeimage[i][0], image[i][0], size_x * channels);
+    }
+
+    Filter blur;
+    setfilter(&blur, (int[]) {1, 2, 1, 2, 4, 2, 1, 2, 1}, 1/16.0, 3, 3);
+    Filter vertical_line;
+    setfilter(&vertical_line, (int[]) {-1, 2, -1, -1, 2, -1, -1, 2, -1}, 1, 3, 3);
+
+    bool success = convolve(edgeimage, size_x, size_y, blur, 1, channels)
+        && convolve(edgeimage, size_x, size_y, vertical_line, 1, channels);
+
+    /* set_white */
+    for (int i = 0; i < size_y; i++) {
+        unsigned char *row = edgeimage[i][0];
+        for (int k = 0; k < size_x * channels; k++) {
+            row[k] = (row[k] > 9) ? 255 : 0;
+        }
+    }
+
+    success = success && convolve(edgeimage, size_x, size_y, blur, 1, channels);
+    freefilter (blur);
+    freefilter (vertical_line);
+    if (!success) {
+        freeimage (edgeimage, size_x, size_y);
+        return NULL;
+    }
+    return edgeimage;
+}
+
+/**
+ * @brief sharp_grayscale egy szűrt pixelre: él-e a pixel
+ * @param[in] pixel[] a filter_edges eredményének egy pixele
+ * @param[in] channels a pixel csatornáinak száma
+ */
+static inline bool edge_pixel(unsigned char pixel[], int channels) {
+    int sum = 0;
+    for (int color = 0; color < channels; color++)
+        sum += pixel[color];
+    return sum / channels >= 128;
+}
+
+/** @brief a detect_edges élképe, a paraméterei és az eredménye ugyanaz */
+static unsigned char ***edges_image(unsigned char ***image, int size_x, int size_y, int channels) {
+    unsigned char ***result = allocateimage_channels (size_x, size_y, 1);
+    if (result == NULL)
+        return NULL;
+    unsigned char ***edgeimage = filter_edges (image, size_x, size_y, channels);
+    if (edgeimage == NULL) {
+        freeimage (result, size_x, size_y);
+        return NULL;
+    }
+
+    /* sharp_grayscale, egy csatornába */
+    for (int i = 0; i < size_y; i++) {
+        for (int j = 0; j < size_x; j++) {
+            result[i][j][0] = edge_pixel(edgeimage[i][j], channels) ? 255 : 0;
+        }
+    }
+    freeimage (edgeimage, size_x, size_y);
+    return result;
+}
+
 /**
  * @brief megkeresi a képen található objektumok függőleges széleit
  *
  * @param[in] ***image a kép amin keresni kell
  * @param[in] size_x a kép oszlopainak száma
  * @param[in] size_y a kép sorainak száma
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[out] edgeimage az éleket tartalmazó egycsatornás (szürkeárnyalatos) kép, az élek 255-ös, minden más 0 értékű
  *
  * Mivel egy teljesen új képet hozunk létre, először lemásoljuk a képet.
  * Ezek után sorrendben a következő műveleteket hajtjuk végre:
@@ -249,43 +343,168 @@ void set_white(unsigned char pixel[], int treshold) {
  * - set_white a kicsit sötét színek kivételével (9 felett) teljesen fehérré (255) változtatjuk a pixeleket, a többi fekete (0) lesz, így élesebbek lesznek az élek
  * - 3x3 Gauss-blur tompítjuk az éleket, a következő művelethez
  * - sharp_grayscale ami a pixel értékéhez legközelebbi szélsőértékhez igazítja a pixel értékét (128 alatt 0, 128 felett 255), így nagyon vékony élek keletkeznek, mivel az előző művelet összemossa a fehér és fekete színeket, így csak a legbelső élek maradnak meg.
+ * Az utolsó lépés után a három szín biztosan azonos, ezért az eredményt már csak egy csatornán tároljuk. Ha a bemenet is szürkeárnyalatos, akkor az egész folyamat egy csatornán fut.
+ * @see detect_edge_spans
+ */
+
+unsigned char ***detect_edges(unsigned char ***image, int size_x, int size_y, int channels) {
+    long long began = trace_begin();
+    unsigned char ***result = edges_image(image, size_x, size_y, channels);
+    trace_end("detect_edges", began);
+    return result;
+}
+
+/**
+ * @brief a detect_edges memóriaigényének becslése
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[in] banded true esetén a konvolúciók sávonkénti változatával
+ * @param[out] bytes a kép mellett egyszerre lefoglalt legtöbb bájt, az egycsatornás eredménnyel együtt
+ * @see detect_edges
  */
+long long detect_edges_bytes(int size_x, int size_y, int channels, bool banded) {
+    return image_bytes(size_x, size_y, 1) + image_bytes(size_x, size_y, channels) + convolve_bytes(size_x, size_y, 1, channels, banded);
+}
 
-unsigned char ***detect_edges(unsigned char ***image, int size_x, int size_y) {
-    unsigned char ***edgeimage = allocateimage (size_x, size_y);
+/**
+ * @brief az élindex építésének adatai a szálak számára
+ */
+typedef struct EdgeSpansJob {
+    unsigned char ***edgeimage; /**< a filter_edges eredménye */
+    int size_x; /**< a kép oszlopainak száma */
+    int channels; /**< az edgeimage csatornáinak száma */
+    EdgeSpans *spans; /**< az épülő index */
+} EdgeSpansJob;
 
-    for (int i = 0; i < size_y; i++) {
-        for (int j = 0; j < size_x; j++) {
-            for (int k = 0; k < 3; k++) {
-                edgeimage[i][j][k] = image[i][j][k];
-            }
-        }
+/**
+ * @brief megszámolja a [first, last) sorok éleit, az offsets[line + 1]-be
+ */
+static void count_edges_rows(int first, int last, void *data) {
+    EdgeSpansJob *job = (EdgeSpansJob *) data;
+    for (int line = first; line < last; line++) {
+        int count = 0;
+        for (int elem = 0; elem < job->size_x; elem++)
+            count += edge_pixel(job->edgeimage[line][elem], job->channels);
+        job->spans->offsets[line + 1] = count;
     }
+}
 
-    Filter blur;
-    setfilter(&blur, (int[]) {1, 2, 1, 2, 4, 2, 1, 2, 1}, 1/16.0, 3, 3);
-    Filter vertical_line;
-    setfilter(&vertical_line, (int[]) {-1, 2, -1, -1, 2, -1, -1, 2, -1}, 1, 3, 3);
+/**
+ * @brief kiírja a [first, last) sorok éleinek oszlopait a columns-ba
+ */
+static void fill_edges_rows(int first, int last, void *data) {
+    EdgeSpansJob *job = (EdgeSpansJob *) data;
+    for (int line = first; line < last; line++) {
+        int *column = job->spans->columns + job->spans->offsets[line];
+        for (int elem = 0; elem < job->size_x; elem++)
+            if (edge_pixel(job->edgeimage[line][elem], job->channels))
+                *column++ = elem;
+    }
+}
 
-    convolve(edgeimage, size_x, size_y, blur, 1);
-    convolve(edgeimage, size_x, size_y, vertical_line, 1);
+/**
+ * @brief mint a detect_edges, de az éleket soronkénti oszloplistaként adja vissza
+ * @param[in] ***image a kép amin keresni kell
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[out] spans az élek indexe, vagy NULL ha nem sikerült lefoglalni a memóriát. A freeedgespans-szel kell felszabadítani.
+ *
+ * A képen többnyire kevés él van, ezért a teljes maszk helyett csak az élek oszlopait tároljuk: először soronként megszámoljuk az éleket, ebből prefix összeggel kapjuk a sorok kezdőindexét, majd kiírjuk az oszlopokat. Mindkét menet párhuzamosan fut.
+ * @see detect_edges
+ * @see parallel_rows
+ */
+EdgeSpans *detect_edge_spans(unsigned char ***image, int size_x, int size_y, int channels) {
+    EdgeSpans *spans = (EdgeSpans *) mem_calloc(1, sizeof(EdgeSpans));
+    if (spans == NULL)
+        return NULL;
+    spans->size_y = size_y;
+    spans->offsets = (long long *) mem_calloc(size_y + 1, sizeof(long long));
+    unsigned char ***edgeimage = (spans->offsets != NULL) ? filter_edges (image, size_x, size_y, channels) : NULL;
+    if (edgeimage == NULL) {
+        freeedgespans(spans);
+        return NULL;
+    }
 
-    for (int i = 0; i < size_y; i++) {
-        for (int j = 0; j < size_x; j++) {
-            set_white (edgeimage[i][j], 9);
-        }
+    EdgeSpansJob job = {edgeimage, size_x, channels, spans};
+    parallel_rows(size_y, count_edges_rows, &job);
+    for (int line = 0; line < size_y; line++)
+        spans->offsets[line + 1] += spans->offsets[line];
+    spans->columns = (int *) mem_alloc((size_t) (spans->offsets[size_y] + 1) * sizeof(int));
+    if (spans->columns != NULL)
+        parallel_rows(size_y, fill_edges_rows, &job);
+    freeimage (edgeimage, size_x, size_y);
+    if (spans->columns == NULL) {
+        freeedgespans(spans);
+        return NULL;
     }
+    return spans;
+}
 
-    convolve(edgeimage, size_x, size_y, blur, 1);
+/**
+ * @brief felszabadítja a detect_edge_spans eredményét
+ * @param[in] *spans az index, lehet NULL
+ */
+void freeedgespans(EdgeSpans *spans) {
+    if (spans == NULL)
+        return;
+    mem_free(spans->offsets);
+    mem_free(spans->columns);
+    mem_free(spans);
+}
 
-    for (int i = 0; i < size_y; i++) {
-        for (int j = 0; j < size_x; j++) {
-            sharp_grayscale (edgeimage[i][j]);
+/**
+ * @brief egycsatornás, szürkeárnyalatos képpé alakítja a képet
+ * @param[in] *image az átalakítandó kép
+ *
+ * A grayscale függvénnyel azonos módon számolja ki a pixelek értékét, de az eredményt már csak egy csatornán tárolja, így a további lépések harmad annyi adaton dolgoznak.
+ * @see grayscale
+ * @see expand_rgb
+ */
+void grayscale_image(PPM_Image *image) {
+    if (image->channels == 1)
+        return;
+    unsigned char ***gray = allocateimage_channels(image->size_x, image->size_y, 1);
+    if (gray == NULL) {
+        perror("error allocating image");
+        abort();
+    }
+    for (int i = 0; i < image->size_y; i++) {
+        for (int j = 0; j < image->size_x; j++) {
+            unsigned char *pixel = image->image_data[i][j];
+            gray[i][j][0] = pixel[0] * 0.2989 + pixel[1] * 0.5870 + pixel[2] * 0.1140;
         }
     }
-    freefilter (blur);
-    freefilter (vertical_line);
-    return edgeimage;
+    freeimage(image->image_data, image->size_x, image->size_y);
+    image->image_data = gray;
+    image->channels = 1;
+}
+
+/**
+ * @brief egycsatornás kép esetén visszaalakítja a képet RGB-re
+ * @param[in] *image az átalakítandó kép
+ *
+ * Azok a lépések hívják, amelyek a színeket külön kezelik, és ezért három csatornára van szükségük. RGB képen nem csinál semmit.
+ * @see grayscale_image
+ */
+void expand_rgb(PPM_Image *image) {
+    if (image->channels == 3)
+        return;
+    unsigned char ***rgb = allocateimage(image->size_x, image->size_y);
+    if (rgb == NULL) {
+        perror("error allocating image");
+        abort();
+    }
+    for (int i = 0; i < image->size_y; i++) {
+        for (int j = 0; j < image->size_x; j++) {
+            for (int color = 0; color < 3; color++)
+                rgb[i][j][color] = image->image_data[i][j][0];
+        }
+    }
+    freeimage(image->image_data, image->size_x, image->size_y);
+    image->image_data = rgb;
+    image->channels = 3;
 }
 
 /**
@@ -308,20 +527,36 @@ void change_light(unsigned char pixel[], int percent) {
     pixel[2] = rgbpixel.b;
 }
 
+/**
+ * @brief felcseréli két pixel tartalmát
+ * @param[in] *a az egyik pixel
+ * @param[in] *b a másik pixel
+ * @param[in] channels a pixelek színcsatornáinak száma
+ *
+ * A pixelek mutatóit nem cserélhetjük fel, mert a kép sorfolytonos tárolása megköveteli, hogy minden mutató a helyén maradjon.
+ * @see allocateimage_channels
+ */
+static void swappixel(unsigned char *a, unsigned char *b, int channels) {
+    for (int color = 0; color < channels; color++) {
+        unsigned char temp = a[color];
+        a[color] = b[color];
+        b[color] = temp;
+    }
+}
+
 /**
  * @brief az átló mentén tükrözi a képet
  * @param[in] ***matrix a tükrözendő matrix (többnyire a kép)
  * @param[in] size_x a mátrix oszlopainak száma
  * @param[in] size_y a mátrix sorainak száma
+ * @param[in] channels a mátrix színcsatornáinak száma
  *
  * A bal felső sarokból kezdve, a pixeleket a jobb alsó sarokba helyezi át. Azért csak a sze_y/2-ig mert ha ennél tovább menne akkor visszacserélné az egész mátrixot.
  */
-void mirror_diagonal(unsigned char ***matrix, int size_x, int size_y) {
+void mirror_diagonal(unsigned char ***matrix, int size_x, int size_y, int channels) {
     for (int line = 0; line < size_y / 2; line++) {
         for (int row = 0; row < size_x; row++) {
-            unsigned char *temp = matrix[line][row];
-            matrix[line][row] = matrix[size_y-1-line][size_x-1-row];
-            matrix[size_y-1-line][size_x-1-row] = temp;
+            swappixel(matrix[line][row], matrix[size_y-1-line][size_x-1-row], channels);
         }
     }
 }
@@ -331,15 +566,14 @@ void mirror_diagonal(unsigned char ***matrix, int size_x, int size_y) {
  * @param[in] ***matrix a tükrözendő matrix (többnyire a kép)
  * @param[in] size_x a mátrix oszlopainak száma
  * @param[in] size_y a mátrix sorainak száma
+ * @param[in] channels a mátrix színcsatornáinak száma
  *
  * A sor első elemét a végére helyezi. Azért csak size_x/2-ig megy, mert ha ennél tovább menne akkor visszacserélné az egész mátrixot.
  */
-void mirror_vertical(unsigned char ***matrix, int size_x, int size_y) {
+void mirror_vertical(unsigned char ***matrix, int size_x, int size_y, int channels) {
     for (int line = 0; line < size_y; line++) {
         for (int row = 0; row < size_x/2; row++) {
-            unsigned char *temp = matrix[line][row];
-            matrix[line][row] = matrix[line][size_x-1-row];
-            matrix[line][size_x-1-row] = temp;
+            swappixel(matrix[line][row], matrix[line][size_x-1-row], channels);
         }
     }
 }
@@ -349,91 +583,279 @@ void mirror_vertical(unsigned char ***matrix, int size_x, int size_y) {
  * @param[in] ***matrix a tükrözendő matrix (többnyire a kép)
  * @param[in] size_x a mátrix oszlopainak száma
  * @param[in] size_y a mátrix sorainak száma
+ * @param[in] channels a mátrix színcsatornáinak száma
  *
  * Az oszlop első elemét a végére helyezi. Azért csak size_y/2-ig megy, mert ha ennél tovább menne akkor visszacserélné az egész mátrixot.
  */
-void mirror_horizontal(unsigned char ***matrix, int size_x, int size_y) {
+void mirror_horizontal(unsigned char ***matrix, int size_x, int size_y, int channels) {
     for (int line = 0; line < size_y / 2; line++) {
         for (int row = 0; row < size_x; row++) {
-            unsigned char *temp = matrix[line][row];
-            matrix[line][row] = matrix[size_y-1-line][row];
-            matrix[size_y-1-line][row] = temp;
+            swappixel(matrix[line][row], matrix[size_y-1-line][row], channels);
         }
     }
 }
 
 /**
- * @brief végrehajtja a konvolúciót, ami a blur és sharpen lépésekhez kell
- * @see pszeudokód és működési elv itt: https://en.wikipedia.org/wiki/Kernel_(image_processing)
- * @see Filter
- *
+ * @brief a konvolúció egy menete a kép egy CONV_TILE magas sávján, csempénként
+ * @param[in] ***src a menet bemenete, ebből töltjük be a csempéket a környezetükkel
+ * @param[in] *out[] a sáv sorainak helye, ide kerül a menet eredménye
+ * @param[in] ty a sáv első sora
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] filter a használandó filter
+ * @param[in] steps a menetben elvégzendő iterációk száma
+ * @param[in] halo_x mennyivel kell iterációnként vízszintesen kibővíteni a csempét
+ * @param[in] halo_y mennyivel kell iterációnként függőlegesen kibővíteni a csempét
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[in] *buf_a a csempe munkaterülete, legalább a kibővített csempe méretű
+ * @param[in] *buf_b a csempe másik munkaterülete, ugyanekkora
+ * @see convolve
+ */
+static void convolve_band(unsigned char ***src, unsigned char *out[], int ty, int size_x, int size_y, Filter filter, int steps, int halo_x, int halo_y, int channels, unsigned char *buf_a, unsigned char *buf_b) {
+    int ty1 = (ty + CONV_TILE < size_y) ? ty + CONV_TILE : size_y;
+
+    for (int tx = 0; tx < size_x; tx += CONV_TILE) {
+        int tx1 = (tx + CONV_TILE < size_x) ? tx + CONV_TILE : size_x;
+
+        /* a csempe a környezetével együtt, a kép szélére szorítva */
+        int ey0 = clamp(ty - steps * halo_y, 0, size_y);
+        int ey1 = clamp(ty1 + steps * halo_y, 0, size_y);
+        int ex0 = clamp(tx - steps * halo_x, 0, size_x);
+        int ex1 = clamp(tx1 + steps * halo_x, 0, size_x);
+        int ext_w = ex1 - ex0;
+
+        for (int y = ey0; y < ey1; y++) {
+            memcpy(buf_a + (y - ey0) * ext_w * channels, src[y][ex0], ext_w * channels);
+        }
+
+        unsigned char *in = buf_a;
+        unsigned char *next = buf_b;
+        for (int step = 1; step <= steps; step++) {
+            /* a kiszámolandó terület minden iterációval a filter sugarával csökken */
+            int cy0 = clamp(ty - (steps - step) * halo_y, 0, size_y);
+            int cy1 = clamp(ty1 + (steps - step) * halo_y, 0, size_y);
+            int cx0 = clamp(tx - (steps - step) * halo_x, 0, size_x);
+            int cx1 = clamp(tx1 + (steps - step) * halo_x, 0, size_x);
+            isa_kernels()->convolve_tile(in, next, ex0, ey0, ext_w, cy0, cy1, cx0, cx1, size_x, size_y, filter, channels);
+            unsigned char *temp = in;
+            in = next;
+            next = temp;
+        }
+
+        for (int y = ty; y < ty1; y++) {
+            memcpy(out[y - ty] + tx * channels, in + ((y - ey0) * ext_w + (tx - ex0)) * channels, (tx1 - tx) * channels);
+        }
+    }
+}
+
+/**
+ * @brief a convolve kevés memóriát használó változata, ha a kép másolatát nem lehet lefoglalni
  * @param[in] ***original módosítandó kép
  * @param[in] size_x a kép oszlopainak száma
  * @param[in] size_y a kép sorainak száma
  * @param[in] filter a használandó filter
+ * @param[in] times hányszor kell egymás után végrehajtani
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[in] depth egy menetben legfeljebb ennyi iteráció
+ * @param[in] halo_x mennyivel kell iterációnként vízszintesen kibővíteni a csempét
+ * @param[in] halo_y mennyivel kell iterációnként függőlegesen kibővíteni a csempét
+ * @param[in] *buf_a a csempe munkaterülete
+ * @param[in] *buf_b a csempe másik munkaterülete
+ * @param[out] success false ha a sávok pufferét sem sikerült lefoglalni, ekkor a kép nem változik
+ *
+ * A menetek a kép helyén futnak. Egy sáv eredménye egy gyűrűpufferbe kerül, és csak akkor írjuk vissza a képbe, amikor a későbbi sávok csempéinek környezete már nem éri el, így a későbbi sávok még az eredeti pixeleket olvassák. A teljes kép helyett így csak néhány sávnyi memória kell, az eredmény pedig ugyanaz.
+ * @see convolve
  */
-void convolve(unsigned char ***original, int size_x, int size_y, Filter filter, int times) {
-    double sur, sug, sub;
-    /* lefoglalunk egy új képet ahova az új értékeket írjuk */
-    unsigned char ***newmatrix = allocateimage(size_x, size_y);
-
-    int filterCenterX = filter.size_x / 2;
-    int filterCenterY = filter.size_y / 2;
-
-    for (int ttimes = 0; ttimes < times; ttimes++) {
-        for (int i = 0; i < size_y; i++) { /* sorok */
-            for(int j = 0; j < size_x; j++) { /* oszlopok */
-
-                sur = 0;
-                sug = 0;
-                sub = 0;
-
-                for (int k = 0; k < filter.size_y; k++) { /* a filter sorai */
-                    int kk = filter.size_y - 1 - k;      /* a megfordított filter sorai */
-
-                    for(int l = 0; l < filter.size_x; l++) { /* a filter oszlopai */
-                        int ll = filter.size_x - 1 - l; /* a megfordított filter oszlopai */
-
-                        /* a vizsgálandó pixel koordinátái */
-                        int ii = i + (filterCenterY - kk);
-                        int jj = j + (filterCenterX - ll);
-
-                        /* ha a koordináták a képen belül vannak */
-                        if( ii >= 0 && ii < size_y && jj >= 0 && jj < size_x ) {
-                            sur += original[ii][jj][0] * filter.mult*filter.filt[kk][ll];
-                            sug += original[ii][jj][1] * filter.mult*filter.filt[kk][ll];
-                            sub += original[ii][jj][2] * filter.mult*filter.filt[kk][ll];
-                        }
-                        /* ha kívül, akkor a hozzá legközelebb eső legszélső pixelt használjuk */
-                        else {
-                            /* az ii mindenképpen a két határon kívül van, tehát az értéke vagy a legfelső sor, vagy a legalsó */
-                            int newline = clamp(ii, 0, size_y-1);
-                            /* az jj mindenképpen a két határon kívül van, tehát az értéke vagy a legelső bal oldali oszlop, vagy a legszélső jobboldali */
-                            int newcol = clamp(jj, 0, size_x-1);
-                            sur += original[newline][newcol][0] * filter.mult*filter.filt[kk][ll];
-                            sug += original[newline][newcol][1] * filter.mult*filter.filt[kk][ll];
-                            sub += original[newline][newcol][2] * filter.mult*filter.filt[kk][ll];
-                        }
-                    }
-                }
-                /* végül átírjuk az üres képbe az adatokat úgy hogy levágjuk a 0 és 255 közötti intervallumra */
-                newmatrix[i][j][0] = (unsigned char) clamp(sur, 0, 255);
-                newmatrix[i][j][1] = (unsigned char) clamp(sug, 0, 255);
-                newmatrix[i][j][2] = (unsigned char) clamp(sub, 0, 255);
+static bool convolve_banded(unsigned char ***original, int size_x, int size_y, Filter filter, int times, int channels, int depth, int halo_x, int halo_y, unsigned char *buf_a, unsigned char *buf_b) {
+    /* egy sáv csempéinek környezete legfeljebb ennyi sávval korábbra ér vissza, ezekből nem írhatunk még vissza semmit */
+    int reach = (depth * halo_y + CONV_TILE - 1) / CONV_TILE + 1;
+    size_t row_bytes = (size_t) size_x * channels;
+    unsigned char *ring = (unsigned char *) mem_alloc(reach * CONV_TILE * row_bytes);
+    if (ring == NULL)
+        return false;
+
+    int bands = (size_y + CONV_TILE - 1) / CONV_TILE;
+    unsigned char *out[CONV_TILE];
+    for (int done = 0; done < times; done += depth) {
+        int steps = (times - done < depth) ? times - done : depth;
+
+        for (int band = 0; band < bands + reach; band++) {
+            int ready = band - reach;
+            if (ready >= 0) {
+                unsigned char *slot = ring + (ready % reach) * CONV_TILE * row_bytes;
+                for (int y = ready * CONV_TILE; y < size_y && y < (ready + 1) * CONV_TILE; y++)
+                    memcpy(original[y][0], slot + (y - ready * CONV_TILE) * row_bytes, row_bytes);
+            }
+            if (band < bands) {
+                unsigned char *slot = ring + (band % reach) * CONV_TILE * row_bytes;
+                for (int i = 0; i < CONV_TILE; i++)
+                    out[i] = slot + i * row_bytes;
+                convolve_band(original, out, band * CONV_TILE, size_x, size_y, filter, steps, halo_x, halo_y, channels, buf_a, buf_b);
             }
         }
+    }
+    mem_free(ring);
+    return true;
+}
+
+/**
+ * @brief a convolve egy menetének adatai a párhuzamos sávokhoz
+ */
+typedef struct ConvolveJob {
+    unsigned char ***src; /**< a menet bemenete */
+    unsigned char ***dst; /**< a menet kimenete */
+    int size_x; /**< a kép oszlopainak száma */
+    int size_y; /**< a kép sorainak száma */
+    Filter filter; /**< a használandó filter */
+    int steps; /**< a menetben elvégzendő iterációk száma */
+    int halo_x; /**< a csempe vízszintes bővítése iterációnként */
+    int halo_y; /**< a csempe függőleges bővítése iterációnként */
+    int channels; /**< a kép színcsatornáinak száma */
+    unsigned char *buffers; /**< a csempék munkaterületei, egyenként 2 * buf_bytes bájt */
+    size_t buf_bytes; /**< egy csempe puffer mérete */
+    pthread_mutex_t lock; /**< a szabad munkaterületek listájához */
+    int *free_slots; /**< a szabad munkaterületek sorszámai */
+    int free_count; /**< a szabad munkaterületek száma */
+} ConvolveJob;
+
+/**
+ * @brief lefoglal egy szabad csempe munkaterületet
+ *
+ * Egy szál egyszerre egy sávot dolgoz fel, ezért a szálak számánál kevés esetben fogy el; ilyenkor megvárjuk, hogy egy sáv elkészüljön.
+ */
+static int take_slot(ConvolveJob *job) {
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        int slot = (job->free_count > 0) ? job->free_slots[--job->free_count] : -1;
+        pthread_mutex_unlock(&job->lock);
+        if (slot >= 0)
+            return slot;
+        sched_yield();
+    }
+}
+
+/** @brief visszaadja a munkaterületet a szabadok közé */
+static void give_slot(ConvolveJob *job, int slot) {
+    pthread_mutex_lock(&job->lock);
+    job->free_slots[job->free_count++] = slot;
+    pthread_mutex_unlock(&job->lock);
+}
+
+/**
+ * @brief a convolve egy menete a [first, last) sávokon
+ */
+static void convolve_bands(int first, int last, void *data) {
+    long long began = trace_begin();
+    ConvolveJob *job = (ConvolveJob *) data;
+    int slot = take_slot(job);
+    unsigned char *buf_a = job->buffers + 2 * slot * job->buf_bytes;
+    unsigned char *out[CONV_TILE];
+    for (int band = first; band < last; band++) {
+        int ty = band * CONV_TILE;
+        for (int y = ty; y < job->size_y && y < ty + CONV_TILE; y++)
+            out[y - ty] = job->dst[y][0];
+        convolve_band(job->src, out, ty, job->size_x, job->size_y, job->filter, job->steps, job->halo_x, job->halo_y, job->channels, buf_a, buf_a + job->buf_bytes);
+    }
+    give_slot(job, slot);
+    trace_end_range("convolve_bands", began, first, last);
+}
+
+/**
+ * @brief hány csempe munkaterületet foglal a convolve
+ */
+static int convolve_slots(void) {
+    return parallel_threads() + CONV_EXTRA_SLOTS;
+}
 
-        /* átmásoljuk az új képet az eredetibe */
+/** @brief a convolve menetei, a paraméterei és az eredménye ugyanaz */
+static bool convolve_passes(unsigned char ***original, int size_x, int size_y, Filter filter, int times, int channels) {
+    if (times <= 0)
+        return true;
+
+    /* mennyivel kell iterációnként kibővíteni a csempét */
+    int halo_x = (int) max((double[]) {filter.size_x / 2, filter.size_x - 1 - filter.size_x / 2}, 2);
+    int halo_y = (int) max((double[]) {filter.size_y / 2, filter.size_y - 1 - filter.size_y / 2}, 2);
+    int depth = (times < CONV_MAX_DEPTH) ? times : CONV_MAX_DEPTH;
+    int buf_w = CONV_TILE + 2 * depth * halo_x;
+    int buf_h = CONV_TILE + 2 * depth * halo_y;
+    ConvolveJob job = {original, NULL, size_x, size_y, filter, 0, halo_x, halo_y, channels, NULL, (size_t) buf_w * buf_h * channels, PTHREAD_MUTEX_INITIALIZER, NULL, 0};
+
+    /* szálanként egy munkaterület, vagy ha annyi nem fér el, csak egy, és akkor egy szálon dolgozunk */
+    int slots = convolve_slots();
+    job.buffers = (unsigned char *) mem_alloc(slots * 2 * job.buf_bytes);
+    if (job.buffers == NULL) {
+        slots = 1;
+        job.buffers = (unsigned char *) mem_alloc(2 * job.buf_bytes);
+    }
+    job.free_slots = (int *) mem_alloc(slots * sizeof(int));
+    if (job.buffers == NULL || job.free_slots == NULL) {
+        mem_free(job.buffers);
+        mem_free(job.free_slots);
+        return false;
+    }
+    for (int i = 0; i < slots; i++)
+        job.free_slots[job.free_count++] = i;
+
+    /* lefoglalunk egy új képet ahova az új értékeket írjuk */
+    unsigned char ***newmatrix = allocateimage_channels(size_x, size_y, channels);
+    if (newmatrix == NULL) {
+        bool success = convolve_banded(original, size_x, size_y, filter, times, channels, depth, halo_x, halo_y, job.buffers, job.buffers + job.buf_bytes);
+        mem_free(job.buffers);
+        mem_free(job.free_slots);
+        return success;
+    }
+
+    int bands = (size_y + CONV_TILE - 1) / CONV_TILE;
+    job.dst = newmatrix;
+    for (int done = 0; done < times; done += depth) {
+        job.steps = (times - done < depth) ? times - done : depth;
+        if (slots > 1)
+            parallel_rows(bands, convolve_bands, &job);
+        else
+            convolve_bands(0, bands, &job);
+
+        unsigned char ***temp = job.src;
+        job.src = job.dst;
+        job.dst = temp;
+    }
+
+    /* ha páratlan számú menet volt, az eredmény az új képben van, ezt még át kell másolni az eredetibe */
+    if (job.src != original) {
         for (int y = 0; y < size_y; y++) {
-            for (int x = 0; x < size_x; x++) {
-                original[y][x][0] = newmatrix[y][x][0];
-                original[y][x][1] = newmatrix[y][x][1];
-                original[y][x][2] = newmatrix[y][x][2];
-            }
+            memcpy(original[y][0], job.src[y][0], size_x * channels);
         }
     }
+    mem_free(job.buffers);
+    mem_free(job.free_slots);
     /* felszabadítjuk az új képet */
     freeimage(newmatrix, size_x, size_y);
+    return true;
+}
+
+/**
+ * @brief végrehajtja a konvolúciót, ami a blur és sharpen lépésekhez kell
+ * @see pszeudokód és működési elv itt: https://en.wikipedia.org/wiki/Kernel_(image_processing)
+ * @see Filter
+ * @see convolve_tile
+ *
+ * @param[in] ***original módosítandó kép
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] filter a használandó filter
+ * @param[in] times hányszor kell egymás után végrehajtani
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[out] success false ha nem sikerült lefoglalni a munkaterületet, ekkor a kép nem változik
+ *
+ * Az iterációkat nem egyesével futtatjuk végig az egész képen, hanem egy menetben legfeljebb CONV_MAX_DEPTH iterációt végzünk el egy CONV_TILE méretű csempén (temporal blocking).
+ * Ehhez a csempét iterációnként a filter sugarával kibővített környezettel együtt töltjük be egy kis pufferbe, ami elfér a cache-ben. Minden iteráció után a kiszámolt terület a filter sugarával csökken, így az utolsó iteráció után pont a csempe marad meg, ami ugyanaz, mintha az iterációkat egymás után az egész képen hajtottuk volna végre.
+ * A menetek két kép között váltakoznak (ping-pong), így nem kell minden iteráció után visszamásolni az eredményt, legfeljebb egyszer a legvégén. Egy menet sávjai egymástól függetlenek, ezeket párhuzamosan számoljuk, minden szál a saját csempe munkaterületével. Ha a második képet nem lehet lefoglalni (pl. a memóriakorlát miatt), a convolve_banded a kép helyén, sávonként végzi el ugyanezt.
+ * @see convolve_banded
+ */
+bool convolve(unsigned char ***original, int size_x, int size_y, Filter filter, int times, int channels) {
+    long long began = trace_begin();
+    bool success = convolve_passes(original, size_x, size_y, filter, times, channels);
+    trace_end("convolve", began);
+    return success;
 }
 
 /**
@@ -472,6 +894,223 @@ void sortcopy(Sort partline[], unsigned char ***image, int line, int start, int
             reverse_i++;
     }
 }
+/**
+ * @brief a convolve munkaterületének becslése 3x3-as filterre
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] times hányszor hajtjuk végre
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[in] banded true esetén a convolve_banded változaté, ami a kép másolata helyett néhány sávot foglal le
+ * @param[out] bytes a convolve által a kép mellett egyszerre lefoglalt legtöbb bájt
+ * @see convolve
+ */
+long long convolve_bytes(int size_x, int size_y, int times, int channels, bool banded) {
+    if (times <= 0)
+        return 0;
+    int depth = (times < CONV_MAX_DEPTH) ? times : CONV_MAX_DEPTH;
+    long long buf = (long long) (CONV_TILE + 2 * depth) * (CONV_TILE + 2 * depth) * channels;
+    long long tiles = 2 * buf * convolve_slots() + convolve_slots() * (long long) sizeof(int);
+    if (!banded)
+        return tiles + image_bytes(size_x, size_y, channels);
+    int reach = (depth + CONV_TILE - 1) / CONV_TILE + 1;
+    return tiles + (long long) reach * CONV_TILE * size_x * channels;
+}
+
+/**
+ * @brief a median_filter adatai a párhuzamos oszlopsávokhoz
+ */
+typedef struct MedianJob {
+    unsigned char ***src; /**< a bemeneti kép */
+    unsigned char ***dst; /**< ide írjuk a szűrt képet */
+    int size_x; /**< a kép oszlopainak száma */
+    int size_y; /**< a kép sorainak száma */
+    int channels; /**< a kép színcsatornáinak száma */
+    int radius; /**< az ablak sugara */
+    atomic_bool failed; /**< nem sikerült lefoglalni egy sáv hisztogramjait */
+} MedianJob;
+
+/** @brief az index a [0, last] tartományba szorítva, a kép széleit így ismételjük */
+static inline int clamp_index(int value, int last) {
+    return (value < 0) ? 0 : ((value > last) ? last : value);
+}
+
+/**
+ * @brief egy oszlopsáv hisztogramjainak mérete bájtban
+ *
+ * A sáv és a két oldalán a sugárnyi (és még egy) oszlop színenként egy 256 rekeszes finom és egy 16 rekeszes durva hisztogramja, ugyanez az ablakra, és az ablak finom hisztogramjának 16 szakaszához az utolsó frissítés oszlopa.
+ */
+static size_t median_strip_bytes(int radius, int channels) {
+    size_t columns = MEDIAN_STRIP + 2 * radius + 2;
+    return (columns + 1) * channels * (256 + 16) * sizeof(uint16_t) + channels * 16 * sizeof(int);
+}
+
+/** @brief hozzáadja (delta = 1) vagy kivonja (delta = -1) egy sor pixeleit a [lo, hi] oszlopok hisztogramjaiból */
+static void median_columns_row(unsigned char **row, int lo, int hi, int channels, uint16_t *fine, uint16_t *coarse, int delta) {
+    for (int x = lo; x <= hi; x++) {
+        for (int color = 0; color < channels; color++) {
+            int index = (x - lo) * channels + color;
+            unsigned char value = row[x][color];
+            fine[index * 256 + value] += delta;
+            coarse[index * 16 + (value >> 4)] += delta;
+        }
+    }
+}
+
+/** @brief hozzáadja (delta = 1) vagy kivonja (delta = -1) egy oszlop hisztogramjának n elemét az ablakéból */
+static inline void median_add(uint16_t *kernel, const uint16_t *column, int n, int delta) {
+    for (int i = 0; i < n; i++)
+        kernel[i] += delta * column[i];
+}
+
+/**
+ * @brief a medián szűrő egy oszlopsávon
+ * @param[in] *job a szűrő adatai
+ * @param[in] strip a sáv sorszáma
+ * @param[in] *memory a median_strip_bytes méretű munkaterület
+ *
+ * Az oszlophisztogramok a sorral együtt lefelé csúsznak: minden sor után kivesszük a legfelső és hozzáadjuk a következő sor pixelét. Az ablak hisztogramja soronként újraindul, és jobbra csúszik: a durva hisztogramhoz minden oszlopnál hozzáadjuk a belépő és kivonjuk a kilépő oszlopét.
+ * A finom hisztogramnak csak azt a 16 rekeszes szakaszát hozzuk naprakészre, amelyikbe a durva hisztogram szerint a medián esik, így egy pixel költsége nem függ a sugártól.
+ */
+static void median_strip(MedianJob *job, int strip, uint16_t *memory) {
+    int radius = job->radius;
+    int channels = job->channels;
+    int last_x = job->size_x - 1;
+    int last_y = job->size_y - 1;
+    int x0 = strip * MEDIAN_STRIP;
+    int x1 = (x0 + MEDIAN_STRIP < job->size_x) ? x0 + MEDIAN_STRIP : job->size_x;
+    int lo = clamp_index(x0 - radius - 1, last_x);
+    int hi = clamp_index(x1 - 1 + radius, last_x);
+    int columns = hi - lo + 1;
+    int target = (2 * radius + 1) * (2 * radius + 1) / 2;
+
+    uint16_t *fine = memory;
+    uint16_t *coarse = fine + (size_t) columns * channels * 256;
+    uint16_t *kernel_fine = coarse + (size_t) columns * channels * 16;
+    uint16_t *kernel_coarse = kernel_fine + channels * 256;
+    int *updated = (int *) (kernel_coarse + channels * 16);
+
+    memset(fine, 0, (size_t) columns * channels * 256 * sizeof(uint16_t));
+    memset(coarse, 0, (size_t) columns * channels * 16 * sizeof(uint16_t));
+    for (int y = -radius; y <= radius; y++)
+        median_columns_row(job->src[clamp_index(y, last_y)], lo, hi, channels, fine, coarse, 1);
+
+    for (int y = 0; y <= last_y; y++) {
+        memset(kernel_coarse, 0, channels * 16 * sizeof(uint16_t));
+        for (int x = x0 - radius; x <= x0 + radius; x++)
+            for (int color = 0; color < channels; color++)
+                median_add(kernel_coarse + color * 16, coarse + ((clamp_index(x, last_x) - lo) * channels + color) * 16, 16, 1);
+        for (int i = 0; i < channels * 16; i++)
+            updated[i] = x0 - 2 * radius - 2;
+
+        for (int x = x0; x < x1; x++) {
+            if (x > x0) {
+                int enter = (clamp_index(x + radius, last_x) - lo) * channels;
+                int leave = (clamp_index(x - radius - 1, last_x) - lo) * channels;
+                for (int color = 0; color < channels; color++) {
+                    median_add(kernel_coarse + color * 16, coarse + (enter + color) * 16, 16, 1);
+                    median_add(kernel_coarse + color * 16, coarse + (leave + color) * 16, 16, -1);
+                }
+            }
+            for (int color = 0; color < channels; color++) {
+                uint16_t *counts = kernel_coarse + color * 16;
+                int sum = 0;
+                int segment = 0;
+                while (sum + counts[segment] <= target)
+                    sum += counts[segment++];
+
+                /* a szakaszt frissítjük a legutóbbi állapotából, vagy ha az újraszámolás olcsóbb, az ablak oszlopaiból összeadjuk */
+                uint16_t *bins = kernel_fine + color * 256 + segment * 16;
+                int *since = &updated[color * 16 + segment];
+                if (2 * (x - *since) > 2 * radius + 1) {
+                    memset(bins, 0, 16 * sizeof(uint16_t));
+                    for (int column = x - radius; column <= x + radius; column++)
+                        median_add(bins, fine + ((clamp_index(column, last_x) - lo) * channels + color) * 256 + segment * 16, 16, 1);
+                } else {
+                    for (int column = *since + 1; column <= x; column++) {
+                        median_add(bins, fine + ((clamp_index(column + radius, last_x) - lo) * channels + color) * 256 + segment * 16, 16, 1);
+                        median_add(bins, fine + ((clamp_index(column - radius - 1, last_x) - lo) * channels + color) * 256 + segment * 16, 16, -1);
+                    }
+                }
+                *since = x;
+
+                int bin = 0;
+                while (sum + bins[bin] <= target)
+                    sum += bins[bin++];
+                job->dst[y][x][color] = (unsigned char) (segment * 16 + bin);
+            }
+        }
+
+        if (y < last_y) {
+            median_columns_row(job->src[clamp_index(y - radius, last_y)], lo, hi, channels, fine, coarse, -1);
+            median_columns_row(job->src[clamp_index(y + radius + 1, last_y)], lo, hi, channels, fine, coarse, 1);
+        }
+    }
+}
+
+/**
+ * @brief a medián szűrő a [first, last) oszlopsávokon
+ */
+static void median_strips(int first, int last, void *data) {
+    long long began = trace_begin();
+    MedianJob *job = (MedianJob *) data;
+    uint16_t *memory = (uint16_t *) mem_alloc(median_strip_bytes(job->radius, job->channels));
+    if (memory == NULL) {
+        atomic_store(&job->failed, true);
+        return;
+    }
+    for (int strip = first; strip < last; strip++)
+        median_strip(job, strip, memory);
+    mem_free(memory);
+    trace_end_range("median_strips", began, first, last);
+}
+
+/**
+ * @brief medián szűrő, minden pixel színét a (2 * radius + 1)^2 méretű környezetének mediánjára cseréli, színenként
+ * @param[in] ***image a módosítandó kép
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[in] radius az ablak sugara, legfeljebb MEDIAN_MAX_RADIUS
+ * @param[out] success false ha nem sikerült lefoglalni a munkaterületet, ekkor a kép nem változik
+ *
+ * A zajt eltávolítja, de az éleket megtartja, ezért érdemes az élkeresés és az edges pixelsort előtt futtatni. Perreault és Hébert csúszó hisztogramos módszerével egy pixel költsége állandó, nem függ a sugártól.
+ * A kép széleit ismételjük, mint a convolve. A kép MEDIAN_STRIP széles oszlopsávjai egymástól függetlenek, ezeket párhuzamosan számoljuk, minden sáv a saját oszlophisztogramjaival.
+ * @see median_strip
+ */
+bool median_filter(unsigned char ***image, int size_x, int size_y, int channels, int radius) {
+    if (radius <= 0)
+        return true;
+    long long began = trace_begin();
+    unsigned char ***result = allocateimage_channels(size_x, size_y, channels);
+    if (result == NULL)
+        return false;
+    MedianJob job = {image, result, size_x, size_y, channels, radius, false};
+    parallel_rows((size_x + MEDIAN_STRIP - 1) / MEDIAN_STRIP, median_strips, &job);
+    bool success = !atomic_load(&job.failed);
+    if (success) {
+        for (int y = 0; y < size_y; y++)
+            memcpy(image[y][0], result[y][0], (size_t) size_x * channels);
+    }
+    freeimage(result, size_x, size_y);
+    trace_end("median", began);
+    return success;
+}
+
+/**
+ * @brief a median_filter munkaterületének becslése
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] channels a kép színcsatornáinak száma
+ * @param[in] radius az ablak sugara
+ * @param[out] bytes a median_filter által a kép mellett egyszerre lefoglalt legtöbb bájt
+ * @see median_filter
+ */
+long long median_bytes(int size_x, int size_y, int channels, int radius) {
+    if (radius <= 0)
+        return 0;
+    return image_bytes(size_x, size_y, channels) + (long long) convolve_slots() * median_strip_bytes(radius, channels);
+}
+
 /**
  * @brief A pixelsort segédfüggvénye. A cím szerint megadott *treshold paraméterbe állítja be a felső tresholdot az alapján hogy a pixelsort milyen paraméterket kapott
  * @param[in] *treshold a paraméter amibe vissza kell írni az értéket
@@ -479,11 +1118,13 @@ void sortcopy(Sort partline[], unsigned char ***image, int line, int start, int
  * @see PsOptions
  * @see ps_option_type
  *
+ * @param[in] *seed a sor véletlenszám-generátorának állapota
+ *
  * Ha a ps_option_type ran akkor egy véletlenszerű értéket választunk a felső és alsó korlát között. Ha man akkor csak az alsó korlátot vesszük figyelembe.
  */
-static void checktreshold_top(int *treshold, PsOptions options) {
+static void checktreshold_top(int *treshold, PsOptions options, unsigned int *seed) {
     if (options.treshold == ran)
-        *treshold = (rand()%(options.treshold_top_max - options.treshold_top_min + 1) + options.treshold_top_min);
+        *treshold = (rand_r(seed)%(options.treshold_top_max - options.treshold_top_min + 1) + options.treshold_top_min);
     else
         *treshold = options.treshold_top_min;
 }
@@ -495,11 +1136,13 @@ static void checktreshold_top(int *treshold, PsOptions options) {
  * @see PsOptions
  * @see ps_option_type
  *
+ * @param[in] *seed a sor véletlenszám-generátorának állapota
+ *
  * Ha a ps_option_type ran akkor egy véletlenszerű értéket választunk a felső és alsó korlát között. Ha man akkor csak az alsó korlátot vesszük figyelembe.
  */
-static void checktreshold_bottom(int *treshold, PsOptions options) {
+static void checktreshold_bottom(int *treshold, PsOptions options, unsigned int *seed) {
     if (options.treshold == ran)
-        *treshold = (rand()%(options.treshold_bottom_max - options.treshold_bottom_min + 1) + options.treshold_bottom_min);
+        *treshold = (rand_r(seed)%(options.treshold_bottom_max - options.treshold_bottom_min + 1) + options.treshold_bottom_min);
     else
         *treshold = options.treshold_bottom_min;
 }
@@ -509,14 +1152,15 @@ static void checktreshold_bottom(int *treshold, PsOptions options) {
  * @param[in] *interval a paraméter amibe vissza kell írni az értéket
  * @param[in] options a pixelsort által kapott tulajdonságok
  * @param[in] elem az éppen aktuálisan vizsgált pixel oszlopszáma
+ * @param[in] *seed a sor véletlenszám-generátorának állapota
  * @see PsOptions
  * @see ps_option_type
  *
  * Ha a ps_option_type ran akkor egy véletlenszerű értéket választunk a felső és alsó korlát között. Ha man akkor csak az alsó korlátot vesszük figyelembe.
  */
-static void checkinterval(int *interval, PsOptions options, int elem) {
+static void checkinterval(int *interval, PsOptions options, int elem, unsigned int *seed) {
     if (options.interval == ran)
-        *interval = rand()%(options.interval_max - options.interval_min + 1) + options.interval_min;
+        *interval = rand_r(seed)%(options.interval_max - options.interval_min + 1) + options.interval_min;
     else
         *interval = options.interval_min;
     if (*interval < 0)
@@ -524,113 +1168,345 @@ static void checkinterval(int *interval, PsOptions options, int elem) {
 }
 
 /**
- * @brief Végrehajtja a pixelsort-ot.
- * @param[in] ***image a módosítandó kép
- * @param[in] size_x a kép oszlopainak száma
- * @param[in] size_y a kép sorainak száma
- * @param[in] options a pixelsort tulajdonságai a PsOptions struktúraként
- * @see PsOptions
- * @see sortcopy
- *
- * Az algoritmus lényege, hogy a megadott típus alapján (HSL lightness, RGB intesity) minden sorban keres egy olyan pixelt ami belefér a megadott treshold-ba (bottom, top). Az edges típusnál a kép objektumainak függőleges széleit keresi meg és ezek a határok között rendez.
- * A megtalált pixelnek egy valamilyen a PsOptions-ban meghatározott környezetét vesszük és ezen a környezeten sorba rendezzük a pixeleket a megadott típus alapján, a szintén megadott irányba.
- *
-*/
-void pixelsort(unsigned char ***image, int size_x, int size_y, PsOptions options) {
-    int times = 0;
+ * @brief a pixelsort adatai a szálak számára
+ */
+typedef struct PixelsortJob {
+    unsigned char ***image; /**< a módosítandó kép */
+    EdgeSpans *spans; /**< az edges típusnál az élek indexe */
+    int size_x; /**< a kép oszlopainak száma */
+    const int *extent; /**< soronként a rendezendő [első, utolsó utáni) oszlop, vagy NULL ha minden sor teljes */
+    PsOptions options; /**< a pixelsort tulajdonságai */
+    unsigned int seed; /**< ebből számoljuk a soronkénti véletlenszám-generátorok kezdőértékét */
+    int *times; /**< soronként a rendezések száma */
+} PixelsortJob;
 
-    /* edges típusú pixelsort. Ez adja a legjobb eredményt.*/
-    if (options.pstype == edges) {
-        time_t seconds;
-        seconds = time(NULL);
-        int lastelem;
-        int interval = 0;
-        unsigned char ***edgeimage = detect_edges (image, size_x, size_y);
-        for (int line = 0; line < size_y; line++) {
-            lastelem = 0;
-            for (int elem = 0; elem < size_x; elem++) {
-                if (edgeimage[line][elem][0] == 255) { /* a fehér szín egy edge*/
-                    interval = elem-lastelem;
-                    int size = (elem < interval) ? elem : interval; /* ha az aktuális pixel közelebb van a kép széléhez mint a megválasztott környezet akkor ennek megfelelő méretet kell választani */
-                    int start = (int) max((double[]){elem-interval, 0}, 2); /* az előzőhöz hasonlóan */
-                    Sort partline[size];
-                    int i = 0; /* az új tömb számlálója */
-                    for (int interval_i = start; interval_i < elem; interval_i++) {
-                        partline[i].idx = interval_i;
-                        partline[i].value = rgb2hsl(image[line][interval_i]).l; /* HSL Lightness alapján rendezünk*/
-                        i++;
-                    }
-                    sortcopy(partline, image, line, start, elem, 0); // többnyire jobb az eredmény ha világostól sötét fele rendezünk (dir=0), mert többnyire arra számítunk, hogy egy objektum sötétebb, mint a háttér
-                    times++;
-                    lastelem = elem;
-                    //break;
-                }
+/**
+ * @brief az edges típusú pixelsort a [first, last) sorokon
+ *
+ * Minden sorban két szomszédos él között rendezünk, az első élnél a sor elejétől. Az élek indexéből közvetlenül a szakaszokon megyünk végig, a sor többi pixelét nem kell megvizsgálni. Ha a soroknak saját terjedelmük van (job->extent), akkor az azon kívül eső éleket kihagyjuk.
+ */
+static void pixelsort_edges_rows(int first, int last, void *data) {
+    long long began = trace_begin();
+    PixelsortJob *job = (PixelsortJob *) data;
+    unsigned char ***image = job->image;
+    EdgeSpans *spans = job->spans;
+
+    for (int line = first; line < last; line++) {
+        int start = (job->extent != NULL) ? job->extent[2*line] : 0;
+        int end = (job->extent != NULL) ? job->extent[2*line + 1] : job->size_x;
+        for (long long k = spans->offsets[line]; k < spans->offsets[line + 1]; k++) {
+            int elem = spans->columns[k];
+            if (elem > end)
+                break;
+            if (elem < start)
+                continue;
+            if (elem > start) {
+                Sort partline[elem - start];
+                isa_kernels()->lightness_keys(partline, image[line][0], start, elem); /* HSL Lightness alapján rendezünk*/
+                sortcopy(partline, image, line, start, elem, 0); // többnyire jobb az eredmény ha világostól sötét fele rendezünk (dir=0), mert többnyire arra számítunk, hogy egy objektum sötétebb, mint a háttér
             }
+            job->times[line]++;
+            start = elem;
         }
-        freeimage(edgeimage, size_x, size_y);
-        printf("Edges pixelsort %d alkalommal végrehajtva, %ld másodperc alatt\n", times, time(NULL)-seconds);
-        return;
     }
+    trace_end_range("pixelsort_edges_rows", began, first, last);
+}
+
+/**
+ * @brief az edges típusú pixelsort sorainak becsült munkaigénye, prefix összegként
+ * @param[in] *spans az élek indexe
+ * @param[out] cost spans->size_y + 1 elemű tömb, vagy NULL ha nem sikerült lefoglalni
+ *
+ * Egy n hosszú szakasz rendezése nagyjából n * log2(n) lépés, ehhez soronként egy egységet adunk a sor bejárásáért.
+ * @see parallel_rows_weighted
+ */
+static long long *edge_spans_cost(EdgeSpans *spans) {
+    long long *cost = (long long *) mem_alloc((spans->size_y + 1) * sizeof(long long));
+    if (cost == NULL)
+        return NULL;
+    cost[0] = 0;
+    for (int line = 0; line < spans->size_y; line++) {
+        long long row = 1;
+        int start = 0;
+        for (long long k = spans->offsets[line]; k < spans->offsets[line + 1]; k++) {
+            unsigned int length = (unsigned int) (spans->columns[k] - start);
+            if (length > 0)
+                row += (long long) length * (32 - __builtin_clz(length));
+            start = spans->columns[k];
+        }
+        cost[line + 1] = cost[line] + row;
+    }
+    return cost;
+}
 
+/**
+ * @brief a küszöb alapú pixelsort a [first, last) sorokon
+ *
+ * Minden sornak saját véletlenszám-generátora van, aminek a kezdőértéke csak a job->seed-től és a sor számától függ, így az eredmény nem függ attól, hogy hány szálon és milyen sávokban dolgozzuk fel a képet.
+ */
+static void pixelsort_rows(int first, int last, void *data) {
+    long long began = trace_begin();
+    PixelsortJob *job = (PixelsortJob *) data;
+    unsigned char ***image = job->image;
+    PsOptions options = job->options;
     int interval;
     int treshold_top, treshold_bottom;
 
-    for (int line = 0; line < size_y; line++) {
-        for (int elem = 0; elem < size_x; elem++) {
+    for (int line = first; line < last; line++) {
+        unsigned int seed = job->seed + (unsigned int) line * 2654435761u;
+        int row_first = (job->extent != NULL) ? job->extent[2*line] : 0;
+        int row_last = (job->extent != NULL) ? job->extent[2*line + 1] : job->size_x;
+        for (int elem = row_first; elem < row_last; elem++) {
             if (options.pstype == hsl_l) { /* ha HSL Lightness alapján kell sortolni */
-                checktreshold_top (&treshold_top, options); /* beállítjuk a tresholdot az alapján hogy mi a beállítás */
-                checktreshold_bottom (&treshold_bottom, options); /* beállítjuk a tresholdot az alapján hogy mi a beállítás */
+                checktreshold_top (&treshold_top, options, &seed); /* beállítjuk a tresholdot az alapján hogy mi a beállítás */
+                checktreshold_bottom (&treshold_bottom, options, &seed); /* beállítjuk a tresholdot az alapján hogy mi a beállítás */
 
                 HSL hsl = rgb2hsl(image[line][elem]); /* megnézzük az aktuális pixel HSL értékeit */
                 if (hsl.l*100 >= treshold_bottom && hsl.l*100 <= treshold_top) { /* ha tresholdon belül van */
 
-                    checkinterval(&interval, options, elem); /* beállítjuk azt a környezetet amin belül rendezni kell */
+                    checkinterval(&interval, options, elem - row_first, &seed); /* beállítjuk azt a környezetet amin belül rendezni kell */
                     // rendezésre kijelölt elemek átmásolása egy új tömbbe
-                    int size = (elem < interval) ? elem : interval; /* ha az aktuális pixel közelebb van a kép széléhez mint a megválasztott környezet akkor ennek megfelelő méretet kell választani */
-                    int start = (int) max((double[]){elem-interval, 0}, 2); /* az előzőhöz hasonlóan */
+                    int size = (elem - row_first < interval) ? elem - row_first : interval; /* ha az aktuális pixel közelebb van a sor elejéhez mint a megválasztott környezet akkor ennek megfelelő méretet kell választani */
+                    int start = (int) max((double[]){elem-interval, row_first}, 2); /* az előzőhöz hasonlóan */
                     Sort partline[size];
-                    int i = 0; /* az új tömb számlálója */
-                    for (int interval_i = start; interval_i < elem; interval_i++) {
-                        partline[i].idx = interval_i;
-                        partline[i].value = rgb2hsl(image[line][interval_i]).l;
-                        i++;
-                    }
+                    isa_kernels()->lightness_keys(partline, image[line][0], start, elem);
                     sortcopy(partline, image, line, start, elem, 0); //(elem < size_x/2) ? 0 : 1);
 
                     elem += interval*options.merge;
 
-                    times++;
+                    job->times[line]++;
 
                 }
             }
             else if (options.pstype == rgb_sum) {
-                checktreshold_top (&treshold_top, options); /* beállítjuk a tresholdot az alapján hogy mi a beállítás */
-                checktreshold_bottom (&treshold_bottom, options); /* beállítjuk a tresholdot az alapján hogy mi a beállítás */
+                checktreshold_top (&treshold_top, options, &seed); /* beállítjuk a tresholdot az alapján hogy mi a beállítás */
+                checktreshold_bottom (&treshold_bottom, options, &seed); /* beállítjuk a tresholdot az alapján hogy mi a beállítás */
 
                 int rgbsum = image[line][elem][0] + image[line][elem][1] + image[line][elem][2];
                 if (rgbsum >= treshold_bottom && rgbsum <= treshold_top) {
-                    checkinterval(&interval, options, elem);
+                    checkinterval(&interval, options, elem - row_first, &seed);
                     // copying below treshold elements to a new array
                     int i = 0;
-                    int size = (elem < interval) ? elem : interval;
-                    int start = (int) max((double[]){elem-interval, 0}, 2);
+                    int size = (elem - row_first < interval) ? elem - row_first : interval;
+                    int start = (int) max((double[]){elem-interval, row_first}, 2);
                     Sort partline[size];
                     for (int interval_i = start; interval_i < elem; interval_i++) {
-                        partline[i].idx = i;
-                        partline[i].value = image[line][i][0] + image[line][i][1] + image[line][i][2];
+                        partline[i].idx = row_first + i;
+                        partline[i].value = image[line][row_first + i][0] + image[line][row_first + i][1] + image[line][row_first + i][2];
                         i++;
                     }
                     sortcopy(partline, image, line, start, elem, 0);
                     // merge size smaller the value more sorts
                     elem += interval*options.merge;
 
-                    times++;
+                    job->times[line]++;
                 }
 
             }
         }
     }
-    printf("Pixelsort végrehajtva %d alkalommal\n", times);
+    trace_end_range("pixelsort_rows", began, first, last);
+}
+
+/**
+ * @brief A pixelsort a kép soraiban
+ * @param[in] ***image a módosítandó kép
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] extent[] soronként a rendezendő [első, utolsó utáni) oszlop (2 * size_y elem), vagy NULL ha minden sor teljes
+ * @param[in] options a pixelsort tulajdonságai a PsOptions struktúraként
+ * @param[in] *sorted ide kerül a végrehajtott rendezések száma
+ * @see PsOptions
+ * @see sortcopy
+ *
+ * Az algoritmus lényege, hogy a megadott típus alapján (HSL lightness, RGB intesity) minden sorban keres egy olyan pixelt ami belefér a megadott treshold-ba (bottom, top). Az edges típusnál a kép objektumainak függőleges széleit keresi meg és ezek a határok között rendez.
+ * A megtalált pixelnek egy valamilyen a PsOptions-ban meghatározott környezetét vesszük és ezen a környezeten sorba rendezzük a pixeleket a megadott típus alapján, a szintén megadott irányba.
+ * A sorok egymástól függetlenek, ezért párhuzamosan dolgozzuk fel őket. Az edges típusnál a sávokat a szakaszok hossza alapján osztjuk ki, mert az élek egyenetlenül oszlanak el a sorok között. A véletlenszerű típusoknál a rand()-ot csak egyszer hívjuk, ebből kap minden sor saját kezdőértéket.
+ * @see parallel_rows
+ * @see detect_edge_spans
+ * @param[out] success false ha nem sikerült lefoglalni a munkaterületet, ekkor a kép nem változik
+*/
+static bool pixelsort_lines(unsigned char ***image, int size_x, int size_y, const int *extent, PsOptions options, int *sorted) {
+    PixelsortJob job = {image, NULL, size_x, extent, options, 0, (int *) mem_calloc(size_y, sizeof(int))};
+    if (job.times == NULL)
+        return false;
+
+    /* edges típusú pixelsort. Ez adja a legjobb eredményt.*/
+    if (options.pstype == edges) {
+        job.spans = detect_edge_spans (image, size_x, size_y, 3);
+        long long *cost = (job.spans != NULL) ? edge_spans_cost (job.spans) : NULL;
+        if (cost == NULL) {
+            freeedgespans(job.spans);
+            mem_free(job.times);
+            return false;
+        }
+        parallel_rows_weighted(size_y, cost, pixelsort_edges_rows, &job);
+        mem_free(cost);
+        freeedgespans(job.spans);
+    }
+    else {
+        job.seed = (unsigned int) rand();
+        parallel_rows(size_y, pixelsort_rows, &job);
+    }
+
+    *sorted = 0;
+    for (int line = 0; line < size_y; line++)
+        *sorted += job.times[line];
+    mem_free(job.times);
+    return true;
+}
+
+/** @brief a pixelsort a szög szerinti átalakításokkal, a paraméterei és az eredménye ugyanaz */
+static bool pixelsort_angle(unsigned char ***image, int size_x, int size_y, PsOptions options, int *sorted) {
+    double angle = fmod(options.angle, 180.0);
+    angle = (angle < 0) ? angle + 180 : angle;
+    if (angle == 0)
+        return pixelsort_lines(image, size_x, size_y, NULL, options, sorted);
+
+    /* a transzponált képen a sorok az eredeti oszlopai */
+    bool transposed = (angle >= 45 && angle <= 135);
+    unsigned char ***lines = image;
+    int lines_x = size_x;
+    int lines_y = size_y;
+    if (transposed) {
+        angle = 90 - angle;
+        lines_x = size_y;
+        lines_y = size_x;
+        lines = allocateimage_channels(lines_x, lines_y, 3);
+        if (lines == NULL)
+            return false;
+        transpose_copy(image, size_x, size_y, lines, 3);
+    }
+    else if (angle > 135) {
+        angle -= 180;
+    }
+
+    int *shift = (int *) mem_alloc(lines_x * sizeof(int));
+    if (shift == NULL) {
+        if (transposed)
+            freeimage(lines, lines_x, lines_y);
+        return false;
+    }
+    double slope = tan(angle * M_PI / 180);
+    for (int x = 0; x < lines_x; x++)
+        shift[x] = (int) floor(x * slope + 0.5);
+    int top = (shift[0] > shift[lines_x - 1]) ? shift[0] : shift[lines_x - 1];
+    int bottom = (shift[0] < shift[lines_x - 1]) ? shift[0] : shift[lines_x - 1];
+    bool success;
+
+    if (top == bottom) {
+        success = pixelsort_lines(lines, lines_x, lines_y, NULL, options, sorted);
+    }
+    else {
+        /* a nyírt kép i. sora az eredeti (i + shift[x]). sorának x. pixele, a shift legnagyobb értéke 0 */
+        for (int x = 0; x < lines_x; x++)
+            shift[x] -= top;
+        int sheared_y = lines_y + top - bottom;
+        unsigned char ***sheared = allocateimage_channels(lines_x, sheared_y, 3);
+        int *extent = (int *) mem_alloc(2 * sheared_y * sizeof(int));
+        success = (sheared != NULL && extent != NULL);
+        if (success) {
+            shear_columns(lines, lines_y, sheared, sheared_y, lines_x, 3, shift);
+            for (int i = 0; i < sheared_y; i++) {
+                int first = 0;
+                while (first < lines_x && (i + shift[first] < 0 || i + shift[first] >= lines_y))
+                    first++;
+                int last = first;
+                while (last < lines_x && i + shift[last] >= 0 && i + shift[last] < lines_y)
+                    last++;
+                extent[2*i] = first;
+                extent[2*i + 1] = last;
+            }
+            success = pixelsort_lines(sheared, lines_x, sheared_y, extent, options, sorted);
+            for (int x = 0; x < lines_x; x++)
+                shift[x] = -shift[x];
+            if (success)
+                shear_columns(sheared, sheared_y, lines, lines_y, lines_x, 3, shift);
+        }
+        freeimage(sheared, lines_x, sheared_y);
+        mem_free(extent);
+    }
+    mem_free(shift);
+
+    if (transposed) {
+        if (success)
+            transpose_copy(lines, lines_x, lines_y, image, 3);
+        freeimage(lines, lines_x, lines_y);
+    }
+    return success;
+}
+
+/**
+ * @brief Végrehajtja a pixelsort-ot.
+ * @param[in] ***image a módosítandó kép
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] options a pixelsort tulajdonságai a PsOptions struktúraként
+ * @param[in] *sorted ide kerül a végrehajtott rendezések száma, NULL ha nem kell
+ * @see PsOptions
+ * @see pixelsort_lines
+ *
+ * A rendezés a options.angle irányú egyenesek mentén történik. A soronkénti rendező (pixelsort_lines) csak a sorokon tud dolgozni, ezért a képet úgy alakítjuk át, hogy az egyenesek sorok legyenek:
+ * - 45 és 135 fok között transzponáljuk a képet (csempénként, hogy az oszlopok bejárása ne legyen lassú), így a maradék szög -45 és 45 fok közé esik, a függőleges rendezés pedig egy transzponálás és a visszaalakítása;
+ * - ha a maradék szög nem 0, függőlegesen nyírjuk a képet: az x. oszlopot round(x * tan(szög)) sorral toljuk el, így az egyenesek vízszintesek lesznek. A nyírt kép sorai nem teljesek, a soronkénti terjedelmet a rendező megkapja, és csak azon belül rendez.
+ * A rendezés után ugyanezeket a lépéseket visszafelé hajtjuk végre. A szög 180 fokonként ismétlődik, a rendezés iránya az egyenes mentén balról jobbra (függőlegesnél fentről lefelé) halad.
+ * @see transpose_copy
+ * @see shear_columns
+ * @param[out] success false ha nem sikerült lefoglalni a munkaterületet, ekkor a kép nem változik
+*/
+bool pixelsort(unsigned char ***image, int size_x, int size_y, PsOptions options, int *sorted) {
+    int times = 0;
+    long long began = trace_begin();
+    bool success = pixelsort_angle(image, size_x, size_y, options, &times);
+    if (sorted != NULL)
+        *sorted = times;
+    trace_end("pixelsort", began);
+    return success;
+}
+
+/**
+ * @brief a pixelsort munkaterületének becslése
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] edges true ha az edges típusú rendezés, ami előbb éleket keres
+ * @param[in] angle a rendezés iránya fokban, mint a PsOptions-ben
+ * @param[in] banded true esetén az élkeresés konvolúcióinak sávonkénti változatával
+ * @param[out] bytes a pixelsort által a kép mellett egyszerre lefoglalt legtöbb bájt (felülről becsülve)
+ *
+ * Ugyanúgy alakítja át a szöget, mint a pixelsort, így a transzponált és a nyírt kép méretét is pontosan tudjuk.
+ * @see pixelsort
+ */
+long long pixelsort_bytes(int size_x, int size_y, bool edges, double angle, bool banded) {
+    long long bytes = 0;
+    angle = fmod(angle, 180.0);
+    angle = (angle < 0) ? angle + 180 : angle;
+    if (angle != 0) {
+        if (angle >= 45 && angle <= 135) {
+            angle = 90 - angle;
+            int temp = size_x;
+            size_x = size_y;
+            size_y = temp;
+            bytes += image_bytes(size_x, size_y, 3);
+        }
+        else if (angle > 135) {
+            angle -= 180;
+        }
+        bytes += (long long) size_x * sizeof(int);
+        int last = (int) floor((size_x - 1) * tan(angle * M_PI / 180) + 0.5);
+        if (last != 0) {
+            size_y += abs(last);
+            bytes += image_bytes(size_x, size_y, 3) + 2LL * size_y * sizeof(int);
+        }
+    }
+
+    bytes += (long long) size_y * sizeof(int);
+    if (edges) {
+        /* az élkeresés szűrt képe, a konvolúció vagy a szakaszok, és a sorok becsült költsége */
+        long long spans = (size_y + 1LL) * sizeof(long long) + ((long long) size_x * size_y + 1) * sizeof(int);
+        long long conv = convolve_bytes(size_x, size_y, 1, 3, banded);
+        bytes += image_bytes(size_x, size_y, 3) + ((conv > spans) ? conv : spans) + (size_y + 1LL) * sizeof(long long);
+    }
+    return bytes;
 }
 
 /**
@@ -676,60 +1552,94 @@ void sinecolor_shift(unsigned char pixel[], double amplifier, double freq,  doub
  * @param[in] **line a forgatandó sor
  * @param[in] size a sor mérete
  * @param[in] color melyik színt kell áthelyezni
- * @param[in] rot mennyivel kell forgatni
+ * @param[in] rot mennyivel kell forgatni, pozitív értéknél jobbra, negatívnál balra
+ *
+ * A színt egy ideiglenes tömbbe másoljuk, majd eltolva írjuk vissza, így a forgatás mértékétől függetlenül a sor hosszával arányos ideig tart.
  */
 static void rotate(unsigned char **line, int size, int color, int rot) {
-    unsigned char temp, tempn;
-    int dir = (rot < 0) ? 1 : 0; // 1 balra, 0 jobbra
-    rot = (rot < 0) ? -rot : rot;
-    for (int i = 0; i < rot; i++) {
-        temp = line[0][color]; /**> az első lefutásnál a 2. helyre így az első kerül, majd így tovább*/
-        for (int j = 0; j < size; j++) {
-            int ind = (dir == 1) ? (size-(j+1)) : (j+1)%size; /**> ha balra forgatunk akkor a méretből kell elvenni hogy melyik kell, ha jobbra akkor csak eggyel növelünk*/
-            tempn = line[ind][color]; /**> azért kell mod size-ot venni, mert így a végén lévő utolsó elem a legelejére kerül*/
-            line[ind][color] = temp;
-            temp = tempn;
-        }
-    }
+    rot %= size;
+    if (rot < 0)
+        rot += size;
+    if (rot == 0)
+        return;
+    unsigned char temp[size];
+    for (int j = 0; j < size; j++)
+        temp[j] = line[j][color];
+    for (int j = 0; j < size - rot; j++)
+        line[j + rot][color] = temp[j];
+    for (int j = size - rot; j < size; j++)
+        line[j + rot - size][color] = temp[j];
 }
 
 /**
- * @brief Oszlopokat forgat meg.
- * @param[in] *image a teljes kép ahonnan ki lehet venni az oszlopokat
- * @param[in] col melyik oszlopot kell
- * @param[in] color melyik színt kell forgatni
- * @param[in] rot mennyivel kell forgatni
+ * @brief az RGB shift adatai a szálak számára
  */
-static void rotate_vertical(PPM_Image *image, int col, int color, int rot) {
-    // kigyűjtjük a forgatandó elemeket
-    unsigned char **temp = (unsigned char **) malloc(image->size_y * sizeof(unsigned char *));
-
-    for (int i = 0; i < image->size_y; i++)
-         temp[i] = (unsigned char *) malloc(3 * sizeof(unsigned char));
+typedef struct ShiftJob {
+    PPM_Image *image; /**< a módosítandó kép */
+    unsigned char ***copy; /**< a kép vízszintes eltolás utáni másolata, ebből olvassuk a függőlegesen eltolt sorokat */
+    int shift_x[3]; /**< színenként a vízszintes eltolás */
+    int shift_y[3]; /**< színenként a függőleges eltolás */
+} ShiftJob;
 
-    int tempi = 0;
-    for (int line = 0; line < image->size_y; line++) {
+/**
+ * @brief vízszintes eltolás a [first, last) sorokon
+ */
+static void shift_rows(int first, int last, void *data) {
+    long long began = trace_begin();
+    ShiftJob *job = (ShiftJob *) data;
+    for (int line = first; line < last; line++) {
         for (int color = 0; color < 3; color++)
-            temp[tempi][color] = image->image_data[line][col][color];
-        tempi++;
+            rotate(job->image->image_data[line], job->image->size_x, color, job->shift_x[color]);
     }
+    trace_end_range("shift_rows", began, first, last);
+}
 
-    // megforgatás
-    rotate(temp, image->size_y, color, rot);
-
-    // visszaírás
-    tempi = 0;
-    for (int line = 0; line < image->size_y; line++) {
-        for (int color = 0; color < 3; color++)
-            image->image_data[line][col][color] = temp[tempi][color];
-        tempi++;
+/**
+ * @brief függőleges eltolás a [first, last) sorokon
+ *
+ * Az oszlopok forgatása helyett minden sor színét a másolat megfelelő sorából vesszük, így a képet sorfolytonosan járjuk be.
+ */
+static void shift_columns(int first, int last, void *data) {
+    long long began = trace_begin();
+    ShiftJob *job = (ShiftJob *) data;
+    int size_x = job->image->size_x;
+    int size_y = job->image->size_y;
+    for (int line = first; line < last; line++) {
+        for (int color = 0; color < 3; color++) {
+            if (job->shift_y[color] % size_y == 0)
+                continue;
+            int from = (line - job->shift_y[color]) % size_y;
+            if (from < 0)
+                from += size_y;
+            unsigned char *dst = job->image->image_data[line][0];
+            unsigned char *src = job->copy[from][0];
+            for (int col = 0; col < size_x; col++)
+                dst[col*3 + color] = src[col*3 + color];
+        }
     }
+    trace_end_range("shift_columns", began, first, last);
+}
 
-    //felszabadítás
-    for (int i = 0; i < image->size_y; i++) {
-        free(temp[i]);
+/** @brief az rgb_shift eltolásai, a paraméterei és az eredménye ugyanaz */
+static bool shift_channels(PPM_Image *image, RGB_SHIFT options) {
+    if (options.red_x == 0 && options.red_y == 0 && options.green_x == 0 && options.green_y == 0 && options.blue_x == 0 && options.blue_y == 0)
+        return true;
+    expand_rgb(image);
+
+    ShiftJob job = {image, NULL, {options.red_x, options.green_x, options.blue_x}, {options.red_y, options.green_y, options.blue_y}};
+    if (options.red_x != 0 || options.green_x != 0 || options.blue_x != 0)
+        parallel_rows(image->size_y, shift_rows, &job);
+
+    if (options.red_y != 0 || options.green_y != 0 || options.blue_y != 0) {
+        job.copy = allocateimage(image->size_x, image->size_y);
+        if (job.copy == NULL)
+            return false;
+        for (int line = 0; line < image->size_y; line++)
+            memcpy(job.copy[line][0], image->image_data[line][0], image->size_x * 3);
+        parallel_rows(image->size_y, shift_columns, &job);
+        freeimage(job.copy, image->size_x, image->size_y);
     }
-    free(temp);
+    return true;
 }
 
 /**
@@ -738,47 +1648,19 @@ static void rotate_vertical(PPM_Image *image, int col, int color, int rot) {
  * @param[in] *image a kép amin alkalmazni kell
  * @param[in] options melyik színt milyen irányba, mennyivel (RGB_SHIFT)
  *
- * Először a soronként mozgat a rotate segítségével, majd oszloponként a rotate_vertical segítségével.
+ * Először a soronként mozgat a rotate segítségével, majd oszloponként, a kép egy másolatából. Mindkét lépés a kép méretével arányos ideig tart, és a sorokat párhuzamosan dolgozzuk fel. Szürkeárnyalatos képet előbb RGB-re alakít.
  *
  * @see RGB_SHIFT
  * @see rotate
- * @see rotate_vertical
+ * @see parallel_rows
+ * @param[out] success false ha nem sikerült lefoglalni a másolatot, ekkor csak a vízszintes eltolás történt meg
  */
 
-void rgb_shift(PPM_Image *image, RGB_SHIFT options) {
-    for (int line = 0; line < image->size_y; line++) {
-        for (int color = 0; color < 3; color++) {
-            switch (color) {
-                case 0: // red
-                    rotate(image->image_data[line], image->size_x, color, options.red_x);
-                    break;
-                case 1: // green
-                    rotate(image->image_data[line], image->size_x, color, options.green_x);
-                    break;
-                case 2: // blue
-                    rotate(image->image_data[line], image->size_x, color, options.blue_x);
-                    break;
-            }
-        }
-    }
-    for (int col = 0; col < image->size_x; col++) {
-        for (int color = 0; color < 3; color++) {
-            switch (color) {
-                case 0: // red
-                    if (options.red_y != 0)
-                        rotate_vertical (image, col, color, options.red_y);
-                    break;
-                case 1: // green
-                    if (options.green_y != 0)
-                        rotate_vertical (image, col, color, options.green_y);
-                    break;
-                case 2: // blue
-                    if (options.blue_y != 0)
-                        rotate_vertical (image, col, color, options.blue_y);
-                    break;
-            }
-        }
-    }
+bool rgb_shift(PPM_Image *image, RGB_SHIFT options) {
+    long long began = trace_begin();
+    bool success = shift_channels(image, options);
+    trace_end("rgb_shift", began);
+    return success;
 }
 
 /**
@@ -791,42 +1673,180 @@ void rgb_shift(PPM_Image *image, RGB_SHIFT options) {
  * @see rotate
  */
 void anaglyph3d(PPM_Image *image) {
+    expand_rgb(image);
     for (int line = 0; line < image->size_y; line++) {
         rotate(image->image_data[line], image->size_x, 0, -image->size_x*0.00925);
     }
 }
 
+/**
+ * @brief a corrupt színmódosításának adatai a szálak számára
+ */
+typedef struct CorruptJob {
+    unsigned char ***image; /**< a módosítandó kép */
+    int size_x; /**< a kép oszlopainak száma */
+    double light; /**< a HSL Lightness változása */
+    int hue; /**< a Hue eltolása (-100)-100 */
+    unsigned char contrast[256]; /**< a kontraszt táblázata, színértékenként */
+} CorruptJob;
+
+/**
+ * @brief a fényesség, a kontraszt és a Hue egyszerre történő módosítása a [first, last) sorokon
+ * @see IsaKernels
+ */
+static void corrupt_colors(int first, int last, void *data) {
+    CorruptJob *job = (CorruptJob *) data;
+    isa_kernels()->color_rows(job->image, first, last, job->size_x, job->light, job->hue, job->contrast);
+}
+
+/**
+ * @brief módosítja a kép fényességét, kontrasztját és Hue-ját, ebben a sorrendben
+ * @param[in] *image a módosítandó RGB kép
+ * @param[in] light a fényesség változása százalékban, mint a change_light-nál
+ * @param[in] cont a kontraszt változása, mint a contrast-nál
+ * @param[in] hue a Hue eltolása, mint a hue_shift-nél
+ *
+ * Bitre ugyanazt adja, mintha pixelenként a change_light, a contrast és a hue_shift függvényt hívnánk, de a kontrasztot táblázatból számoljuk, és a sorokat párhuzamosan dolgozzuk fel.
+ * @see corrupt_colors
+ */
+void light_contrast_hue(PPM_Image *image, int light, int cont, int hue) {
+    CorruptJob job = {image->image_data, image->size_x, light/100.0, hue, {0}};
+    for (int value = 0; value < 256; value++) {
+        unsigned char pixel[3] = {value, value, value};
+        contrast(pixel, cont);
+        job.contrast[value] = pixel[0];
+    }
+    parallel_rows(image->size_y, corrupt_colors, &job);
+}
+
 /**
  * @brief Véletlenszerűen tönkreteszi a képet.
  *
  * @param[in] ***image a módosítandó kép
  *
- * Először kiválasztunk 3 értéket amivel sorrendben a: fényességet (change_light), a kontrasztot (contrast) és a HSL Hue -t (hue_shift) módosítjuk.
+ * Először kiválasztunk 3 értéket amivel a: fényességet (change_light), a kontrasztot (contrast) és a HSL Hue -t (hue_shift) módosítjuk. Ezt egy menetben, párhuzamosan végezzük (light_contrast_hue).
  * Ezek után a kép bizonyos részeit tükrözzük, ha páratlan számú alkalommal, akkor a kép egy része fordítva lesz, ha páros számú alkalommal, akkor az eredeti irányban.
  * Ez után az RGB színeit kell shiftelni véletlenszerű irányba és értékkel.
  * Ezután a lehető legbővebb véletlenszerű beállítással végrehajtjuk a pixelsort -ot
+ * @param[in] *sorted ide kerül a pixelsort rendezéseinek száma, NULL ha nem kell
+ * @param[out] success false ha valamelyik lépésnek nem sikerült lefoglalni a munkaterületét
  */
-void corrupt(PPM_Image *image) {
+bool corrupt(PPM_Image *image, int *sorted) {
+    expand_rgb(image);
     int light = rand()%(30-(-25)) +(-25);
     int cont = rand()%51 +(-25);
     int hue = rand()%201 +(-100);
-    for (int i = 0; i < image->size_y; i++) {
-        for (int j = 0; j < image->size_x; j++) {
-            change_light(image->image_data[i][j], light);
-            contrast(image->image_data[i][j], cont);
-            hue_shift(image->image_data[i][j], hue);
-        }
-    }
+    light_contrast_hue(image, light, cont, hue);
 
     for (int i = 0; i < 3; i++) {
-        mirror_diagonal(image->image_data, (int) (image->size_x*((rand()%(30 - 10 + 1) + 10)/100.0)), (int) (image->size_y*((rand()%(30 - 10 + 1) + 10)/100.0)));
+        mirror_diagonal(image->image_data, (int) (image->size_x*((rand()%(30 - 10 + 1) + 10)/100.0)), (int) (image->size_y*((rand()%(30 - 10 + 1) + 10)/100.0)), 3);
     }
 
     RGB_SHIFT rgbshft = {rand()%(image->size_x/5),rand()%(image->size_y/3), rand()%(image->size_x/5),rand()%(image->size_y/3), rand()%(image->size_x/5),rand()%(image->size_y/3)};
-    rgb_shift (image, rgbshft);
+    if (!rgb_shift (image, rgbshft))
+        return false;
 
     int interval_min = image->size_x/((rand()%(20 - 5 + 1)+5));
     int interval_max = clamp(image->size_x/((rand()%(20 - 5 + 1)+5)), interval_min+1, image->size_x);
-    PsOptions rando = {hsl_l, ran, 1, 100, 1, 100, ran, interval_min, interval_max, (rand()%100)/100.0};
-    pixelsort(image->image_data, image->size_x, image->size_y, rando);
+    PsOptions rando = {hsl_l, ran, 1, 100, 1, 100, ran, interval_min, interval_max, (rand()%100)/100.0, 0};
+    return pixelsort(image->image_data, image->size_x, image->size_y, rando, sorted);
+}
+
+/**
+ * @brief a területet a kép határai közé szorítja
+ * @param[in] region a terület
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[out] region a képen belülre eső rész, ha üres akkor a mérete 0
+ */
+Region region_clip(Region region, int size_x, int size_y) {
+    int x1 = clamp(region.x + region.size_x, 0, size_x);
+    int y1 = clamp(region.y + region.size_y, 0, size_y);
+    region.x = clamp(region.x, 0, size_x);
+    region.y = clamp(region.y, 0, size_y);
+    region.size_x = (x1 > region.x) ? x1 - region.x : 0;
+    region.size_y = (y1 > region.y) ? y1 - region.y : 0;
+    return region;
+}
+
+/**
+ * @brief a maszk nem fekete pixeleit tartalmazó legkisebb terület
+ * @param[in] ***mask egycsatornás maszk
+ * @param[in] size_x a maszk oszlopainak száma
+ * @param[in] size_y a maszk sorainak száma
+ * @param[out] region a terület, a maszkkal együtt. Ha a maszk teljesen fekete, a mérete 0.
+ */
+Region region_from_mask(unsigned char ***mask, int size_x, int size_y) {
+    int x0 = size_x, y0 = size_y, x1 = 0, y1 = 0;
+    for (int i = 0; i < size_y; i++) {
+        for (int j = 0; j < size_x; j++) {
+            if (mask[i][j][0] != 0) {
+                if (j < x0) x0 = j;
+                if (j >= x1) x1 = j + 1;
+                if (i < y0) y0 = i;
+                if (i >= y1) y1 = i + 1;
+            }
+        }
+    }
+    Region region = {x0, y0, (x1 > x0) ? x1 - x0 : 0, (y1 > y0) ? y1 - y0 : 0, mask};
+    return region;
+}
+
+/**
+ * @brief kimásolja a kép egy területét egy új képbe, hogy azon lehessen végrehajtani egy műveletet
+ * @param[in] *image a teljes kép
+ * @param[in] region a terület (a képen belül)
+ * @param[in] halo ennyi pixellel bővebb környezetet is kimásolunk minden irányban, amennyire a kép engedi
+ * @param[out] part a kimásolt rész, amit a region_commit után fel kell szabadítani; az image_data NULL, ha nem sikerült lefoglalni
+ *
+ * A művelet így csak a terület méretével arányos munkát végez. A környezetre azoknál a műveleteknél van szükség, ahol egy pixel új értéke a szomszédaitól is függ: a convolve-nál iterációnként a filter sugarával kell bővíteni, így a terület pixelei pontosan ugyanazt az értéket kapják, mintha az egész képen futott volna a művelet.
+ * @see region_commit
+ */
+PPM_Image region_extract(PPM_Image *image, Region region, int halo) {
+    Region outer = {region.x - halo, region.y - halo, region.size_x + 2*halo, region.size_y + 2*halo, NULL};
+    outer = region_clip(outer, image->size_x, image->size_y);
+
+    PPM_Image part = *image;
+    part.size_x = outer.size_x;
+    part.size_y = outer.size_y;
+    part.image_data = allocateimage_channels(part.size_x, part.size_y, image->channels);
+    if (part.image_data == NULL)
+        return part;
+    for (int i = 0; i < part.size_y; i++) {
+        memcpy(part.image_data[i][0], image->image_data[outer.y + i][outer.x], part.size_x * image->channels);
+    }
+    return part;
+}
+
+/**
+ * @brief visszaírja a kimásolt részen végzett művelet eredményét a képbe
+ * @param[in] *image a teljes kép
+ * @param[in] *part a region_extract-tal kimásolt és módosított rész
+ * @param[in] region a terület, ugyanaz mint a region_extract-nál
+ * @param[in] halo ugyanaz mint a region_extract-nál, a környezetet nem írjuk vissza
+ *
+ * Ha a területhez maszk tartozik, akkor a maszk értékével arányosan keverjük az új és a régi pixelt. Ha a rész szürkeárnyalatos lett, a képbe mindhárom színbe ugyanaz az érték kerül, ha a rész RGB maradt de a kép szürkeárnyalatos volt, akkor a képet előbb RGB-re alakítjuk.
+ * @see region_extract
+ */
+void region_commit(PPM_Image *image, PPM_Image *part, Region region, int halo) {
+    if (part->channels > image->channels)
+        expand_rgb(image);
+
+    int offset_x = region.x - clamp(region.x - halo, 0, image->size_x);
+    int offset_y = region.y - clamp(region.y - halo, 0, image->size_y);
+    int channel_step = (part->channels == 1) ? 0 : 1;
+
+    for (int i = 0; i < region.size_y; i++) {
+        for (int j = 0; j < region.size_x; j++) {
+            unsigned char *dst = image->image_data[region.y + i][region.x + j];
+            unsigned char *src = part->image_data[offset_y + i][offset_x + j];
+            int alpha = (region.mask == NULL) ? 255 : region.mask[region.y + i][region.x + j][0];
+            if (alpha == 0)
+                continue;
+            for (int color = 0; color < image->channels; color++) {
+                int value = src[color * channel_step];
+                dst[color] = (alpha == 255) ? value : (value * alpha + dst[color] * (255 - alpha) + 127) / 255;
+            }
+        }
+    }
 }
@@ -3,6 +3,9 @@
 
 #include "addmath.h"
 #include "ppm.h"
+
+#define MEDIAN_MAX_RADIUS 127 /**< a median_filter legnagyobb sugara, így a (2r+1)^2 méretű ablak hisztogramja elfér 16 biten */
+
 /**
  * @brief HSL színskála struktúrája
  */
@@ -43,6 +46,29 @@ typedef struct RGB_SHIFT {
   int blue_y; /**< Kék szín eltolásásnak y értéke */
 } RGB_SHIFT;
 
+/**
+ * @brief A kép egy része, amire egy műveletet korlátozni kell
+ * @see region_extract
+ * @see region_commit
+ */
+typedef struct Region {
+    int x; /**< a terület bal felső sarkának oszlopa */
+    int y; /**< a terület bal felső sarkának sora */
+    int size_x; /**< a terület oszlopainak száma */
+    int size_y; /**< a terület sorainak száma */
+    unsigned char ***mask; /**< egycsatornás maszk a teljes kép méretében, vagy NULL. A 255 értékű pixeleken teljesen, a 0 értékűeken egyáltalán nem, a köztes értékeken arányosan érvényesül a művelet. */
+} Region;
+
+/**
+ * @brief A kép éleinek oszlopai soronként, tömör (CSR) formában
+ * @see detect_edge_spans
+ */
+typedef struct EdgeSpans {
+    int size_y; /**< a sorok száma */
+    long long *offsets; /**< size_y + 1 elemű tömb, az i. sor élei a columns[offsets[i]] ... columns[offsets[i+1] - 1] elemek */
+    int *columns; /**< az élek oszlopai soronként növekvő sorrendben */
+} EdgeSpans;
+
 /**
  * @brief Pixelsort preset típusa
  */
@@ -100,6 +126,7 @@ typedef struct PsOptions {
     int interval_min; /**< a rendezési környezet alsó határa. Az értékét úgy érdemes megválasztani, hogy igazodjon a képen található objektumok méretéhez. Egy tájképnél például lehet nagy értéket választani, mivel ott nem fontosak a részletek, míg egy részletes képnél minnél kisebbre kell választani, hogy minden felismerhető legyen.*/
     int interval_max; /**< a rendezési környezet felső határa */
     double merge; /**< minél kisebb a merge mérete annál kisebbet ugrik a ciklus, ennek megfelelően annál nagyobb lesz az átfedés a környezetek között. Ha ez 0, az azt jelenti hogy minden pixelt megvizsgál, így kellően nagy treshold tartományban majdnem minden pixel bekerül és a kép el fog csúszni a rendezés irányának megfelelően, mivel a legvilágosabb pixelek a kép szélére sodródnak. Ez azt is jelenti, hogy sokkal lassabb lesz a program (1080x1080-as képen akár 500 ezer - 1 millió rendezést is el kell végezni.). */
+    double angle; /**< a rendezés iránya fokban: 0 vízszintes (soronként), 90 függőleges (oszloponként), a köztes értékek ferde egyenesek mentén rendeznek */
 } PsOptions;
 
 void setfilter(Filter *filter, int *filt, double mult, int size_x, int size_y);
@@ -120,27 +147,42 @@ void grayscale(unsigned char pixel[]);
 void sharp_grayscale(unsigned char pixel[]);
 void set_black(unsigned char pixel[], int treshold);
 
-unsigned char ***detect_edges(unsigned char ***image, int size_x, int size_y);
+unsigned char ***detect_edges(unsigned char ***image, int size_x, int size_y, int channels);
+long long detect_edges_bytes(int size_x, int size_y, int channels, bool banded);
+EdgeSpans *detect_edge_spans(unsigned char ***image, int size_x, int size_y, int channels);
+void freeedgespans(EdgeSpans *spans);
+void grayscale_image(PPM_Image *image);
+void expand_rgb(PPM_Image *image);
 
 void change_light(unsigned char pixel[], int percent);
 
-void mirror_diagonal(unsigned char ***matrix, int size_x, int size_y);
-void mirror_vertical(unsigned char ***matrix, int size_x, int size_y);
-void mirror_horizontal(unsigned char ***matrix, int size_x, int size_y);
+void mirror_diagonal(unsigned char ***matrix, int size_x, int size_y, int channels);
+void mirror_vertical(unsigned char ***matrix, int size_x, int size_y, int channels);
+void mirror_horizontal(unsigned char ***matrix, int size_x, int size_y, int channels);
 
-void convolve(unsigned char ***original, int size_x, int size_y, Filter filter, int times);
+bool convolve(unsigned char ***original, int size_x, int size_y, Filter filter, int times, int channels);
+long long convolve_bytes(int size_x, int size_y, int times, int channels, bool banded);
+bool median_filter(unsigned char ***image, int size_x, int size_y, int channels, int radius);
+long long median_bytes(int size_x, int size_y, int channels, int radius);
 
 void sortcopy(Sort partline[], unsigned char ***image, int line, int start, int elem, int dir);
 
-void pixelsort(unsigned char ***image, int size_x, int size_y, PsOptions options);
+bool pixelsort(unsigned char ***image, int size_x, int size_y, PsOptions options, int *sorted);
+long long pixelsort_bytes(int size_x, int size_y, bool edges, double angle, bool banded);
 
 void hue_shift(unsigned char pixel[], double value);
 void sinecolor_shift(unsigned char pixel[], double amplifier, double freq, double phase, double bias);
 
-void rgb_shift(PPM_Image *image, RGB_SHIFT options);
+bool rgb_shift(PPM_Image *image, RGB_SHIFT options);
 
 void anaglyph3d(PPM_Image *image);
 
-void corrupt(PPM_Image *image);
+void light_contrast_hue(PPM_Image *image, int light, int cont, int hue);
+bool corrupt(PPM_Image *image, int *sorted);
+
+Region region_clip(Region region, int size_x, int size_y);
+Region region_from_mask(unsigned char ***mask, int size_x, int size_y);
+PPM_Image region_extract(PPM_Image *image, Region region, int halo);
+void region_commit(PPM_Image *image, PPM_Image *part, Region region, int halo);
 
 #endif
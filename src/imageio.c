@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+
+#include "ppm.h"
+#include "qoi.h"
+#include "imageio.h"
+#include "trace.h"
+
+/**
+ * @file
+ * @brief A támogatott képformátumok (PPM, PGM, PBM, QOI) közötti választás
+ *
+ * Beolvasáskor a formátumot a fájl tartalmából ismerjük fel, kiíráskor a felhasználó választja ki, vagy a fájl kiterjesztéséből következik.
+ */
+
+/**
+ * @brief a formátum neve alapján kiválasztja a formátumot
+ * @param[in] *name a formátum neve: "ppm", "pgm", "pbm" vagy "qoi"
+ * @param[in] *format ide kerül a formátum
+ * @param[out] success false ha nincs ilyen nevű formátum
+ */
+bool format_parse(const char *name, image_format *format) {
+    if (strcmp(name, "ppm") == 0)
+        *format = format_ppm;
+    else if (strcmp(name, "pgm") == 0)
+        *format = format_pgm;
+    else if (strcmp(name, "pbm") == 0)
+        *format = format_pbm;
+    else if (strcmp(name, "qoi") == 0)
+        *format = format_qoi;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * @brief a fájl kiterjesztéséből következő formátum
+ * @param[in] *filename a fájl neve
+ * @param[out] format a .qoi végű fájloké format_qoi, a .pgm végűeké format_pgm, a .pbm végűeké format_pbm, a .ppm végűeké format_ppm, a többié (pl. .pnm) format_auto
+ */
+image_format format_from_filename(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    if (dot == NULL)
+        return format_auto;
+    if (strcasecmp(dot, ".qoi") == 0)
+        return format_qoi;
+    if (strcasecmp(dot, ".pgm") == 0)
+        return format_pgm;
+    if (strcasecmp(dot, ".pbm") == 0)
+        return format_pbm;
+    if (strcasecmp(dot, ".ppm") == 0)
+        return format_ppm;
+    return format_auto;
+}
+
+/**
+ * @brief beolvassa a következő képet egy már megnyitott fájlból, a formátumát az első bájtjából felismerve
+ * @param[in] *fp a megnyitott fájl
+ * @param[in] *image ebbe a PPM_Image-be kerül a kép
+ * @param[in] shrink a kicsinyítés mértéke, 1 esetén az eredeti méretben olvassuk be
+ * @param[out] success false ha nincs több kép a fájlban
+ *
+ * A QOI fájlok "qoif"-fel kezdődnek, minden mást PPM-ként (P1-P6) olvasunk be. Egy fájlban a képkockák formátuma akár váltakozhat is.
+ * @see PPM_ReadFrameScaled
+ * @see QOI_ReadFrameScaled
+ */
+bool Image_ReadFrameScaled(FILE *fp, PPM_Image *image, int shrink) {
+    return Image_ReadFrameProgress(fp, image, shrink, NULL);
+}
+
+/**
+ * @brief mint az Image_ReadFrameScaled, de a beolvasás közben értesít az elkészült sorokról
+ * @param[in] *fp a megnyitott fájl
+ * @param[in] *image ebbe a PPM_Image-be kerül a kép
+ * @param[in] shrink a kicsinyítés mértéke, 1 esetén az eredeti méretben olvassuk be
+ * @param[in] *progress az értesítés, NULL ha nem kell
+ * @param[out] success false ha nincs több kép a fájlban
+ * @see RowProgress
+ */
+bool Image_ReadFrameProgress(FILE *fp, PPM_Image *image, int shrink, RowProgress *progress) {
+    int first = getc(fp);
+    if (first == EOF)
+        return false;
+    ungetc(first, fp);
+
+    long long began = trace_begin();
+    bool success = (first == 'q') ? QOI_ReadFrameProgress(fp, image, shrink, progress) : PPM_ReadFrameProgress(fp, image, shrink, progress);
+    trace_end("Image_ReadFrame", began);
+    return success;
+}
+
+/**
+ * @brief a kimeneti kép magic-je
+ * @param[in] *magic a kép eredeti magic-je
+ * @param[in] format a kimenet formátuma
+ * @param[out] magic format_auto esetén az eredeti, különben a formátum szöveges vagy bináris változata
+ *
+ * A PPM kimenet megtartja a bemenet szöveges vagy bináris voltát. A PGM és PBM kimenet bináris, hacsak a bemenet nem volt már eleve szöveges PGM vagy PBM, mert ezeket a formátumokat a kis méretük miatt választjuk.
+ */
+static const char *output_magic(const char *magic, image_format format) {
+    bool text = magic[1] >= '1' && magic[1] <= '3';
+    bool text_gray = magic[1] == '1' || magic[1] == '2';
+    switch (format) {
+        case format_ppm:
+            return text ? "P3" : "P6";
+        case format_pgm:
+            return text_gray ? "P2" : "P5";
+        case format_pbm:
+            return text_gray ? "P1" : "P4";
+        default:
+            return magic;
+    }
+}
+
+/**
+ * @brief egy már megnyitott fájlba írja a képet a megadott formátumban
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép
+ * @param[in] format a kimenet formátuma, format_auto esetén a kép magic-je szerinti PPM, PGM vagy PBM
+ * @see output_magic
+ */
+void Image_WriteFrame(FILE *fp, PPM_Image *image, image_format format) {
+    ImageWriter writer;
+    Image_WriteBegin(&writer, fp, image, format);
+    Image_WriteRows(&writer, image, 0, image->size_y);
+    Image_WriteEnd(&writer);
+}
+
+/**
+ * @brief elkezdi a kép soronkénti kiírását: kiírja a fejlécet
+ * @param[in] *writer ide kerül a kiírás állapota
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép, a sorai még nem kellenek
+ * @param[in] format a kimenet formátuma, mint az Image_WriteFrame-nél
+ *
+ * A sorokat az Image_WriteRows-szal, sorrendben kell kiírni, a végén az Image_WriteEnd zárja le a képet.
+ * @see Image_WriteFrame
+ */
+void Image_WriteBegin(ImageWriter *writer, FILE *fp, PPM_Image *image, image_format format) {
+    writer->fp = fp;
+    writer->format = format;
+    writer->qoi = NULL;
+    if (format == format_qoi) {
+        writer->qoi = QOI_WriteBegin(fp, image);
+        return;
+    }
+    PPM_Image output = *image;
+    strcpy(output.magic, output_magic(image->magic, format));
+    strcpy(writer->magic, output.magic);
+    PPM_WriteHeader(fp, &output);
+}
+
+/**
+ * @brief kiírja a kép [first, last) sorait az eddig kiírt sorok után
+ * @param[in] *writer a kiírás állapota
+ * @param[in] *image a kiírandó kép
+ * @param[in] first az első kiírandó sor
+ * @param[in] last az utolsó utáni kiírandó sor
+ */
+void Image_WriteRows(ImageWriter *writer, PPM_Image *image, int first, int last) {
+    long long began = trace_begin();
+    if (writer->qoi != NULL) {
+        QOI_WriteRows(writer->qoi, image, first, last);
+    }
+    else {
+        PPM_Image output = *image;
+        strcpy(output.magic, writer->magic);
+        if (!PPM_WriteRows(writer->fp, &output, first, last)) {
+            perror("error allocating buffer");
+            abort();
+        }
+    }
+    trace_end_range("Image_WriteRows", began, first, last);
+}
+
+/**
+ * @brief lezárja a képet
+ * @param[in] *writer a kiírás állapota
+ */
+void Image_WriteEnd(ImageWriter *writer) {
+    if (writer->qoi != NULL)
+        QOI_WriteEnd(writer->qoi);
+    writer->qoi = NULL;
+}
+
+/**
+ * @brief beolvas egy PPM, PGM, PBM vagy QOI képet, a megadott mértékben kicsinyítve
+ * @param[in] filename[] ezt a fájlt fogja megnyitni
+ * @param[in] shrink a kicsinyítés mértéke, 1 esetén az eredeti méretben olvassuk be
+ * @see Image_ReadFrameScaled
+ * @see PPM_ParserScaled
+ */
+PPM_Image Image_ParserScaled(char filename[], int shrink) {
+    FILE *fp;
+    fp = fopen(filename, "rb");
+
+    PPM_Image image;
+
+    if (fp == NULL) {
+        perror("error reading file");
+        abort();
+        return image;
+    }
+
+    if (!Image_ReadFrameScaled(fp, &image, shrink)) {
+        fprintf(stderr, "üres fájl: %s\n", filename);
+        abort();
+    }
+
+    printf("Szélesség: %d\n", image.size_x);
+    printf("Magasság: %d\n", image.size_y);
+
+    fclose(fp);
+    return image;
+}
+
+/**
+ * @brief beolvassa a kép méretét a fejlécből, a pixelek nélkül
+ * @param[in] filename[] ezt a fájlt fogja megnyitni
+ * @param[in] shrink a kicsinyítés mértéke, 1 esetén az eredeti méret
+ * @param[in] *image ide kerül a (kicsinyített) méret, a csatornák száma és a magic, az image_data NULL lesz
+ * @param[out] success false ha a fájlt nem lehet megnyitni, üres, vagy a fejléce hibás
+ *
+ * A memória becsléséhez kell, még a kép lefoglalása előtt.
+ * @see Image_ParserScaled
+ */
+bool Image_ReadInfo(char filename[], int shrink, PPM_Image *image) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL)
+        return false;
+
+    int first = getc(fp);
+    ungetc(first, fp);
+    ppm_status status = (first == 'q') ? QOI_ReadHeader(fp, image) : PPM_ReadHeader(fp, image);
+    fclose(fp);
+    if (status != ppm_ok)
+        return false;
+
+    image->size_x = (image->size_x + shrink - 1) / shrink;
+    image->size_y = (image->size_y + shrink - 1) / shrink;
+    return true;
+}
+
+/**
+ * @brief fájlba írja a képet
+ * @param[in] filename[] a kimeneti fájl neve
+ * @param[in] *image a kiírandó kép
+ * @param[in] format a kimenet formátuma, format_auto esetén a fájl kiterjesztése dönt, ennek hiányában a kép magic-je
+ * @see Image_WriteFrame
+ */
+void Image_Writer(char filename[], PPM_Image *image, image_format format) {
+    if (format == format_auto)
+        format = format_from_filename(filename);
+
+    FILE *fp;
+    fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        perror("error writing file");
+        abort();
+    }
+
+    Image_WriteFrame(fp, image, format);
+    fclose(fp);
+}
@@ -0,0 +1,45 @@
+#ifndef IMAGEIO
+#define IMAGEIO
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ppm.h"
+#include "qoi.h"
+
+/**
+ * @brief a képfájl formátuma
+ */
+typedef enum image_format {
+  format_auto, /**< beolvasáskor a fájl tartalmából, kiíráskor a fájl nevéből döntjük el */
+  format_ppm,  /**< PPM (P3 vagy P6, a kép magic-je szerint) */
+  format_pgm,  /**< szürkeárnyalatos PGM (P5, vagy P2 ha a bemenet is szöveges PGM vagy PBM volt) */
+  format_pbm,  /**< fekete-fehér PBM bitkép (P4, vagy P1 ha a bemenet is szöveges PGM vagy PBM volt) */
+  format_qoi   /**< QOI */
+} image_format;
+
+/**
+ * @brief a soronkénti kiírás állapota
+ * @see Image_WriteBegin
+ */
+typedef struct ImageWriter {
+    FILE *fp; /**< a kimeneti fájl */
+    image_format format; /**< a kimenet formátuma */
+    char magic[2+1]; /**< PPM, PGM és PBM kimenetnél a kiírt magic */
+    QoiEncoder *qoi; /**< QOI kimenetnél a kódolás állapota, különben NULL */
+} ImageWriter;
+
+bool format_parse(const char *name, image_format *format);
+image_format format_from_filename(const char *filename);
+
+bool Image_ReadFrameScaled(FILE *fp, PPM_Image *image, int shrink);
+bool Image_ReadFrameProgress(FILE *fp, PPM_Image *image, int shrink, RowProgress *progress);
+void Image_WriteFrame(FILE *fp, PPM_Image *image, image_format format);
+void Image_WriteBegin(ImageWriter *writer, FILE *fp, PPM_Image *image, image_format format);
+void Image_WriteRows(ImageWriter *writer, PPM_Image *image, int first, int last);
+void Image_WriteEnd(ImageWriter *writer);
+PPM_Image Image_ParserScaled(char filename[], int shrink);
+bool Image_ReadInfo(char filename[], int shrink, PPM_Image *image);
+void Image_Writer(char filename[], PPM_Image *image, image_format format);
+
+#endif
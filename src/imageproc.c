@@ -0,0 +1,607 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ppm.h"
+#include "imagefunc.h"
+#include "resample.h"
+#include "transform.h"
+#include "parallel.h"
+#include "imageproc.h"
+#include "memusage.h"
+
+/**
+ * @file
+ * @brief A libimageproc könyvtár: a képfeldolgozó függvények a hívó pufferén, hibakódokkal
+ *
+ * A belső függvények a PPM_Image 3 dimenziós tömbjén dolgoznak. Ehhez a hívó pufferéhez csak a sorok és a pixelek mutatóit foglaljuk le (wrapimage), a pixeleket nem másoljuk.
+ */
+
+/**
+ * @brief a hibakód szöveges leírása
+ * @param[in] status a hibakód
+ * @param[out] message a leírás
+ */
+const char *ip_strerror(ip_status status) {
+    switch (status) {
+        case ip_ok:
+            return "sikeres végrehajtás";
+        case ip_invalid_argument:
+            return "hibás paraméter";
+        case ip_out_of_memory:
+            return "nem sikerült lefoglalni a memóriát";
+        case ip_format_error:
+            return "hibás PPM kép";
+        case ip_truncated:
+            return "a kép közepén véget ért a bemenet";
+        case ip_no_space:
+            return "a kimeneti puffer túl kicsi";
+    }
+    return "ismeretlen hiba";
+}
+
+/**
+ * @brief beállítja, hogy a párhuzamos műveletek hány szálon fussanak
+ * @param[in] threads a szálak száma, 0 esetén a processzormagok száma
+ * @see parallel_set_threads
+ */
+void ip_set_threads(int threads) {
+    parallel_set_threads(threads);
+}
+
+/**
+ * @brief ellenőrzi a puffert, és elkészíti hozzá a belső függvények képét
+ * @param[in] *buffer a hívó puffere
+ * @param[in] channels a művelet által elvárt csatornaszám, 0 ha az 1 és a 3 is megfelelő
+ * @param[in] *image ide kerül a kép, a pixel mutatói a pufferbe mutatnak
+ * @param[out] status ip_ok ha sikerült, ekkor a képet a release_view-val kell felszabadítani
+ */
+static ip_status make_view(const ImageBuffer *buffer, int channels, PPM_Image *image) {
+    if (buffer == NULL || buffer->pixels == NULL || buffer->size_x <= 0 || buffer->size_y <= 0)
+        return ip_invalid_argument;
+    if ((buffer->channels != 1 && buffer->channels != 3) || (channels != 0 && buffer->channels != channels))
+        return ip_invalid_argument;
+    if (buffer->stride < (long long) buffer->size_x * buffer->channels)
+        return ip_invalid_argument;
+
+    image->image_data = wrapimage(buffer->pixels, buffer->size_x, buffer->size_y, buffer->stride, buffer->channels);
+    if (image->image_data == NULL)
+        return ip_out_of_memory;
+    image->size_x = buffer->size_x;
+    image->size_y = buffer->size_y;
+    image->channels = buffer->channels;
+    strcpy(image->magic, "P6");
+    image->maxval = 255;
+    return ip_ok;
+}
+
+/**
+ * @brief felszabadítja a make_view által lefoglalt mutatókat, a pixeleket nem
+ */
+static void release_view(PPM_Image *image) {
+    mem_free(image->image_data);
+    image->image_data = NULL;
+}
+
+/**
+ * @brief pixelenkénti műveletek: fényesség, kontraszt, hue, invertálás, szinusz színeltolás, ebben a sorrendben
+ * @param[in] *image a módosítandó RGB kép
+ * @param[in] lightness a fényesség változása (change_light), 0 ha nem változik
+ * @param[in] contrast_level a kontraszt változása (contrast), 0 ha nem változik
+ * @param[in] hue a Hue eltolása (hue_shift), 0 ha nem változik
+ * @param[in] negative true esetén negatívvá tesszük a képet (invert)
+ * @param[in] sinecolor a szinusz színeltolás frekvenciája (sinecolor_shift), 0 ha nincs
+ * @param[out] status a hibakód
+ */
+ip_status ip_point_ops(ImageBuffer *image, int lightness, int contrast_level, int hue, bool negative, double sinecolor) {
+    PPM_Image view;
+    ip_status status = make_view(image, 3, &view);
+    if (status != ip_ok)
+        return status;
+
+    for (int i = 0; i < view.size_y; i++) {
+        for (int j = 0; j < view.size_x; j++) {
+            unsigned char *pixel = view.image_data[i][j];
+            if (lightness != 0)
+                change_light(pixel, lightness);
+            if (contrast_level != 0)
+                contrast(pixel, contrast_level);
+            if (hue != 0)
+                hue_shift(pixel, hue);
+            if (negative)
+                invert(pixel);
+            if (sinecolor != 0)
+                /*amplitude, frequency, phase, bias*/
+                sinecolor_shift(pixel, 0.5, sinecolor, 90, 1);
+        }
+    }
+    release_view(&view);
+    return ip_ok;
+}
+
+/**
+ * @brief tükrözés
+ * @param[in] *image a módosítandó kép
+ * @param[in] type a tükrözés iránya
+ * @param[out] status a hibakód
+ */
+ip_status ip_mirror(ImageBuffer *image, mirror_type type) {
+    PPM_Image view;
+    ip_status status = make_view(image, 0, &view);
+    if (status != ip_ok)
+        return status;
+
+    switch (type) {
+        case diagonal:
+            mirror_diagonal(view.image_data, view.size_x, view.size_y, view.channels);
+            break;
+        case vertical:
+            mirror_vertical(view.image_data, view.size_x, view.size_y, view.channels);
+            break;
+        case horizontal:
+            mirror_horizontal(view.image_data, view.size_x, view.size_y, view.channels);
+            break;
+        case none:
+            break;
+    }
+    release_view(&view);
+    return ip_ok;
+}
+
+/**
+ * @brief RGB shift
+ * @param[in] *image a módosítandó RGB kép
+ * @param[in] shift melyik színt milyen irányba, mennyivel
+ * @param[out] status a hibakód
+ * @see rgb_shift
+ */
+ip_status ip_rgb_shift(ImageBuffer *image, RGB_SHIFT shift) {
+    PPM_Image view;
+    ip_status status = make_view(image, 3, &view);
+    if (status != ip_ok)
+        return status;
+
+    status = rgb_shift(&view, shift) ? ip_ok : ip_out_of_memory;
+    release_view(&view);
+    return status;
+}
+
+/**
+ * @brief pixelsort
+ * @param[in] *image a módosítandó RGB kép
+ * @param[in] options a pixelsort beállításai
+ * @param[in] *sorted ide kerül a végrehajtott rendezések száma, NULL ha nem kell
+ * @param[out] status a hibakód
+ * @see pixelsort
+ */
+ip_status ip_pixelsort(ImageBuffer *image, PsOptions options, int *sorted) {
+    PPM_Image view;
+    ip_status status = make_view(image, 3, &view);
+    if (status != ip_ok)
+        return status;
+
+    status = pixelsort(view.image_data, view.size_x, view.size_y, options, sorted) ? ip_ok : ip_out_of_memory;
+    release_view(&view);
+    return status;
+}
+
+/**
+ * @brief a kép konvolúciója egy 3x3-as filterrel
+ */
+static ip_status convolve_buffer(ImageBuffer *image, int *values, double mult, int times) {
+    if (times < 0)
+        return ip_invalid_argument;
+    PPM_Image view;
+    ip_status status = make_view(image, 0, &view);
+    if (status != ip_ok)
+        return status;
+
+    Filter filter;
+    setfilter(&filter, values, mult, 3, 3);
+    status = convolve(view.image_data, view.size_x, view.size_y, filter, times, view.channels) ? ip_ok : ip_out_of_memory;
+    freefilter(filter);
+    release_view(&view);
+    return status;
+}
+
+/**
+ * @brief elmosás
+ * @param[in] *image a módosítandó kép
+ * @param[in] times hányszor hajtjuk végre a 3x3-as Gauss elmosást
+ * @param[out] status a hibakód
+ */
+ip_status ip_blur(ImageBuffer *image, int times) {
+    return convolve_buffer(image, (int[]) {1, 2, 1, 2, 4, 2, 1, 2, 1}, 1/16.0, times);
+}
+
+/**
+ * @brief élesítés
+ * @param[in] *image a módosítandó kép
+ * @param[in] times hányszor hajtjuk végre a 3x3-as élesítést
+ * @param[out] status a hibakód
+ */
+ip_status ip_sharpen(ImageBuffer *image, int times) {
+    return convolve_buffer(image, (int[]) {0, -1, 0, -1, 5, -1, 0, -1, 0}, 1, times);
+}
+
+/**
+ * @brief medián szűrő, zajszűrés az élek megtartásával
+ * @param[in] *image a módosítandó kép
+ * @param[in] radius az ablak sugara, 0 és MEDIAN_MAX_RADIUS között, 0 esetén a kép nem változik
+ * @param[out] status a hibakód
+ * @see median_filter
+ */
+ip_status ip_median(ImageBuffer *image, int radius) {
+    if (radius < 0 || radius > MEDIAN_MAX_RADIUS)
+        return ip_invalid_argument;
+    PPM_Image view;
+    ip_status status = make_view(image, 0, &view);
+    if (status != ip_ok)
+        return status;
+    status = median_filter(view.image_data, view.size_x, view.size_y, view.channels, radius) ? ip_ok : ip_out_of_memory;
+    release_view(&view);
+    return status;
+}
+
+/**
+ * @brief véletlenszerű tönkretétel
+ * @param[in] *image a módosítandó RGB kép, legalább 5x3 pixeles
+ * @param[in] *sorted ide kerül a pixelsort rendezéseinek száma, NULL ha nem kell
+ * @param[out] status a hibakód
+ * @see corrupt
+ */
+ip_status ip_corrupt(ImageBuffer *image, int *sorted) {
+    /* a véletlenszerű eltolások a szélesség ötödével és a magasság harmadával osztanak maradékosan */
+    if (image != NULL && (image->size_x < 5 || image->size_y < 3))
+        return ip_invalid_argument;
+    PPM_Image view;
+    ip_status status = make_view(image, 3, &view);
+    if (status != ip_ok)
+        return status;
+
+    status = corrupt(&view, sorted) ? ip_ok : ip_out_of_memory;
+    release_view(&view);
+    return status;
+}
+
+/**
+ * @brief szürkeárnyalatossá alakítás a helyén: RGB képnél mindhárom szín a pixel szürke értéke lesz
+ * @param[in] *image a módosítandó kép, egycsatornás képen nem csinál semmit
+ * @param[out] status a hibakód
+ * @see grayscale
+ */
+ip_status ip_grayscale(ImageBuffer *image) {
+    PPM_Image view;
+    ip_status status = make_view(image, 0, &view);
+    if (status != ip_ok)
+        return status;
+
+    if (view.channels == 3) {
+        for (int i = 0; i < view.size_y; i++) {
+            for (int j = 0; j < view.size_x; j++)
+                grayscale(view.image_data[i][j]);
+        }
+    }
+    release_view(&view);
+    return ip_ok;
+}
+
+/**
+ * @brief vörös-cián 3D
+ * @param[in] *image a módosítandó RGB kép
+ * @param[out] status a hibakód
+ * @see anaglyph3d
+ */
+ip_status ip_anaglyph3d(ImageBuffer *image) {
+    PPM_Image view;
+    ip_status status = make_view(image, 3, &view);
+    if (status != ip_ok)
+        return status;
+
+    anaglyph3d(&view);
+    release_view(&view);
+    return ip_ok;
+}
+
+/**
+ * @brief élkeresés
+ * @param[in] *image a bemeneti kép, nem változik
+ * @param[in] *edges ide kerül az eredmény, egycsatornás és a bemenettel azonos méretű kép
+ * @param[out] status a hibakód
+ * @see detect_edges
+ */
+ip_status ip_detect_edges(const ImageBuffer *image, ImageBuffer *edges) {
+    if (edges == NULL || image == NULL || edges->size_x != image->size_x || edges->size_y != image->size_y)
+        return ip_invalid_argument;
+    PPM_Image view, result;
+    ip_status status = make_view(edges, 1, &result);
+    if (status != ip_ok)
+        return status;
+    status = make_view(image, 0, &view);
+    if (status != ip_ok) {
+        release_view(&result);
+        return status;
+    }
+
+    unsigned char ***edgeimage = detect_edges(view.image_data, view.size_x, view.size_y, view.channels);
+    if (edgeimage != NULL) {
+        for (int i = 0; i < view.size_y; i++)
+            memcpy(result.image_data[i][0], edgeimage[i][0], view.size_x);
+        freeimage(edgeimage, view.size_x, view.size_y);
+    }
+    else
+        status = ip_out_of_memory;
+    release_view(&view);
+    release_view(&result);
+    return status;
+}
+
+/**
+ * @brief átméretezés
+ * @param[in] *image a bemeneti kép, nem változik
+ * @param[in] *resized ide kerül az eredmény, a mérete adja meg az új méretet, a csatornák száma a bemenetével azonos
+ * @param[in] filter a szűrő
+ * @param[out] status a hibakód
+ * @see resample_image
+ */
+ip_status ip_resize(const ImageBuffer *image, ImageBuffer *resized, resample_filter filter) {
+    if (image == NULL || resized == NULL || resized->channels != image->channels)
+        return ip_invalid_argument;
+    if (filter != box_filter && filter != bilinear_filter && filter != lanczos_filter)
+        return ip_invalid_argument;
+    PPM_Image view, result;
+    ip_status status = make_view(resized, 0, &result);
+    if (status != ip_ok)
+        return status;
+    status = make_view(image, 0, &view);
+    if (status != ip_ok) {
+        release_view(&result);
+        return status;
+    }
+
+    if (!resample_image(view.image_data, view.size_x, view.size_y, result.image_data, result.size_x, result.size_y, view.channels, filter))
+        status = ip_out_of_memory;
+    release_view(&view);
+    release_view(&result);
+    return status;
+}
+
+/**
+ * @brief transzponálás
+ * @param[in] *image a bemeneti kép, nem változik
+ * @param[in] *transposed ide kerül az eredmény, size_x-e a bemenet size_y-ja, size_y-ja a bemenet size_x-e, a csatornák száma a bemenetével azonos
+ * @param[out] status a hibakód
+ * @see transpose_copy
+ */
+ip_status ip_transpose(const ImageBuffer *image, ImageBuffer *transposed) {
+    if (image == NULL || transposed == NULL || transposed->channels != image->channels)
+        return ip_invalid_argument;
+    if (transposed->size_x != image->size_y || transposed->size_y != image->size_x)
+        return ip_invalid_argument;
+    PPM_Image view, result;
+    ip_status status = make_view(transposed, 0, &result);
+    if (status != ip_ok)
+        return status;
+    status = make_view(image, 0, &view);
+    if (status != ip_ok) {
+        release_view(&result);
+        return status;
+    }
+
+    transpose_copy(view.image_data, view.size_x, view.size_y, result.image_data, view.channels);
+    release_view(&view);
+    release_view(&result);
+    return ip_ok;
+}
+
+/**
+ * @brief forgatás az óramutató járásával megegyező irányban
+ * @param[in] *image a bemeneti kép, nem változik
+ * @param[in] *rotated ide kerül az eredmény; 90 és 270 foknál felcserélt, 180 foknál a bemenettel azonos méretű, a csatornák száma a bemenetével azonos
+ * @param[in] degrees a forgatás szöge: 90, 180 vagy 270
+ * @param[out] status a hibakód
+ * @see rotate_copy
+ */
+ip_status ip_rotate(const ImageBuffer *image, ImageBuffer *rotated, int degrees) {
+    if (image == NULL || rotated == NULL || rotated->channels != image->channels)
+        return ip_invalid_argument;
+    if (degrees != 90 && degrees != 180 && degrees != 270)
+        return ip_invalid_argument;
+    bool swapped = (degrees != 180);
+    if (rotated->size_x != (swapped ? image->size_y : image->size_x) || rotated->size_y != (swapped ? image->size_x : image->size_y))
+        return ip_invalid_argument;
+    PPM_Image view, result;
+    ip_status status = make_view(rotated, 0, &result);
+    if (status != ip_ok)
+        return status;
+    status = make_view(image, 0, &view);
+    if (status != ip_ok) {
+        release_view(&result);
+        return status;
+    }
+
+    if (!rotate_copy(view.image_data, view.size_x, view.size_y, result.image_data, view.channels, degrees))
+        status = ip_out_of_memory;
+    release_view(&view);
+    release_view(&result);
+    return status;
+}
+
+/**
+ * @brief a PPM olvasás eredményének átalakítása hibakóddá
+ */
+static ip_status ppm_error(ppm_status status) {
+    switch (status) {
+        case ppm_ok:
+            return ip_ok;
+        case ppm_truncated:
+            return ip_truncated;
+        case ppm_no_memory:
+            return ip_out_of_memory;
+        default:
+            return ip_format_error;
+    }
+}
+
+/**
+ * @brief beolvassa egy memóriában lévő PPM kép fejlécét
+ * @param[in] *fp ide kerül a memóriát olvasó stream, NULL ha nem sikerült
+ * @param[in] *data a kép bájtjai
+ * @param[in] size a bájtok száma
+ * @param[in] *header ide kerül a fejléc
+ */
+static ip_status open_ppm(FILE **fp, const unsigned char *data, size_t size, PPM_Image *header) {
+    *fp = NULL;
+    if (data == NULL)
+        return ip_invalid_argument;
+    if (size == 0)
+        return ip_format_error;
+    *fp = fmemopen((void *) data, size, "rb");
+    if (*fp == NULL)
+        return ip_out_of_memory;
+    ip_status status = ppm_error(PPM_ReadHeader(*fp, header));
+    if (status != ip_ok) {
+        fclose(*fp);
+        *fp = NULL;
+    }
+    return status;
+}
+
+/**
+ * @brief egy memóriában lévő P3 vagy P6 kép mérete, a pixelek beolvasása nélkül
+ * @param[in] *data a kép bájtjai
+ * @param[in] size a bájtok száma
+ * @param[in] *size_x ide kerül az oszlopok száma
+ * @param[in] *size_y ide kerül a sorok száma
+ * @param[out] status a hibakód
+ */
+ip_status ip_ppm_info(const unsigned char *data, size_t size, int *size_x, int *size_y) {
+    if (size_x == NULL || size_y == NULL)
+        return ip_invalid_argument;
+    FILE *fp;
+    PPM_Image header;
+    ip_status status = open_ppm(&fp, data, size, &header);
+    if (status != ip_ok)
+        return status;
+    fclose(fp);
+    *size_x = header.size_x;
+    *size_y = header.size_y;
+    return ip_ok;
+}
+
+/**
+ * @brief egy memóriában lévő P3 vagy P6 kép beolvasása a hívó pufferébe
+ * @param[in] *data a kép bájtjai
+ * @param[in] size a bájtok száma
+ * @param[in] *image ide kerülnek a pixelek, a mérete az ip_ppm_info által adott méret, 3 csatornával
+ * @param[out] status a hibakód, ip_truncated esetén a hiányzó pixelek feketék
+ *
+ * A 255-nél nagyobb maxval-ú képeket 8 bitesre alakítjuk, mint a PPM_ReadFrame.
+ */
+ip_status ip_ppm_decode(const unsigned char *data, size_t size, ImageBuffer *image) {
+    PPM_Image view;
+    ip_status status = make_view(image, 3, &view);
+    if (status != ip_ok)
+        return status;
+
+    FILE *fp;
+    PPM_Image header;
+    status = open_ppm(&fp, data, size, &header);
+    if (status == ip_ok && (header.size_x != view.size_x || header.size_y != view.size_y))
+        status = ip_invalid_argument;
+    if (status == ip_ok)
+        status = ppm_error(PPM_ReadPixels(fp, &header, view.image_data));
+    if (fp != NULL)
+        fclose(fp);
+    release_view(&view);
+    return status;
+}
+
+/**
+ * @brief a kimeneti puffer, amibe a PPM_WriteFrame ír
+ */
+typedef struct OutBuffer {
+    unsigned char *data; /**< a puffer eleje */
+    size_t capacity; /**< a puffer mérete */
+    size_t used; /**< a már kiírt bájtok száma */
+} OutBuffer;
+
+/**
+ * @brief a kimeneti stream írása: a puffer végén túl nem írunk
+ *
+ * Az fmemopen helyett használjuk, mert az a teljesen kitöltött puffer utolsó bájtját lezáró nullára cserélné.
+ */
+static ssize_t write_buffer(void *cookie, const char *data, size_t size) {
+    OutBuffer *out = (OutBuffer *) cookie;
+    if (size > out->capacity - out->used)
+        size = out->capacity - out->used;
+    memcpy(out->data + out->used, data, size);
+    out->used += size;
+    return size;
+}
+
+/**
+ * @brief egy szám tízes számrendszerbeli jegyeinek száma
+ */
+static int digits(int value) {
+    int count = 1;
+    while (value >= 10) {
+        value /= 10;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief a kép PPM formátumban a hívó pufferébe
+ * @param[in] *image a kiírandó kép, egycsatornás képnél mindhárom színbe ugyanaz kerül
+ * @param[in] binary true esetén P6, különben P3
+ * @param[in] *out a kimeneti puffer
+ * @param[in] capacity a kimeneti puffer mérete
+ * @param[in] *written ide kerül a kiírt bájtok száma, ip_no_space esetén a szükséges méret
+ * @param[out] status a hibakód
+ *
+ * A kimenet bájtra ugyanaz, mint amit a PPM_WriteFrame egy fájlba írna. A szükséges méretet előre kiszámoljuk, így túl kicsi puffer esetén semmit nem írunk bele.
+ * Ha a kiíráshoz nem sikerült lefoglalni a sorpuffert, ip_out_of_memory a hibakód, és a pufferben csak a fejléc van.
+ */
+ip_status ip_ppm_encode(const ImageBuffer *image, bool binary, unsigned char *out, size_t capacity, size_t *written) {
+    if (out == NULL || written == NULL)
+        return ip_invalid_argument;
+    PPM_Image view;
+    ip_status status = make_view(image, 0, &view);
+    if (status != ip_ok)
+        return status;
+    strcpy(view.magic, binary ? "P6" : "P3");
+
+    size_t needed = snprintf(NULL, 0, "%s\n%d %d\n%d\n", view.magic, view.size_x, view.size_y, 255);
+    if (binary)
+        needed += (size_t) view.size_x * view.size_y * 3;
+    else {
+        int channel_step = (view.channels == 1) ? 0 : 1;
+        for (int line = 0; line < view.size_y; line++) {
+            for (int col = 0; col < view.size_x; col++) {
+                for (int color = 0; color < 3; color++)
+                    needed += digits(view.image_data[line][col][color * channel_step]) + 1;
+                needed++;
+            }
+        }
+    }
+    *written = needed;
+    if (capacity < needed) {
+        release_view(&view);
+        return ip_no_space;
+    }
+
+    OutBuffer buffer = {out, capacity, 0};
+    FILE *fp = fopencookie(&buffer, "wb", (cookie_io_functions_t) {NULL, write_buffer, NULL, NULL});
+    if (fp == NULL) {
+        release_view(&view);
+        return ip_out_of_memory;
+    }
+    bool complete = PPM_WriteFrame(fp, &view);
+    fclose(fp);
+    release_view(&view);
+    *written = buffer.used;
+    return complete ? ip_ok : ip_out_of_memory;
+}
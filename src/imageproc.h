@@ -0,0 +1,65 @@
+#ifndef IMAGEPROC
+#define IMAGEPROC
+
+/**
+ * @file
+ * @brief A libimageproc könyvtár nyilvános felülete
+ *
+ * A függvények a hívó által lefoglalt pixel pufferen dolgoznak, a pixeleket nem másolják és nem foglalnak le helyettük új képet. Hiba esetén nem állítják le a programot, hanem hibakódot adnak vissza.
+ * A véletlenszerű műveletek (pixelsort presetek, corrupt) a rand()-ot használják, ezt a hívónak kell az srand()-dal beállítania. A szálak számát az ip_set_threads állítja, az egész folyamatra.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "imagefunc.h"
+#include "resample.h"
+
+/**
+ * @brief a könyvtár függvényeinek eredménye
+ */
+typedef enum ip_status {
+  ip_ok,               /**< sikeres végrehajtás */
+  ip_invalid_argument, /**< hibás paraméter (NULL puffer, nem pozitív méret, túl kicsi stride, nem támogatott csatornaszám) */
+  ip_out_of_memory,    /**< nem sikerült lefoglalni a munkaterületet, a kép változatlan vagy részben módosult */
+  ip_format_error,     /**< a bemenet nem értelmezhető PPM kép */
+  ip_truncated,        /**< a bemenet a kép közepén véget ért, a hiányzó pixelek feketék */
+  ip_no_space          /**< a kimeneti puffer túl kicsi */
+} ip_status;
+
+/**
+ * @brief a hívó által lefoglalt kép
+ *
+ * Az y-adik sor x-edik pixelének színei a pixels + y * stride + x * channels címen kezdődnek. A sorok végén lehet kihagyás, ha a stride nagyobb mint size_x * channels.
+ */
+typedef struct ImageBuffer {
+    unsigned char *pixels; /**< az első sor eleje */
+    int size_x; /**< a kép oszlopainak száma */
+    int size_y; /**< a kép sorainak száma */
+    int stride; /**< két egymás utáni sor kezdete közötti távolság bájtban */
+    int channels; /**< a pixelenkénti színcsatornák száma: 3 (RGB) vagy 1 (szürkeárnyalatos) */
+} ImageBuffer;
+
+const char *ip_strerror(ip_status status);
+void ip_set_threads(int threads);
+
+ip_status ip_point_ops(ImageBuffer *image, int lightness, int contrast_level, int hue, bool negative, double sinecolor);
+ip_status ip_mirror(ImageBuffer *image, mirror_type type);
+ip_status ip_rgb_shift(ImageBuffer *image, RGB_SHIFT shift);
+ip_status ip_pixelsort(ImageBuffer *image, PsOptions options, int *sorted);
+ip_status ip_blur(ImageBuffer *image, int times);
+ip_status ip_sharpen(ImageBuffer *image, int times);
+ip_status ip_median(ImageBuffer *image, int radius);
+ip_status ip_corrupt(ImageBuffer *image, int *sorted);
+ip_status ip_grayscale(ImageBuffer *image);
+ip_status ip_anaglyph3d(ImageBuffer *image);
+ip_status ip_detect_edges(const ImageBuffer *image, ImageBuffer *edges);
+ip_status ip_resize(const ImageBuffer *image, ImageBuffer *resized, resample_filter filter);
+ip_status ip_transpose(const ImageBuffer *image, ImageBuffer *transposed);
+ip_status ip_rotate(const ImageBuffer *image, ImageBuffer *rotated, int degrees);
+
+ip_status ip_ppm_info(const unsigned char *data, size_t size, int *size_x, int *size_y);
+ip_status ip_ppm_decode(const unsigned char *data, size_t size, ImageBuffer *image);
+ip_status ip_ppm_encode(const ImageBuffer *image, bool binary, unsigned char *out, size_t capacity, size_t *written);
+
+#endif
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#include "isa.h"
+
+/*
+ * A kernelek minden utasításkészleten bitre ugyanazt számolják: a lebegőpontos szorzásokat és összeadásokat nem szabad FMA utasításokká összevonni,
+ * mert az más kerekítést adna, mint az általános változat.
+ */
+#pragma GCC optimize("fp-contract=off")
+
+#define KERNEL(name) name##_generic
+#include "isa_kernels.h"
+#undef KERNEL
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+#define KERNEL(name) name##_sse42
+#include "isa_kernels.h"
+#undef KERNEL
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define KERNEL(name) name##_avx2
+#include "isa_kernels.h"
+#undef KERNEL
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+#define KERNEL(name) name##_avx512
+#include "isa_kernels.h"
+#undef KERNEL
+#pragma GCC pop_options
+
+#define ISA_X86 1
+#else
+#define ISA_X86 0
+#endif
+
+#define KERNELS(isa, suffix) {isa, convolve_tile_##suffix, color_rows_##suffix, scale_samples_##suffix, lightness_keys_##suffix, transpose_tile_##suffix}
+
+/**
+ * @brief a kernelek táblázata, utasításkészletenként
+ */
+static const IsaKernels kernels[isa_count] = {
+    KERNELS("generic", generic),
+#if ISA_X86
+    KERNELS("sse4.2", sse42),
+    KERNELS("avx2", avx2),
+    KERNELS("avx512", avx512),
+#else
+    KERNELS("sse4.2", generic),
+    KERNELS("avx2", generic),
+    KERNELS("avx512", generic),
+#endif
+};
+
+static const IsaKernels *_Atomic selected = NULL; /**< a kiválasztott kernelek, az első használatkor állítjuk be; atomikus, mert az első használat lehet egyszerre több szálon is (pl. a könyvtár API párhuzamos sávjaiban) */
+
+/**
+ * @brief megállapítja, melyik a legjobb utasításkészlet, amit a processzor támogat
+ * @param[out] level a legjobb támogatott szint
+ */
+isa_level isa_detect(void) {
+#if ISA_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return isa_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return isa_avx2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return isa_sse42;
+#endif
+    return isa_generic;
+}
+
+/**
+ * @brief megnézi, hogy a processzor támogatja-e a megadott utasításkészletet
+ * @param[in] level az utasításkészlet
+ * @param[out] supported igaz, ha ezen a gépen futtatható
+ */
+bool isa_supported(isa_level level) {
+    return level >= isa_generic && level <= isa_detect();
+}
+
+/**
+ * @brief az utasításkészlet beolvasása a nevéből (generic, sse4.2, avx2, avx512)
+ * @param[in] *name a név
+ * @param[in] *level ide kerül a szint
+ * @param[out] found igaz, ha ismert a név
+ */
+bool isa_parse(const char *name, isa_level *level) {
+    for (int i = 0; i < isa_count; i++) {
+        if (strcmp(name, kernels[i].name) == 0) {
+            *level = (isa_level) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief kiválasztja a használandó kerneleket; a szintet előtte az isa_supported-del ellenőrizni kell
+ * @param[in] level az utasításkészlet
+ */
+void isa_select(isa_level level) {
+    atomic_store(&selected, &kernels[level]);
+}
+
+/**
+ * @brief a kiválasztott utasításkészlet
+ * @param[out] level a szint, ha még nem választottunk, akkor a legjobb támogatott
+ */
+isa_level isa_current(void) {
+    return (isa_level) (isa_kernels() - kernels);
+}
+
+/**
+ * @brief a használandó kernelek; ha még nem választottunk, akkor a processzor alapján választunk
+ * @param[out] *kernels a kernelek táblázata
+ */
+const IsaKernels *isa_kernels(void) {
+    const IsaKernels *current = atomic_load(&selected);
+    if (current == NULL) {
+        /* ha több szál egyszerre választ, mind ugyanazt a szintet írja be */
+        isa_select(isa_detect());
+        current = atomic_load(&selected);
+    }
+    return current;
+}
+
+/**
+ * @brief kiírja a kiválasztott kerneleket
+ * @param[in] *fp ide írunk
+ */
+void isa_print(FILE *fp) {
+    const IsaKernels *current = isa_kernels();
+    fprintf(fp, "Utasításkészlet: %s (támogatott: %s)\n", current->name, kernels[isa_detect()].name);
+    fprintf(fp, "  convolve:        convolve_tile/%s\n", current->name);
+    fprintf(fp, "  szín (corrupt):  color_rows/%s\n", current->name);
+    fprintf(fp, "  P6 beolvasás:    scale_samples/%s\n", current->name);
+    fprintf(fp, "  pixelsort kulcs: lightness_keys/%s\n", current->name);
+    fprintf(fp, "  transzponálás:   transpose_tile/%s\n", current->name);
+}
@@ -0,0 +1,46 @@
+#ifndef ISA
+#define ISA
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "imagefunc.h"
+
+/**
+ * @brief az utasításkészlet-szintek, amikre a gyakran futó függvények külön le vannak fordítva
+ */
+typedef enum isa_level {
+  isa_generic, /**< a fordító alapbeállítása, bármelyik gépen fut */
+  isa_sse42, /**< SSE4.2 */
+  isa_avx2, /**< AVX2 */
+  isa_avx512, /**< AVX-512 (F és BW) */
+  isa_count /**< a szintek száma */
+} isa_level;
+
+/**
+ * @brief a gyakran futó függvények egy utasításkészletre fordított változatai
+ *
+ * Szándékosan nem kerültek ide, tehát a fordító alapbeállításával futnak:
+ * - a pontonkénti színműveletek (ip_point_ops: fényesség, kontraszt, Hue, negatív, sinecolor). Pixelenként függvényhívások láncai, double számolással és feltételekkel; egy kernelnek bitre ugyanezt a kerekítési sorrendet kellene követnie. Az átfedéses feldolgozásban sávonként, a beolvasással párhuzamosan futnak.
+ * - a szöveges (P2, P3) beolvasás és kiírás (readimage_text_parallel, format_rows). A változó hosszúságú számok karakterenkénti feldolgozása elágazásos, ezért vektorizálás helyett a sorokat szálanként párhuzamosan dolgozzuk fel.
+ * @see isa_kernels
+ */
+typedef struct IsaKernels {
+    const char *name; /**< az utasításkészlet neve */
+    void (*convolve_tile)(unsigned char *src, unsigned char *dst, int ext_x0, int ext_y0, int ext_w,
+                          int y0, int y1, int x0, int x1, int size_x, int size_y, Filter filter, int channels); /**< a convolve egy csempéje */
+    void (*color_rows)(unsigned char ***image, int first, int last, int size_x, double light, int hue, const unsigned char contrast[256]); /**< fényesség, kontraszt és Hue egy HSL átalakítással */
+    void (*scale_samples)(const unsigned char *raw, unsigned char *row, int samples, int bytes, int maxval); /**< a P6 minták 8 bitesre alakítása */
+    void (*lightness_keys)(Sort *keys, const unsigned char *row, int start, int end); /**< a pixelsort rendezési kulcsai (HSL Lightness) */
+    void (*transpose_tile)(unsigned char ***src, unsigned char ***dst, int y0, int y1, int x0, int x1, int channels); /**< a transzponálás egy csempéje */
+} IsaKernels;
+
+isa_level isa_detect(void);
+bool isa_supported(isa_level level);
+bool isa_parse(const char *name, isa_level *level);
+void isa_select(isa_level level);
+isa_level isa_current(void);
+const IsaKernels *isa_kernels(void);
+void isa_print(FILE *fp);
+
+#endif
@@ -0,0 +1,317 @@
+/**
+ * @file
+ * @brief A gyakran futó függvények, amiket az isa.c minden utasításkészletre külön lefordít
+ *
+ * Ezt a fájlt többször illesztjük be, ezért nincs include guard. Beillesztés előtt a KERNEL(név) makrónak az utasításkészlettel kiegészített nevet kell adnia, és a fordítót a megfelelő #pragma GCC target beállítással kell hívni.
+ * A függvényeknek minden utasításkészleten bitre ugyanazt kell adniuk, mint az általános változatnak, ezt a --verify-kernels ellenőrzi.
+ */
+
+/**
+ * @brief RGB pixel HSL-re alakítása, ugyanúgy mint az rgb2hsl
+ * @see rgb2hsl
+ */
+static inline HSL KERNEL(pixel_to_hsl)(const unsigned char pixel[]) {
+    double r = pixel[0]/255.0;
+    double g = pixel[1]/255.0;
+    double b = pixel[2]/255.0;
+    double Xmin = (r < g) ? r : g;
+    Xmin = (b < Xmin) ? b : Xmin;
+    double Xmax = (r > g) ? r : g;
+    Xmax = (b > Xmax) ? b : Xmax;
+
+    HSL hsl = {0, 0, (Xmin + Xmax)/2.0};
+    if (Xmin != Xmax) {
+        if (hsl.l < 0.5)
+            hsl.s = (Xmax - Xmin)/(Xmax + Xmin);
+        else
+            hsl.s = (Xmax - Xmin)/(2 - Xmax - Xmin);
+        if (r == Xmax)
+            hsl.h = (g-b)/(Xmax - Xmin) + ((g < b) ? 6 : 0);
+        else if (g == Xmax)
+            hsl.h = 2 + (b-r)/(Xmax - Xmin);
+        else
+            hsl.h = 4 + (r-g)/(Xmax - Xmin);
+        if (hsl.h < 0.0)
+            hsl.h += 6;
+        hsl.h /= 6.0;
+    }
+    return hsl;
+}
+
+/**
+ * @brief egy szín értéke a HSL-ből, ugyanúgy mint a hsl2rgbcolor
+ * @see hsl2rgbcolor
+ */
+static inline double KERNEL(hsl_color)(double temp1, double temp2, double temp3) {
+    if (temp3 < (1/6.0))
+        return temp1+(temp2-temp1)*6*temp3;
+    if (temp3 < (1/2.0))
+        return temp2;
+    if (temp3 < (2/3.0))
+        return temp1+(temp2-temp1)*(2/3.0 - temp3)*6;
+    return temp1;
+}
+
+/**
+ * @brief HSL pixel RGB-re alakítása, ugyanúgy mint a hsl2rgb
+ * @see hsl2rgb
+ */
+static inline void KERNEL(hsl_to_pixel)(HSL hsl, unsigned char pixel[]) {
+    if (hsl.s == 0.0) {
+        pixel[0] = pixel[1] = pixel[2] = (unsigned char) (hsl.l*255);
+        return;
+    }
+    double temp2 = (hsl.l < 0.5) ? hsl.l*(1.0+hsl.s) : hsl.l + hsl.s - hsl.l*hsl.s;
+    double temp1 = 2.0 * hsl.l - temp2;
+    double temp3 = hsl.h+1/3.0;
+    if (temp3 > 1)
+        temp3 = temp3 - 1.0;
+    pixel[0] = (unsigned char) (KERNEL(hsl_color)(temp1, temp2, temp3)*255);
+    pixel[1] = (unsigned char) (KERNEL(hsl_color)(temp1, temp2, hsl.h)*255);
+    temp3 = hsl.h-1/3.0;
+    if (temp3 < 0.0)
+        temp3 = temp3 + 1.0;
+    pixel[2] = (unsigned char) (KERNEL(hsl_color)(temp1, temp2, temp3)*255);
+}
+
+/**
+ * @brief A convolve egy csempéjének egy iterációja
+ * @param[in] *src a csempe bemeneti puffere (a kibővített terület, sorfolytonosan, pixelenként channels érték)
+ * @param[in] *dst a csempe kimeneti puffere, a src-vel azonos elrendezésben
+ * @param[in] ext_x0 a puffer bal felső sarkának oszlopa a képen
+ * @param[in] ext_y0 a puffer bal felső sarkának sora a képen
+ * @param[in] ext_w a puffer szélessége
+ * @param[in] y0 az első kiszámolandó sor
+ * @param[in] y1 az utolsó utáni kiszámolandó sor
+ * @param[in] x0 az első kiszámolandó oszlop
+ * @param[in] x1 az utolsó utáni kiszámolandó oszlop
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] filter a használandó filter
+ * @param[in] channels a kép színcsatornáinak száma
+ *
+ * A számolás pontosan ugyanaz mint az egész képen futó változatban, csak a szomszédokat a pufferből olvassuk. A kép szélén kívül eső koordinátákat a legközelebbi szélső pixelre szorítjuk, ami mindig benne van a pufferben.
+ * Ha a filter szorzója kettő hatványa (pl. blur: 1/16, sharpen: 1), akkor a lebegőpontos összeg minden részeredménye pontosan ábrázolható, így egész számokkal is összeadhatunk és csak a végén szorzunk, ami ugyanazt az eredményt adja, csak gyorsabban.
+ */
+static void KERNEL(convolve_tile)(unsigned char *src, unsigned char *dst, int ext_x0, int ext_y0, int ext_w,
+                          int y0, int y1, int x0, int x1, int size_x, int size_y, Filter filter, int channels) {
+    int taps = filter.size_x * filter.size_y;
+    int tap_y[taps];
+    int tap_x[taps];
+    int tap_w[taps];
+    int exponent;
+    bool exact = (frexp(filter.mult, &exponent) == 0.5);
+
+    /* a megfordított filter elemei abban a sorrendben, ahogy össze kell adni őket */
+    int t = 0;
+    for (int k = 0; k < filter.size_y; k++) {
+        int kk = filter.size_y - 1 - k;
+        for (int l = 0; l < filter.size_x; l++) {
+            int ll = filter.size_x - 1 - l;
+            tap_y[t] = filter.size_y / 2 - kk;
+            tap_x[t] = filter.size_x / 2 - ll;
+            tap_w[t] = filter.filt[kk][ll];
+            t++;
+        }
+    }
+
+    /* azok az oszlopok, ahol a filter egyik eleme sem lóg ki a kép oldalain */
+    int inner_x0 = x0;
+    int inner_x1 = x1;
+    for (t = 0; t < taps; t++) {
+        if (-tap_x[t] > inner_x0)
+            inner_x0 = -tap_x[t];
+        if (size_x - tap_x[t] < inner_x1)
+            inner_x1 = size_x - tap_x[t];
+    }
+    if (inner_x1 < inner_x0)
+        inner_x1 = inner_x0 = x1;
+
+    int width = (inner_x1 - inner_x0) * channels;
+    int iacc[width > 0 ? width : 1];
+    double acc[width > 0 ? width : 1];
+
+    for (int i = y0; i < y1; i++) { /* sorok */
+        /* a szélső oszlopokban pixelenként, a szomszédokat a képre szorítva számolunk */
+        for (int j = x0; j < x1; j++) { /* oszlopok */
+            if (j == inner_x0)
+                j = inner_x1;
+            if (j >= x1)
+                break;
+
+            double sum[3] = {0, 0, 0};
+            int isum[3] = {0, 0, 0};
+
+            for (t = 0; t < taps; t++) {
+                /* a vizsgálandó pixel koordinátái, ha kívül esnek a képen akkor a legközelebbi szélső pixelé */
+                int ii = i + tap_y[t];
+                int jj = j + tap_x[t];
+                ii = (ii < 0) ? 0 : (ii > size_y-1) ? size_y-1 : ii;
+                jj = (jj < 0) ? 0 : (jj > size_x-1) ? size_x-1 : jj;
+
+                unsigned char *p = src + ((ii - ext_y0) * ext_w + (jj - ext_x0)) * channels;
+                for (int color = 0; color < channels; color++) {
+                    if (exact)
+                        isum[color] += p[color] * tap_w[t];
+                    else
+                        sum[color] += p[color] * filter.mult*tap_w[t];
+                }
+            }
+            /* levágjuk a 0 és 255 közötti intervallumra */
+            unsigned char *q = dst + ((i - ext_y0) * ext_w + (j - ext_x0)) * channels;
+            for (int color = 0; color < channels; color++) {
+                if (exact)
+                    sum[color] = isum[color] * filter.mult;
+                q[color] = (unsigned char) clamp(sum[color], 0, 255);
+            }
+        }
+
+        if (width <= 0)
+            continue;
+
+        /*
+         * a belső oszlopokban az egész sort egyszerre számoljuk: mivel a szomszédok eltolása a sorban mindig a csatornák számának többszöröse,
+         * a színcsatornák nem keverednek, így a sor bájtjain egyetlen egyszerű (vektorizálható) ciklus megy végig filter elemenként
+         */
+        unsigned char *q = dst + ((i - ext_y0) * ext_w + (inner_x0 - ext_x0)) * channels;
+        for (int b = 0; b < width; b++) {
+            iacc[b] = 0;
+            acc[b] = 0;
+        }
+        for (t = 0; t < taps; t++) {
+            int ii = i + tap_y[t];
+            ii = (ii < 0) ? 0 : (ii > size_y-1) ? size_y-1 : ii;
+            unsigned char *p = src + ((ii - ext_y0) * ext_w + (inner_x0 + tap_x[t] - ext_x0)) * channels;
+            int w = tap_w[t];
+            if (exact) {
+                for (int b = 0; b < width; b++)
+                    iacc[b] += p[b] * w;
+            }
+            else {
+                for (int b = 0; b < width; b++)
+                    acc[b] += p[b] * filter.mult*w;
+            }
+        }
+        for (int b = 0; b < width; b++) {
+            double value = exact ? iacc[b] * filter.mult : acc[b];
+            q[b] = (unsigned char) ((value < 0) ? 0 : (value > 255) ? 255 : value);
+        }
+    }
+}
+
+/**
+ * @brief a fényesség, a kontraszt és a Hue egyszerre történő módosítása a [first, last) sorokon
+ * @param[in] ***image a módosítandó RGB kép
+ * @param[in] first az első sor
+ * @param[in] last az utolsó utáni sor
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] light a HSL Lightness változása
+ * @param[in] hue a Hue eltolása (-100)-100
+ * @param[in] contrast[] a kontraszt táblázata, színértékenként
+ *
+ * A műveletek sorrendje ugyanaz, mint a change_light, a contrast és a hue_shift egymás utáni hívásánál, így az eredmény is bitre ugyanaz. A kontraszt nem cserélhető fel a Hue eltolásával: a színenkénti 0-255 közé vágás után a pixel Hue-ja is megváltozhat. A kontrasztot egy táblázatból alkalmazzuk, a pixelt a fényesség után visszaalakítjuk, mert a kontraszt a kerekített színértékeken dolgozik.
+ */
+static void KERNEL(color_rows)(unsigned char ***image, int first, int last, int size_x, double light, int hue, const unsigned char contrast[256]) {
+    for (int i = first; i < last; i++) {
+        unsigned char *pixel = image[i][0];
+        for (int j = 0; j < size_x; j++, pixel += 3) {
+            HSL hsl = KERNEL(pixel_to_hsl)(pixel);
+            hsl.l = hsl.l + light;
+            hsl.l = (hsl.l < 0.0) ? 0.0 : (hsl.l > 1.0) ? 1.0 : hsl.l;
+            KERNEL(hsl_to_pixel)(hsl, pixel);
+            pixel[0] = contrast[pixel[0]];
+            pixel[1] = contrast[pixel[1]];
+            pixel[2] = contrast[pixel[2]];
+            hsl = KERNEL(pixel_to_hsl)(pixel);
+            hsl.h = (abs((int) (hsl.h*100 + hue))%100)/100.0;
+            KERNEL(hsl_to_pixel)(hsl, pixel);
+        }
+    }
+}
+
+/**
+ * @brief a P6 fájlból beolvasott minták 8 bitesre alakítása
+ * @param[in] *raw a nyers bájtok, mintánként 1 vagy 2 (big endian)
+ * @param[in] *row ide kerülnek a 8 bites minták
+ * @param[in] samples a minták száma
+ * @param[in] bytes a minták mérete bájtban
+ * @param[in] maxval a kép maxval-ja, az ennél nagyobb mintákat maxval-ra vágjuk
+ */
+static void KERNEL(scale_samples)(const unsigned char *raw, unsigned char *row, int samples, int bytes, int maxval) {
+    float scale = 255.0f/maxval;
+    if (bytes == 1) {
+        if (maxval == 255) {
+            memcpy(row, raw, samples);
+            return;
+        }
+        for (int i = 0; i < samples; i++) {
+            int temp = (raw[i] > maxval) ? maxval : raw[i];
+            row[i] = (unsigned char) (temp*scale);
+        }
+        return;
+    }
+    for (int i = 0; i < samples; i++) {
+        int temp = raw[2*i] << 8 | raw[2*i+1];
+        temp = (temp > maxval) ? maxval : temp;
+        row[i] = (unsigned char) (temp*scale);
+    }
+}
+
+/**
+ * @brief a pixelsort rendezési kulcsai: a pixelek HSL Lightness értéke, ugyanúgy mint az rgb2hsl(pixel).l
+ * @param[in] *keys ide kerülnek a kulcsok és az oszlopok indexei
+ * @param[in] *row a sor RGB pixelei, sorfolytonosan
+ * @param[in] start az első oszlop
+ * @param[in] end az utolsó utáni oszlop
+ */
+static void KERNEL(lightness_keys)(Sort *keys, const unsigned char *row, int start, int end) {
+    for (int i = start; i < end; i++) {
+        const unsigned char *pixel = row + 3*i;
+        int low = (pixel[0] < pixel[1]) ? pixel[0] : pixel[1];
+        low = (pixel[2] < low) ? pixel[2] : low;
+        int high = (pixel[0] > pixel[1]) ? pixel[0] : pixel[1];
+        high = (pixel[2] > high) ? pixel[2] : high;
+        keys[i - start].idx = i;
+        keys[i - start].value = (low/255.0 + high/255.0)/2.0;
+    }
+}
+
+/**
+ * @brief a transpose_copy egy csempéje: dst[j][i] = src[i][j]
+ * @param[in] ***src a bemeneti kép
+ * @param[in] ***dst a kimeneti kép
+ * @param[in] y0 a csempe első sora a bemeneten
+ * @param[in] y1 a csempe utolsó utáni sora
+ * @param[in] x0 a csempe első oszlopa a bemeneten
+ * @param[in] x1 a csempe utolsó utáni oszlopa
+ * @param[in] channels a színcsatornák száma
+ *
+ * A kimenet egy sorát egyszerre írjuk; a bemenet sorainak címét előre kigyűjtjük, így a belső ciklus csak egy lépésközzel olvas. Az 1 és 3 csatornás képeknek saját ciklusa van, hogy a fordító a pixel méretét ismerve vektorizálhasson.
+ * @see transpose_copy
+ */
+static void KERNEL(transpose_tile)(unsigned char ***src, unsigned char ***dst, int y0, int y1, int x0, int x1, int channels) {
+    const unsigned char *rows[y1 - y0];
+    for (int i = y0; i < y1; i++)
+        rows[i - y0] = src[i][0];
+    int height = y1 - y0;
+
+    for (int j = x0; j < x1; j++) {
+        unsigned char *restrict out = dst[j][y0];
+        if (channels == 3) {
+            for (int i = 0; i < height; i++) {
+                const unsigned char *p = rows[i] + 3*j;
+                out[3*i] = p[0];
+                out[3*i + 1] = p[1];
+                out[3*i + 2] = p[2];
+            }
+        }
+        else if (channels == 1) {
+            for (int i = 0; i < height; i++)
+                out[i] = rows[i][j];
+        }
+        else {
+            for (int i = 0; i < height; i++)
+                memcpy(out + i * channels, rows[i] + j * channels, channels);
+        }
+    }
+}
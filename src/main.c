@@ -1,12 +1,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <math.h>
 #include <string.h>
 #include <stdbool.h>
 #include <getopt.h>
 
 #include "ppm.h"
+#include "imageio.h"
 #include "imagefunc.h"
+#include "sequence.h"
+#include "stagecache.h"
+#include "resample.h"
+#include "stats.h"
+#include "verify.h"
+#include "isa.h"
+#include "imageproc.h"
+#include "pipeline.h"
+#include "transform.h"
+#include "memusage.h"
+#include "parallel.h"
+#include "trace.h"
 
 /**
  * @file
@@ -14,29 +28,928 @@
  * @details debugmalloc helyett a Valgrindot használtam a tesztelésre és nem jelzett hibát
 */
 
+/**
+ * @brief a parancssorban megadott beállítások
+ */
+typedef struct CmdOptions {
+    int lightness;
+    int contrast;
+    bool grayscale;
+    int hue_shift;
+    double sinecolor_shft;
+    bool invert;
+    mirror_type mirror;
+    RGB_SHIFT rgbshft;
+    pixelsort_preset ps_preset;
+    int blur;
+    int sharpen;
+    bool edge;
+    bool corrupt;
+    bool a3d;
+    bool sequence; /**< egymás után fűzött képkockák feldolgozása */
+    bool stable_random; /**< minden képkocka ugyanazokat a véletlenszerű paramétereket kapja */
+    unsigned int seed; /**< a véletlenszám-generátor kezdőértéke */
+    bool seed_given; /**< a kezdőértéket a parancssorban adták meg */
+    char *cache_dir; /**< a gyorsítótár könyvtára, NULL ha nincs gyorsítótár */
+    long long cache_size; /**< a gyorsítótár legnagyobb mérete bájtban */
+    bool region_given; /**< a műveletek csak a region területén hajtódnak végre */
+    Region region; /**< a --roi és a --mask által kijelölt terület */
+    PPM_Image mask; /**< a maszk kép, image_data NULL ha nincs maszk */
+    uint64_t mask_hash; /**< a maszk fájl hash-e a gyorsítótár kulcsához */
+    int preview_scale; /**< előnézetnél a kicsinyítés mértéke (1, 2, 4 vagy 8), 1 ha nincs kicsinyítés */
+    int resize_x; /**< az átméretezett kép oszlopainak száma, 0 ha nincs átméretezés */
+    int resize_y; /**< az átméretezett kép sorainak száma */
+    resample_filter resize_filter; /**< az átméretezés szűrője */
+    bool adaptive; /**< a pixelsort presetek a kép statisztikái alapján választják a paramétereiket */
+    bool stats_only; /**< csak a bemenet statisztikáit írjuk ki */
+    bool verify; /**< az optimalizált függvények összevetése a referencia változatukkal */
+    bool stats; /**< a futás végén kiírjuk a használt kerneleket */
+    image_format format; /**< a kimeneti kép formátuma, format_auto esetén a kimeneti fájl kiterjesztése dönt */
+    double ps_angle; /**< a pixelsort iránya fokban, 0 vízszintes, 90 függőleges */
+    bool transpose; /**< a kép transzponálása */
+    int rotate; /**< a forgatás szöge az óramutató járásával megegyezően (90, 180 vagy 270), 0 ha nincs forgatás */
+    long long max_memory; /**< a képek és a munkaterületek együttes memóriakorlátja bájtban, 0 ha nincs korlát */
+    int median; /**< a medián szűrő sugara, 0 ha nincs zajszűrés */
+} CmdOptions;
+
+/**
+ * @brief a feldolgozás egy lépése
+ */
+typedef struct Stage {
+    const char *name; /**< a lépés neve */
+    char params[128]; /**< a lépés paraméterei kanonikus alakban, ez kerül a gyorsítótár kulcsába */
+    bool random; /**< true ha a lépés a véletlenszám-generátort használja */
+    void (*run)(PPM_Image *image, CmdOptions *options); /**< a lépést végrehajtó függvény */
+    int halo; /**< ennyi pixelnyi környezetét kell a terület körül is beolvasni */
+    bool whole; /**< a lépés a kép méretét változtatja, ezért --roi esetén is a teljes képen fut */
+    bool rows; /**< a lépés soronként független, így a kép egy sávján is végrehajtható */
+    long long (*memory)(PPM_Image *shape, CmdOptions *options, bool low); /**< a lépés alatt a kép mellett lefoglalt legtöbb bájt becslése (low esetén a kevesebb memóriát használó változaté), a shape-et a lépés utáni méretre állítja */
+} Stage;
+
+#define MAX_STAGES 16 /**< a lépések legnagyobb száma */
+#define IO_RESERVE_BYTES (5LL * 1024 * 1024) /**< a be- és kiírás puffereinek becslése a soronkénti puffereken felül (a szöveges kiírás egy menete legfeljebb 4 MB) */
+
+/** @brief a kép pufferként a könyvtár függvényei számára, a pixelek másolása nélkül */
+static ImageBuffer image_buffer(PPM_Image *image) {
+    ImageBuffer buffer = {image->image_data[0][0], image->size_x, image->size_y, image->size_x * image->channels, image->channels};
+    return buffer;
+}
+
+/** @brief ha a könyvtár függvénye hibával tért vissza, kiírjuk és kilépünk */
+static void check_status(ip_status status, const char *stage) {
+    if (status != ip_ok) {
+        fprintf(stderr, "%s: %s\n", stage, ip_strerror(status));
+        abort();
+    }
+}
+
+/** @brief átméretezés, előnézetnél a kicsinyített méretre */
+static void stage_resize(PPM_Image *image, CmdOptions *options) {
+    int scale = options->preview_scale;
+    resize_image(image, (options->resize_x + scale - 1) / scale, (options->resize_y + scale - 1) / scale, options->resize_filter);
+}
+
+/** @brief transzponálás */
+static void stage_transpose(PPM_Image *image, CmdOptions *options) {
+    (void) options;
+    transpose_image(image);
+}
+
+/** @brief forgatás */
+static void stage_rotate(PPM_Image *image, CmdOptions *options) {
+    rotate_image(image, options->rotate);
+}
+
+/** @brief pixelenkénti műveletek: fényesség, kontraszt, hue, invertálás, szinusz színeltolás */
+static void stage_pointops(PPM_Image *image, CmdOptions *options) {
+    expand_rgb(image);
+    ImageBuffer buffer = image_buffer(image);
+    check_status(ip_point_ops(&buffer, options->lightness, options->contrast, options->hue_shift, options->invert, options->sinecolor_shft), "pointops");
+}
+
+/** @brief tükrözés */
+static void stage_mirror(PPM_Image *image, CmdOptions *options) {
+    ImageBuffer buffer = image_buffer(image);
+    check_status(ip_mirror(&buffer, options->mirror), "mirror");
+}
+
+/** @brief RGB shift, előnézetnél az eltolásokat is kicsinyítjük */
+static void stage_rgbshift(PPM_Image *image, CmdOptions *options) {
+    RGB_SHIFT shift = options->rgbshft;
+    int scale = options->preview_scale;
+    shift.red_x /= scale;
+    shift.red_y /= scale;
+    shift.green_x /= scale;
+    shift.green_y /= scale;
+    shift.blue_x /= scale;
+    shift.blue_y /= scale;
+    expand_rgb(image);
+    ImageBuffer buffer = image_buffer(image);
+    check_status(ip_rgb_shift(&buffer, shift), "rgb-shift");
+}
+
+/**
+ * @brief a HSL Lightness adott percentilise 0-100 között, ahogy a pixelsort küszöbei várják
+ */
+static int light_percent(ImageStats *stats, double fraction) {
+    return stats_percentile(stats->lightness, stats->pixels, fraction) * 100 / 255;
+}
+
+/**
+ * @brief a preset küszöbeit és környezetét a kép tartalmához igazítja
+ * @param[in] *image a rendezendő kép
+ * @param[in] *preset a preset, aminek a küszöbeit és környezetét felülírjuk
+ * @param[in] type a preset típusa
+ *
+ * A küszöbök a Lightness hisztogram percentilisei, így sötét vagy világos képen is ugyanakkora része kerül a kijelölt tartományba, mint egy átlagos képen. A környezet mérete a két él közötti átlagos távolsághoz (az élsűrűség reciprokához) igazodik, a presettől függő szorzóval.
+ * @see image_stats
+ */
+static void adapt_preset(PPM_Image *image, PsOptions *preset, pixelsort_preset type) {
+    ImageStats stats;
+    image_stats(image, &stats);
+
+    double low = 1, high = 2;
+    switch (type) {
+        case landscape:
+            preset->treshold_bottom_min = light_percent(&stats, 0.02);
+            preset->treshold_bottom_max = light_percent(&stats, 0.10);
+            preset->treshold_top_min = light_percent(&stats, 0.50);
+            preset->treshold_top_max = light_percent(&stats, 0.70);
+            low = 2;
+            high = 4;
+            break;
+        case macro:
+            preset->treshold_bottom_min = light_percent(&stats, 0.05);
+            preset->treshold_bottom_max = light_percent(&stats, 0.40);
+            preset->treshold_top_min = light_percent(&stats, 0.60);
+            preset->treshold_top_max = light_percent(&stats, 1.0);
+            low = 0.5;
+            high = 1;
+            break;
+        case fewcolors:
+            preset->treshold_bottom_min = light_percent(&stats, 0.02);
+            preset->treshold_bottom_max = light_percent(&stats, 0.10);
+            preset->treshold_top_min = light_percent(&stats, 0.50);
+            preset->treshold_top_max = light_percent(&stats, 0.70);
+            break;
+        case dark:
+            /* rgb_sum: a három szín összege, a legsötétebb 10% */
+            preset->treshold_top_min = 3 * stats_percentile(stats.lightness, stats.pixels, 0.10);
+            preset->treshold_top_max = preset->treshold_top_min;
+            break;
+        default:
+            return;
+    }
+
+    double spacing = (stats.edge_density > 0) ? 1 / stats.edge_density : image->size_x / 5.0;
+    preset->interval_min = (int) clamp(spacing * low, 2, image->size_x / 2);
+    preset->interval_max = (int) clamp(spacing * high, preset->interval_min + 1, image->size_x);
+}
+
+/** @brief a preset alapján beállítja és végrehajtja a pixelsortot */
+static void stage_pixelsort(PPM_Image *image, CmdOptions *options) {
+    PsOptions preset;
+
+    if (options->ps_preset == allrandom) {
+        preset.pstype = hsl_l;
+        preset.treshold = ran;
+        preset.treshold_bottom_min = 0;
+        preset.treshold_bottom_max = 100;
+        preset.treshold_top_min = 0;
+        preset.treshold_top_max = 100;
+        preset.interval = ran;
+        preset.interval_min = image->size_x/40;
+        preset.interval_max = image->size_x/5;
+        preset.merge = 1.0/(rand()%5)*(0.5+(rand()%10)/10);
+    }
+
+    if (options->ps_preset == landscape) {
+        preset.pstype = hsl_l;
+        preset.treshold = ran;
+        preset.treshold_bottom_min = 0;
+        preset.treshold_bottom_max = 10;
+        preset.treshold_top_min = 0;
+        preset.treshold_top_max = 70;
+        preset.interval = ran;
+        preset.interval_min = image->size_x/10;
+        preset.interval_max = image->size_x/5;
+        preset.merge = 1;
+    }
+
+    if (options->ps_preset == macro) {
+        preset.pstype = hsl_l;
+        preset.treshold = ran;
+        preset.treshold_bottom_min = 0;
+        preset.treshold_bottom_max = 70;
+        preset.treshold_top_min = 0;
+        preset.treshold_top_max = 100;
+        preset.interval = ran;
+        preset.interval_min = image->size_x/40;
+        preset.interval_max = image->size_x/35;
+        preset.merge = 1;
+    }
+
+    if (options->ps_preset == fewcolors) {
+        preset.pstype = hsl_l;
+        preset.treshold = ran;
+        preset.treshold_bottom_min = 0;
+        preset.treshold_bottom_max = 10;
+        preset.treshold_top_min = 0;
+        preset.treshold_top_max = 70;
+        preset.interval = ran;
+        preset.interval_min = image->size_x/30;
+        preset.interval_max = image->size_x/20;
+        preset.merge = 1/2.0;
+    }
+
+    if (options->ps_preset == dark) {
+        preset.pstype = rgb_sum;
+        preset.treshold = man;
+        preset.treshold_bottom_min = 1;
+        preset.treshold_bottom_max = 1;
+        preset.treshold_top_min = 50;
+        preset.treshold_top_max = 10;
+        preset.interval = ran;
+        preset.interval_min = image->size_x/30;
+        preset.interval_max = image->size_x/20;
+        preset.merge = 1;
+    }
+    if (options->ps_preset == edge) {
+        preset.pstype = edges;
+    }
+    preset.angle = options->ps_angle;
+    if (options->adaptive)
+        adapt_preset(image, &preset, options->ps_preset);
+
+    expand_rgb(image);
+    ImageBuffer buffer = image_buffer(image);
+    int sorted;
+    time_t seconds = time(NULL);
+    check_status(ip_pixelsort(&buffer, preset, &sorted), "pixelsort");
+    if (preset.pstype == edges)
+        printf("Edges pixelsort %d alkalommal végrehajtva, %ld másodperc alatt\n", sorted, time(NULL)-seconds);
+    else
+        printf("Pixelsort végrehajtva %d alkalommal\n", sorted);
+}
+
+/** @brief elmosás */
+static void stage_blur(PPM_Image *image, CmdOptions *options) {
+    ImageBuffer buffer = image_buffer(image);
+    check_status(ip_blur(&buffer, options->blur), "blur");
+}
+
+/** @brief zajszűrés medián szűrővel */
+static void stage_median(PPM_Image *image, CmdOptions *options) {
+    ImageBuffer buffer = image_buffer(image);
+    check_status(ip_median(&buffer, options->median), "median");
+}
+
+/** @brief élesítés */
+static void stage_sharpen(PPM_Image *image, CmdOptions *options) {
+    ImageBuffer buffer = image_buffer(image);
+    check_status(ip_sharpen(&buffer, options->sharpen), "sharpen");
+}
+
+/**
+ * @brief véletlenszerű tönkretétel
+ *
+ * Az ip_corrupt legalább 5x3 pixeles képet vár. A kisebb képet (pl. egy kis --roi területet) figyelmeztetéssel változatlanul hagyjuk, a többi lépés ettől még lefut.
+ */
+static void stage_corrupt(PPM_Image *image, CmdOptions *options) {
+    (void) options;
+    if (image->size_x < 5 || image->size_y < 3) {
+        printf("a corrupt legalább 5x3 pixeles területet igényel, a %dx%d méretűt kihagyjuk\n", image->size_x, image->size_y);
+        return;
+    }
+    expand_rgb(image);
+    ImageBuffer buffer = image_buffer(image);
+    int sorted;
+    check_status(ip_corrupt(&buffer, &sorted), "corrupt");
+    printf("Pixelsort végrehajtva %d alkalommal\n", sorted);
+}
+
+/** @brief szürkeárnyalatossá alakítás */
+static void stage_grayscale(PPM_Image *image, CmdOptions *options) {
+    (void) options;
+    grayscale_image(image);
+}
+
+/** @brief vörös-cián 3D */
+static void stage_3d(PPM_Image *image, CmdOptions *options) {
+    (void) options;
+    expand_rgb(image);
+    ImageBuffer buffer = image_buffer(image);
+    check_status(ip_anaglyph3d(&buffer), "3d");
+}
+
+/** @brief élkeresés, az eredmény egy egycsatornás kép */
+static void stage_edge(PPM_Image *image, CmdOptions *options) {
+    (void) options;
+    unsigned char ***edges = detect_edges(image->image_data, image->size_x, image->size_y, image->channels);
+    if (edges == NULL) {
+        perror("error allocating image");
+        abort();
+    }
+    freeimage(image->image_data, image->size_x, image->size_y);
+    image->image_data = edges;
+    image->channels = 1;
+}
+
+/** @brief bájtból megabájt a kiíráshoz */
+static double megabytes(long long bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+/** @brief a make_view mutatói, ezt minden ip_ függvény lefoglalja a kép mellé */
+static long long view_bytes(PPM_Image *shape) {
+    return image_bytes(shape->size_x, shape->size_y, 0);
+}
+
+/** @brief az expand_rgb által az egycsatornás kép mellé lefoglalt RGB kép, utána a kép RGB */
+static long long expand_bytes(PPM_Image *shape) {
+    if (shape->channels == 3)
+        return 0;
+    shape->channels = 3;
+    return image_bytes(shape->size_x, shape->size_y, 3);
+}
+
+/** @brief a helyben dolgozó lépések (pl. mirror) memóriaigénye */
+static long long memory_view(PPM_Image *shape, CmdOptions *options, bool low) {
+    (void) options;
+    (void) low;
+    return view_bytes(shape);
+}
+
+/** @brief az RGB képen helyben dolgozó lépések (pointops, 3d) memóriaigénye */
+static long long memory_rgb_view(PPM_Image *shape, CmdOptions *options, bool low) {
+    (void) options;
+    (void) low;
+    return expand_bytes(shape) + view_bytes(shape);
+}
+
+/** @brief az átméretezés memóriaigénye: az új kép, a köztes tároló és a súlyok */
+static long long memory_resize(PPM_Image *shape, CmdOptions *options, bool low) {
+    (void) low;
+    int scale = options->preview_scale;
+    int new_x = (options->resize_x + scale - 1) / scale;
+    int new_y = (options->resize_y + scale - 1) / scale;
+    if (new_x == shape->size_x && new_y == shape->size_y)
+        return 0;
+    long long bytes = image_bytes(new_x, new_y, shape->channels) + resample_bytes(shape->size_x, shape->size_y, new_x, new_y, shape->channels, options->resize_filter);
+    shape->size_x = new_x;
+    shape->size_y = new_y;
+    return bytes;
+}
+
+/** @brief a transzponálás memóriaigénye: az új kép, négyzetes képnél helyben semmi */
+static long long memory_transpose(PPM_Image *shape, CmdOptions *options, bool low) {
+    (void) options;
+    int size_x = shape->size_x;
+    shape->size_x = shape->size_y;
+    shape->size_y = size_x;
+    if (low && shape->size_x == shape->size_y)
+        return 0;
+    return image_bytes(shape->size_x, shape->size_y, shape->channels);
+}
+
+/** @brief a forgatás memóriaigénye: az új kép és 90, 270 foknál a sorok mutatói, 180 fokkal vagy négyzetes képnél helyben semmi */
+static long long memory_rotate(PPM_Image *shape, CmdOptions *options, bool low) {
+    if (low && (options->rotate == 180 || shape->size_x == shape->size_y))
+        return 0;
+    if (options->rotate == 180)
+        return image_bytes(shape->size_x, shape->size_y, shape->channels);
+    long long bytes = (long long) shape->size_y * sizeof(unsigned char **);
+    int size_x = shape->size_x;
+    shape->size_x = shape->size_y;
+    shape->size_y = size_x;
+    return bytes + image_bytes(shape->size_x, shape->size_y, shape->channels);
+}
+
+/** @brief az RGB shift memóriaigénye: függőleges eltolásnál a kép másolata */
+static long long memory_rgbshift(PPM_Image *shape, CmdOptions *options, bool low) {
+    (void) low;
+    RGB_SHIFT shift = options->rgbshft;
+    long long bytes = expand_bytes(shape) + view_bytes(shape);
+    if (shift.red_y != 0 || shift.green_y != 0 || shift.blue_y != 0)
+        bytes += image_bytes(shape->size_x, shape->size_y, 3);
+    return bytes;
+}
+
+/** @brief a pixelsort memóriaigénye */
+static long long memory_pixelsort(PPM_Image *shape, CmdOptions *options, bool low) {
+    long long bytes = expand_bytes(shape) + view_bytes(shape);
+    return bytes + pixelsort_bytes(shape->size_x, shape->size_y, options->ps_preset == edge, options->ps_angle, low);
+}
+
+/** @brief az elmosás memóriaigénye, low esetén sávonként */
+static long long memory_blur(PPM_Image *shape, CmdOptions *options, bool low) {
+    return view_bytes(shape) + convolve_bytes(shape->size_x, shape->size_y, options->blur, shape->channels, low);
+}
+
+/** @brief a medián szűrő memóriaigénye */
+static long long memory_median(PPM_Image *shape, CmdOptions *options, bool low) {
+    (void) low;
+    return view_bytes(shape) + median_bytes(shape->size_x, shape->size_y, shape->channels, options->median);
+}
+
+/** @brief az élesítés memóriaigénye, low esetén sávonként */
+static long long memory_sharpen(PPM_Image *shape, CmdOptions *options, bool low) {
+    return view_bytes(shape) + convolve_bytes(shape->size_x, shape->size_y, options->sharpen, shape->channels, low);
+}
+
+/** @brief a tönkretétel memóriaigénye: a benne futó RGB shift másolata */
+static long long memory_corrupt(PPM_Image *shape, CmdOptions *options, bool low) {
+    (void) options;
+    (void) low;
+    return expand_bytes(shape) + view_bytes(shape) + image_bytes(shape->size_x, shape->size_y, 3);
+}
+
+/** @brief a szürkeárnyalatossá alakítás memóriaigénye: az egycsatornás kép */
+static long long memory_grayscale(PPM_Image *shape, CmdOptions *options, bool low) {
+    (void) options;
+    (void) low;
+    if (shape->channels == 1)
+        return 0;
+    shape->channels = 1;
+    return image_bytes(shape->size_x, shape->size_y, 1);
+}
+
+/** @brief az élkeresés memóriaigénye, utána a kép egycsatornás */
+static long long memory_edge(PPM_Image *shape, CmdOptions *options, bool low) {
+    (void) options;
+    long long bytes = detect_edges_bytes(shape->size_x, shape->size_y, shape->channels, low);
+    shape->channels = 1;
+    return bytes;
+}
+
+/**
+ * @brief hozzáad egy lépést a listához
+ * @param[in] stages[] a lépések listája
+ * @param[in] *count a lépések száma, eggyel növeljük
+ * @param[in] *name a lépés neve
+ * @param[in] random true ha a lépés a véletlenszám-generátort használja
+ * @param[in] run a lépést végrehajtó függvény
+ * @param[out] params a lépés paramétereinek helye, ide kell beírni őket
+ */
+static char *add_stage(Stage stages[], int *count, const char *name, bool random, void (*run)(PPM_Image *, CmdOptions *)) {
+    Stage *stage = &stages[(*count)++];
+    stage->name = name;
+    stage->random = random;
+    stage->run = run;
+    stage->params[0] = '\0';
+    stage->halo = 0;
+    stage->whole = false;
+    stage->rows = false;
+    stage->memory = memory_view;
+    return stage->params;
+}
+
+/**
+ * @brief összeállítja a beállításoknak megfelelő lépések listáját, a végrehajtás sorrendjében
+ * @param[in] *options a beállítások
+ * @param[in] stages[] ide kerülnek a lépések (legalább MAX_STAGES méretű)
+ * @param[out] count a lépések száma
+ */
+static int build_stages(CmdOptions *options, Stage stages[]) {
+    int count = 0;
+    char *params;
+
+    /* a forgatás az első lépés, így a többi lépés méretei (--resize, --roi) már az elforgatott képre vonatkoznak */
+    if (options->transpose) {
+        add_stage(stages, &count, "transpose", false, stage_transpose);
+        stages[count - 1].whole = true;
+        stages[count - 1].memory = memory_transpose;
+    }
+    if (options->rotate != 0) {
+        params = add_stage(stages, &count, "rotate", false, stage_rotate);
+        snprintf(params, 128, "%d", options->rotate);
+        stages[count - 1].whole = true;
+        stages[count - 1].memory = memory_rotate;
+    }
+    /* utána az átméretezés, így a drága lépések már a kisebb képen futnak */
+    if (options->resize_x > 0) {
+        params = add_stage(stages, &count, "resize", false, stage_resize);
+        snprintf(params, 128, "%dx%d %d %d", options->resize_x, options->resize_y, options->resize_filter, options->preview_scale);
+        stages[count - 1].whole = true;
+        stages[count - 1].memory = memory_resize;
+    }
+    /* a zajszűrés a színek és a pixelsort előtt fut, így az élkeresés nem a zajon talál éleket */
+    if (options->median > 0) {
+        params = add_stage(stages, &count, "median", false, stage_median);
+        stages[count - 1].halo = options->median;
+        stages[count - 1].memory = memory_median;
+        snprintf(params, 128, "%d", options->median);
+    }
+    if (options->lightness != 0 || options->contrast != 0 || options->hue_shift != 0 || options->invert || options->sinecolor_shft != 0) {
+        params = add_stage(stages, &count, "pointops", false, stage_pointops);
+        stages[count - 1].rows = true;
+        stages[count - 1].memory = memory_rgb_view;
+        snprintf(params, 128, "%d %d %d %d %.17g", options->lightness, options->contrast, options->hue_shift, options->invert, options->sinecolor_shft);
+    }
+    if (options->mirror != none) {
+        params = add_stage(stages, &count, "mirror", false, stage_mirror);
+        /* a függőleges tengelyre tükrözés soronként történik */
+        stages[count - 1].rows = options->mirror == vertical;
+        snprintf(params, 128, "%d", options->mirror);
+    }
+    RGB_SHIFT shift = options->rgbshft;
+    if (shift.red_x != 0 || shift.red_y != 0 || shift.green_x != 0 || shift.green_y != 0 || shift.blue_x != 0 || shift.blue_y != 0) {
+        params = add_stage(stages, &count, "rgbshift", false, stage_rgbshift);
+        stages[count - 1].memory = memory_rgbshift;
+        snprintf(params, 128, "%d %d %d %d %d %d", shift.red_x, shift.red_y, shift.green_x, shift.green_y, shift.blue_x, shift.blue_y);
+    }
+    if (options->ps_preset != psnone) {
+        /* az edges kivételével minden preset véletlenszerű küszöböt vagy környezetet választ */
+        params = add_stage(stages, &count, "pixelsort", options->ps_preset != edge, stage_pixelsort);
+        stages[count - 1].memory = memory_pixelsort;
+        snprintf(params, 128, "%d %d", options->ps_preset, options->adaptive);
+        if (options->ps_angle != 0) /* vízszintes rendezésnél a kulcs (és így a --seed-del kapott eredmény) nem változik */
+            snprintf(params + strlen(params), 128 - strlen(params), " %.17g", options->ps_angle);
+    }
+    if (options->blur > 0) {
+        params = add_stage(stages, &count, "blur", false, stage_blur);
+        stages[count - 1].halo = options->blur;
+        stages[count - 1].memory = memory_blur;
+        snprintf(params, 128, "%d", options->blur);
+    }
+    if (options->sharpen > 0) {
+        params = add_stage(stages, &count, "sharpen", false, stage_sharpen);
+        stages[count - 1].halo = options->sharpen;
+        stages[count - 1].memory = memory_sharpen;
+        snprintf(params, 128, "%d", options->sharpen);
+    }
+    if (options->corrupt) {
+        add_stage(stages, &count, "corrupt", true, stage_corrupt);
+        stages[count - 1].memory = memory_corrupt;
+    }
+    if (options->grayscale) {
+        add_stage(stages, &count, "grayscale", false, stage_grayscale);
+        stages[count - 1].memory = memory_grayscale;
+    }
+    if (options->a3d) {
+        add_stage(stages, &count, "3d", false, stage_3d);
+        stages[count - 1].rows = true;
+        stages[count - 1].memory = memory_rgb_view;
+    }
+    if (options->edge) {
+        add_stage(stages, &count, "edge", false, stage_edge);
+        stages[count - 1].memory = memory_edge;
+        /* elmosás, függőleges élkeresés, elmosás: mindegyik 3x3-as */
+        stages[count - 1].halo = 3;
+    }
+    return count;
+}
+
+/**
+ * @brief a lépés gyorsítótár-kulcsa az előző lépés kulcsából
+ * @param[in] key az előző lépés kulcsa (az első lépésnél a bemeneti fájl hash-e)
+ * @param[in] *stage a lépés
+ * @param[out] key a lépés utáni állapot kulcsa
+ */
+static uint64_t stage_key(uint64_t key, Stage *stage) {
+    key = cache_hash(key, stage->name, strlen(stage->name) + 1);
+    return cache_hash(key, stage->params, strlen(stage->params) + 1);
+}
+
+/**
+ * @brief végrehajt egy lépést
+ * @param[in] *image a módosítandó kép
+ * @param[in] *options a beállítások
+ * @param[in] *stage a lépés
+ *
+ * Ha a kezdőérték meg van adva, a véletlenszerű lépések előtt a kezdőértékből és a lépés paramétereiből újra beállítjuk a véletlenszám-generátort. Így egy lépés eredménye nem függ attól, hogy a korábbi lépéseket végrehajtottuk, vagy a gyorsítótárból olvastuk be.
+ * Ha a --roi vagy a --mask meg van adva, a lépés csak a terület (és a szükséges környezete) másolatán fut, és csak a terület kerül vissza a képbe.
+ * @see region_extract
+ */
+static void apply_stage(PPM_Image *image, CmdOptions *options, Stage *stage) {
+    if (stage->random && options->seed_given)
+        srand((unsigned int) stage_key(options->seed, stage));
+
+    if (!options->region_given || stage->whole) {
+        stage->run(image, options);
+        return;
+    }
+
+    if (options->mask.image_data != NULL && (options->mask.size_x != image->size_x || options->mask.size_y != image->size_y)) {
+        printf("a maszk mérete (%dx%d) nem egyezik a képével (%dx%d)\n", options->mask.size_x, options->mask.size_y, image->size_x, image->size_y);
+        exit(1);
+    }
+    Region region = region_clip(options->region, image->size_x, image->size_y);
+    if (region.size_x == 0 || region.size_y == 0)
+        return;
+
+    PPM_Image part = region_extract(image, region, stage->halo);
+    if (part.image_data == NULL) {
+        perror("error allocating image");
+        abort();
+    }
+    stage->run(&part, options);
+    region_commit(image, &part, region, stage->halo);
+    freeimage(part.image_data, part.size_x, part.size_y);
+}
+
+/**
+ * @brief végrehajt egy lépést, és --stats esetén kiírja a memóriahasználatát és a párhuzamos feladatok számát, --trace esetén rögzíti az idővonalon
+ * @param[in] *image a módosítandó kép
+ * @param[in] *options a beállítások
+ * @param[in] *stage a lépés
+ * @see apply_stage
+ */
+static void run_stage(PPM_Image *image, CmdOptions *options, Stage *stage) {
+    ParallelStats before, after;
+    parallel_stats(&before);
+    mem_window_begin();
+    long long began = trace_begin();
+    apply_stage(image, options, stage);
+    trace_end(stage->name, began);
+    if (options->stats) {
+        parallel_stats(&after);
+        printf("memória, %s: csúcs %.1f MB, utána %.1f MB\n", stage->name, megabytes(mem_window_peak()), megabytes(mem_current()));
+        printf("ütemező, %s: %lld feladat, ebből %lld lopott\n", stage->name, after.tasks - before.tasks, after.steals - before.steals);
+    }
+}
+
+/**
+ * @brief előre megbecsüli a feldolgozás memóriaigényét a --max-memory korláthoz
+ * @param[in] inn_fname[] a bemeneti fájl
+ * @param[in] *options a beállítások
+ * @param[out] fits false ha a feladat a kevesebb memóriát használó változatokkal sem fér bele a korlátba, ekkor ki is írjuk, melyik lépés miatt
+ *
+ * A lépések egymás után futnak, így a csúcs a lépésenkénti csúcsok maximuma. Egy lépés csúcsa a már lefoglalt memória (pl. a maszk), a be- és kiírás pufferei, a kép a lépés előtti méretében és a lépés saját foglalásai (Stage.memory).
+ * Ha a gyorsabb változat nem fér bele a korlátba, de van kevesebb memóriát használó (helyben forgatás, sávonkénti konvolúció), akkor azzal számolunk. A lépés futás közben magától is ezt választja, mert a gyorsabbnak kellő foglalás a korlát miatt nem sikerül.
+ * A becslés inkább felülről közelít: például a --roi területének másolatát a teljes kép méretével számoljuk. --sequence esetén a képkockák mérete előre nem ismert, ott csak a futás közbeni korlát él.
+ */
+static bool plan_memory(char inn_fname[], CmdOptions *options) {
+    PPM_Image shape;
+    /* ha a fejléc sem olvasható, a beolvasás írja ki a hibát */
+    if (!Image_ReadInfo(inn_fname, options->preview_scale, &shape))
+        return true;
+
+    long long limit = options->max_memory;
+    long long fixed = mem_current() + IO_RESERVE_BYTES + 32LL * shape.size_x * options->preview_scale;
+    long long need = fixed + image_bytes(shape.size_x, shape.size_y, shape.channels);
+    if (need > limit) {
+        printf("a feladat nem fér el a memóriakorlátban (%.1f MB): már a beolvasáshoz %.1f MB kell\n", megabytes(limit), megabytes(need));
+        return false;
+    }
+
+    Stage stages[MAX_STAGES];
+    int count = build_stages(options, stages);
+    for (int i = 0; i < count; i++) {
+        long long base = fixed + image_bytes(shape.size_x, shape.size_y, shape.channels);
+        if (options->region_given && !stages[i].whole)
+            base += image_bytes(shape.size_x, shape.size_y, shape.channels);
+
+        PPM_Image after = shape;
+        need = base + stages[i].memory(&after, options, false);
+        if (need > limit) {
+            PPM_Image low_after = shape;
+            long long low = base + stages[i].memory(&low_after, options, true);
+            if (low < need) {
+                printf("memória, %s: a kevesebb memóriát használó változat fut (%.1f MB helyett %.1f MB)\n", stages[i].name, megabytes(need), megabytes(low));
+                need = low;
+                after = low_after;
+            }
+        }
+        if (options->stats)
+            printf("memóriaterv, %s: becsült csúcs %.1f MB\n", stages[i].name, megabytes(need));
+        if (need > limit) {
+            printf("a feladat nem fér el a memóriakorlátban (%.1f MB): a(z) %s lépéshez becslés szerint %.1f MB kell\n", megabytes(limit), stages[i].name, megabytes(need));
+            return false;
+        }
+        shape = after;
+    }
+    return true;
+}
+
+/**
+ * @brief beolvassa a maszkot egycsatornás képként
+ * @param[in] fname[] a maszk fájl
+ * @param[in] shrink a kicsinyítés mértéke, ugyanaz mint a képé
+ * @param[out] mask a maszk, pixelenként a három szín átlagával
+ *
+ * A grayscale súlyozása a fehér pixelekből 254-et csinálna, ezért itt a színek átlagát használjuk, így a fehér rész teljesen érvényesül.
+ */
+static PPM_Image load_mask(char fname[], int shrink) {
+    PPM_Image mask = Image_ParserScaled(fname, shrink);
+    if (mask.channels == 1)
+        return mask;
+    unsigned char ***gray = allocateimage_channels(mask.size_x, mask.size_y, 1);
+    if (gray == NULL) {
+        perror("error allocating image");
+        abort();
+    }
+    for (int i = 0; i < mask.size_y; i++) {
+        for (int j = 0; j < mask.size_x; j++) {
+            unsigned char *pixel = mask.image_data[i][j];
+            gray[i][j][0] = (pixel[0] + pixel[1] + pixel[2]) / 3;
+        }
+    }
+    freeimage(mask.image_data, mask.size_x, mask.size_y);
+    mask.image_data = gray;
+    mask.channels = 1;
+    return mask;
+}
+
+/**
+ * @brief végrehajtja a beállított műveleteket egy képen
+ * @param[in] *image a módosítandó kép
+ * @param[in] *data a CmdOptions
+ *
+ * Képsorozatok képkockáinál ezt használjuk. Ha a véletlenszerű paramétereknek minden képkockán azonosnak kell lenniük, akkor minden kép előtt újra beállítjuk a véletlenszám-generátor kezdőértékét.
+ * @see PPM_Sequence
+ */
+static void process_image(PPM_Image *image, void *data) {
+    CmdOptions *options = (CmdOptions *) data;
+
+    if (options->stable_random)
+        srand(options->seed);
+
+    Stage stages[MAX_STAGES];
+    int count = build_stages(options, stages);
+    for (int i = 0; i < count; i++)
+        run_stage(image, options, &stages[i]);
+}
+
+/**
+ * @brief beolvassa és feldolgozza a képet, a gyorsítótár használatával ha az be van kapcsolva
+ * @param[in] inn_fname[] a bemeneti fájl
+ * @param[in] *options a beállítások
+ * @param[out] image a feldolgozott kép
+ *
+ * A bemeneti fájl tartalmának hash-éből és a lépések paramétereiből lépésenként kiszámoljuk a kulcsokat, majd a leghosszabb olyan előtagtól folytatjuk, aminek az eredménye megvan a gyorsítótárban. Minden kiszámolt lépés eredményét elmentjük.
+ * A véletlenszerű lépések eredménye (és minden utána következő lépésé) csak akkor kerülhet a gyorsítótárba, ha a kezdőérték meg van adva, különben minden futás más eredményt ad. Ekkor a kezdőérték is a kulcs része, így egy másik --seed nem kapja meg a korábbi eredményt.
+ * @see run_stage
+ */
+static PPM_Image process_file(char inn_fname[], CmdOptions *options) {
+    Stage stages[MAX_STAGES];
+    int count = build_stages(options, stages);
+    uint64_t keys[MAX_STAGES + 1];
+    int cacheable = 0;
+    int first = 0;
+    PPM_Image image;
+
+    if (options->cache_dir != NULL) {
+        keys[0] = cache_hash_file(inn_fname);
+        if (options->preview_scale > 1)
+            keys[0] = cache_hash(keys[0], &options->preview_scale, sizeof(options->preview_scale));
+        if (options->region_given) {
+            Region *region = &options->region;
+            char roi[64];
+            snprintf(roi, sizeof(roi), "%d %d %d %d", region->x, region->y, region->size_x, region->size_y);
+            keys[0] = cache_hash(keys[0], roi, strlen(roi) + 1);
+            keys[0] = cache_hash(keys[0], &options->mask_hash, sizeof(options->mask_hash));
+        }
+        while (cacheable < count && (!stages[cacheable].random || options->seed_given)) {
+            keys[cacheable + 1] = stage_key(keys[cacheable], &stages[cacheable]);
+            /* a véletlenszerű lépés eredménye a kezdőértéktől is függ, a későbbi lépések kulcsa ebből öröklődik */
+            if (stages[cacheable].random)
+                keys[cacheable + 1] = cache_hash(keys[cacheable + 1], &options->seed, sizeof(options->seed));
+            cacheable++;
+        }
+        for (first = cacheable; first > 0; first--) {
+            if (cache_load(options->cache_dir, keys[first], &image))
+                break;
+        }
+        if (first > 0)
+            printf("%d lépés a gyorsítótárból\n", first);
+    }
+
+    if (first == 0)
+        image = Image_ParserScaled(inn_fname, options->preview_scale);
+
+    for (int i = first; i < count; i++) {
+        run_stage(&image, options, &stages[i]);
+        if (options->cache_dir != NULL && i < cacheable)
+            cache_store(options->cache_dir, keys[i + 1], &image);
+    }
+
+    if (options->cache_dir != NULL)
+        cache_evict(options->cache_dir, options->cache_size);
+    return image;
+}
+
+/**
+ * @brief a lépések felosztása az átfedéses feldolgozáshoz
+ * @see process_streamed
+ */
+typedef struct StreamPlan {
+    CmdOptions *options; /**< a beállítások */
+    Stage stages[MAX_STAGES]; /**< a lépések */
+    int count; /**< a lépések száma */
+    int prefix; /**< az első ennyi lépés soronként független, ezek a beolvasással átfedésben futnak */
+    int suffix; /**< az ettől kezdődő lépések soronként függetlenek, ezek a kiírással átfedésben futnak */
+    bool suffix_done; /**< az utolsó lépéseket már a teljes képen végrehajtottuk */
+    long long peaks[MAX_STAGES]; /**< --stats esetén a sávonként futó lépések memóriacsúcsa */
+    int blocks[MAX_STAGES]; /**< hány sávon futott a lépés */
+} StreamPlan;
+
+/**
+ * @brief egy soronkénti lépés egy sávon
+ * @param[in] *block a sáv
+ * @param[in] *plan a lépések felosztása
+ * @param[in] *stage a lépés
+ *
+ * A run_stage sávonkénti megfelelője: --trace esetén minden sáv egy külön, a lépés nevével ellátott esemény az idővonalon, --stats esetén pedig a sávok memóriacsúcsát gyűjtjük, amit a process_streamed a végén lépésenként egyszer ír ki.
+ * A sávok közben a többi szál más lépéseken dolgozhat, ezért a mem_window_begin helyett a szál saját foglalásait mérjük, a sáv előtti teljes foglaláshoz képest.
+ * @see run_stage
+ */
+static void run_block_stage(PPM_Image *block, StreamPlan *plan, Stage *stage) {
+    int index = (int) (stage - plan->stages);
+    long long base = mem_current();
+    mem_thread_window_begin();
+    long long began = trace_begin();
+    stage->run(block, plan->options);
+    trace_end(stage->name, began);
+    long long peak = base + mem_thread_window_peak();
+    if (peak > plan->peaks[index])
+        plan->peaks[index] = peak;
+    plan->blocks[index]++;
+}
+
+/** @brief a beolvasással átfedésben futó lépések egy sávon */
+static void stream_read_rows(PPM_Image *block, void *data) {
+    StreamPlan *plan = (StreamPlan *) data;
+    for (int i = 0; i < plan->prefix; i++)
+        run_block_stage(block, plan, &plan->stages[i]);
+}
+
+/**
+ * @brief a teljes képet igénylő lépések
+ *
+ * Ha utánuk a kép már egycsatornás (pl. élkeresés), a soronkénti lépések RGB-re alakítanák, amit egy sávon nem lehet, ezért ekkor a maradék lépések is itt futnak le.
+ */
+static void stream_whole(PPM_Image *image, void *data) {
+    StreamPlan *plan = (StreamPlan *) data;
+    for (int i = plan->prefix; i < plan->suffix; i++)
+        run_stage(image, plan->options, &plan->stages[i]);
+    if (image->channels != 3) {
+        for (int i = plan->suffix; i < plan->count; i++)
+            run_stage(image, plan->options, &plan->stages[i]);
+        plan->suffix_done = true;
+    }
+}
+
+/** @brief a kiírással átfedésben futó lépések egy sávon */
+static void stream_write_rows(PPM_Image *block, void *data) {
+    StreamPlan *plan = (StreamPlan *) data;
+    if (plan->suffix_done)
+        return;
+    for (int i = plan->suffix; i < plan->count; i++)
+        run_block_stage(block, plan, &plan->stages[i]);
+}
+
+/**
+ * @brief beolvassa, feldolgozza és kiírja a képet úgy, hogy a beolvasás és a kiírás átfedésben legyen a feldolgozással
+ * @param[in] inn_fname[] a bemeneti fájl
+ * @param[in] outt_fname[] a kimeneti fájl
+ * @param[in] *options a beállítások
+ * @param[out] image a feldolgozott, már kiírt kép
+ *
+ * Az első teljes képet igénylő lépésig minden lépés a beolvasással párhuzamosan, sávonként fut, az utolsó ilyen lépés után pedig a kiírással párhuzamosan. Ha egyik lépés sem igényli a teljes képet, akkor a beolvasás, a feldolgozás és a kiírás egyszerre halad.
+ * A gyorsítótárral, a --roi-val és a --mask-kal nem használjuk, mert ezek a lépéseket a teljes képen, egyenként hajtják végre.
+ * @see pipeline_run
+ */
+static PPM_Image process_streamed(char inn_fname[], char outt_fname[], CmdOptions *options) {
+    StreamPlan plan;
+    plan.options = options;
+    plan.count = build_stages(options, plan.stages);
+    plan.prefix = 0;
+    while (plan.prefix < plan.count && plan.stages[plan.prefix].rows)
+        plan.prefix++;
+    plan.suffix = plan.count;
+    while (plan.suffix > plan.prefix && plan.stages[plan.suffix - 1].rows)
+        plan.suffix--;
+    plan.suffix_done = false;
+    memset(plan.peaks, 0, sizeof(plan.peaks));
+    memset(plan.blocks, 0, sizeof(plan.blocks));
+
+    PipelineStages stages = {stream_read_rows, stream_whole, stream_write_rows, &plan};
+    if (plan.prefix == plan.count)
+        stages.whole = NULL;
+    PPM_Image image = pipeline_run(inn_fname, outt_fname, options->preview_scale, options->format, &stages);
+
+    /* a teljes képen futó lépésekről a run_stage már beszámolt, a sávonkéntiekről csak most, összesítve */
+    if (options->stats) {
+        for (int i = 0; i < plan.count; i++) {
+            if (plan.blocks[i] > 0)
+                printf("memória, %s: csúcs %.1f MB, %d sávon\n", plan.stages[i].name, megabytes(plan.peaks[i]), plan.blocks[i]);
+        }
+    }
+    return image;
+}
+
 int main (int argc, char *argv[]) {
 
-    typedef struct CmdOptions {
-        int lightness;
-        int contrast;
-        bool grayscale;
-        int hue_shift;
-        double sinecolor_shft;
-        bool invert;
-        mirror_type mirror;
-        RGB_SHIFT rgbshft;
-        pixelsort_preset ps_preset;
-        int blur;
-        int sharpen;
-        bool edge;
-        bool corrupt;
-        bool a3d;
-    } CmdOptions;
-
-    CmdOptions options = {0, 0, false, 0, 0, false, none, {0,0, 0,0, 0,0}, psnone, 0, 0, false, false, false};
-
-    char *inn_fname;
-    char *outt_fname;
+    CmdOptions options = {0, 0, false, 0, 0, false, none, {0,0, 0,0, 0,0}, psnone, 0, 0, false, false, false, false, false, 0, false, NULL, 1024LL*1024*1024, false, {0, 0, 0, 0, NULL}, {NULL, 0, 0, 0, "", 0}, 0, 1, 0, 0, lanczos_filter, false, false, false, false, format_auto, 0, false, 0, 0, 0};
+
+    time_t seconds;
+    seconds = time(NULL);
+    options.seed = seconds;
+
+    char *inn_fname = NULL;
+    char *outt_fname = NULL;
+    char *mask_fname = NULL;
 
     int c;
 
@@ -59,7 +972,31 @@ int main (int argc, char *argv[]) {
             {"sharpen",  required_argument,  0,  10 },
             {"edge-detect",  no_argument,  0,  11 },
             {"corrupt",      no_argument,        0,   12  },
-            {"3d",      no_argument,        0,   13  }
+            {"3d",      no_argument,        0,   13  },
+            {"sequence",      no_argument,        0,   14  },
+            {"seed",  required_argument,  0,  15 },
+            {"stable-random",      no_argument,        0,   16  },
+            {"cache",  required_argument,  0,  17 },
+            {"cache-size",  required_argument,  0,  18 },
+            {"roi",  required_argument,  0,  19 },
+            {"mask",  required_argument,  0,  20 },
+            {"preview-scale",  required_argument,  0,  21 },
+            {"resize",  required_argument,  0,  22 },
+            {"resize-filter",  required_argument,  0,  23 },
+            {"adaptive",      no_argument,        0,   24  },
+            {"stats-only",      no_argument,        0,   25  },
+            {"verify-kernels",      no_argument,        0,   26  },
+            {"isa",  required_argument,  0,  27 },
+            {"stats",      no_argument,        0,   28  },
+            {"format",  required_argument,  0,  29 },
+            {"pixelsort-direction",  required_argument,  0,  30 },
+            {"rotate",  required_argument,  0,  31 },
+            {"transpose",      no_argument,        0,   32  },
+            {"max-memory",  required_argument,  0,  33 },
+            {"threads",  required_argument,  0,  34 },
+            {"trace",  required_argument,  0,  35 },
+            {"median",  required_argument,  0,  36 },
+            {0,         0,                 0,  0 }
         };
 
         c = getopt_long(argc, argv, "i:o:h", long_options, &option_index);
@@ -140,6 +1077,132 @@ int main (int argc, char *argv[]) {
             case 13:
                options.a3d = true;
                break;
+            case 14:
+               options.sequence = true;
+               break;
+            case 15:
+               options.seed = strtoul(optarg, NULL, 10);
+               options.seed_given = true;
+               break;
+            case 16:
+               options.stable_random = true;
+               break;
+            case 17:
+               options.cache_dir = strdup(optarg);
+               break;
+            case 18:
+               options.cache_size = atoll(optarg)*1024*1024;
+               break;
+            case 19:
+                if (sscanf(optarg, "%d,%d,%d,%d", &options.region.x, &options.region.y, &options.region.size_x, &options.region.size_y) != 4) {
+                    printf("hibás terület: %s\n", optarg);
+                    return 1;
+                }
+                options.region_given = true;
+               break;
+            case 20:
+               mask_fname = strdup(optarg);
+               break;
+            case 21:
+                if (sscanf(optarg, "1/%d", &options.preview_scale) != 1 || (options.preview_scale != 1 && options.preview_scale != 2 && options.preview_scale != 4 && options.preview_scale != 8)) {
+                    printf("hibás előnézeti méret: %s (1/2, 1/4 vagy 1/8 lehet)\n", optarg);
+                    return 1;
+                }
+               break;
+            case 22:
+                if (sscanf(optarg, "%dx%d", &options.resize_x, &options.resize_y) != 2 || options.resize_x <= 0 || options.resize_y <= 0) {
+                    printf("hibás méret: %s\n", optarg);
+                    return 1;
+                }
+               break;
+            case 23:
+                if (strcmp(optarg, "box") == 0)
+                    options.resize_filter = box_filter;
+                else if (strcmp(optarg, "bilinear") == 0)
+                    options.resize_filter = bilinear_filter;
+                else if (strcmp(optarg, "lanczos") == 0)
+                    options.resize_filter = lanczos_filter;
+               break;
+            case 24:
+               options.adaptive = true;
+               break;
+            case 25:
+               options.stats_only = true;
+               break;
+            case 26:
+               options.verify = true;
+               break;
+            case 27: {
+               isa_level level;
+               if (!isa_parse(optarg, &level)) {
+                   printf("ismeretlen utasításkészlet: %s\n", optarg);
+                   return 1;
+               }
+               if (!isa_supported(level)) {
+                   printf("a processzor nem támogatja: %s\n", optarg);
+                   return 1;
+               }
+               isa_select(level);
+               break;
+            }
+            case 28:
+               options.stats = true;
+               break;
+            case 29:
+               if (!format_parse(optarg, &options.format)) {
+                   printf("ismeretlen formátum: %s\n", optarg);
+                   return 1;
+               }
+               break;
+            case 30:
+               if (strcmp(optarg, "horizontal") == 0)
+                   options.ps_angle = 0;
+               else if (strcmp(optarg, "vertical") == 0)
+                   options.ps_angle = 90;
+               else if (sscanf(optarg, "angle=%lf", &options.ps_angle) != 1 || !isfinite(options.ps_angle)) {
+                   printf("ismeretlen pixelsort irány: %s\n", optarg);
+                   return 1;
+               }
+               break;
+            case 31:
+               options.rotate = atoi(optarg);
+               if (options.rotate != 90 && options.rotate != 180 && options.rotate != 270) {
+                   printf("a forgatás szöge 90, 180 vagy 270 lehet: %s\n", optarg);
+                   return 1;
+               }
+               break;
+            case 32:
+               options.transpose = true;
+               break;
+            case 33:
+               options.max_memory = atoll(optarg)*1024*1024;
+               if (options.max_memory <= 0) {
+                   printf("hibás memóriakorlát: %s\n", optarg);
+                   return 1;
+               }
+               break;
+            case 34: {
+               int threads = atoi(optarg);
+               if (threads < 1) {
+                   printf("hibás szálszám: %s\n", optarg);
+                   return 1;
+               }
+               parallel_set_threads(threads);
+               break;
+            }
+            case 35:
+               if (!trace_open(optarg)) {
+                   perror("error writing trace");
+                   return 1;
+               }
+               break;
+            case 36:
+               options.median = atoi(optarg);
+               if (options.median < 1 || options.median > MEDIAN_MAX_RADIUS) {
+                   printf("a medián szűrő sugara 1 és %d között lehet: %s\n", MEDIAN_MAX_RADIUS, optarg);
+                   return 1;
+               }
+               break;
             case 'i':
                 inn_fname = strdup(optarg);
                 break;
@@ -156,14 +1219,37 @@ int main (int argc, char *argv[]) {
                 printf("--invert\t\t\ta kép negatívvá tétele\n");
                 printf("--sinecolor-shift frekvencia\ta kép színeit a szinusz függvény alapján torzítja\n");
                 printf("--mirror típus\t\t\ta kép tükrözése, típus: diagonal,\n\t\t\t\thorizontal, vertical irányokban\n");
+                printf("--rotate fok\t\t\ta kép forgatása az óramutató járásával\n\t\t\t\tmegegyezően, fok: 90, 180 vagy 270; minden más\n\t\t\t\tlépés előtt fut\n");
+                printf("--transpose\t\t\ta kép tükrözése a bal felső - jobb alsó átlóra\n\t\t\t\t(a sorokból oszlopok lesznek), a --rotate előtt\n");
                 printf("--rgb-shift ± rvalue, ± gvalue, ± bvalue\n\t\t\t\tRGB shift alkalmazása a képen, a színek\n\t\t\t\tértékeit a megadott értékekkel csúsztatja\n\t\t\t\tel a megfelelő irányba\n");
                 printf("--pixelsort preset\t\tpixelsort algoritmus végrehajtása a képen a\n\t\t\t\tmegadott preset alapján\n\t\t\t\t preset:\n\t\t\t\t  edges: megkeresi a kép objektumainak a szélét\n\t\t\t\t  és ezek között rendez\n\t\t\t\t  all-random: teljesen véletlenszerű\n\t\t\t\t  beállítások\n\t\t\t\t  landscape: tájképekhez és nagy tárgyakhoz\n\t\t\t\t  macro: részletes képekhez használható\n\t\t\t\t  fewcolors: kevés színt tartalmazó képekhez\n\t\t\t\t  dark: sötét területek kiemelése\n");
+                printf("--pixelsort-direction irány\ta pixelsort iránya: horizontal (soronként, ez az\n\t\t\t\talapértelmezett), vertical (oszloponként, fentről\n\t\t\t\tlefelé) vagy angle=fok, ferde egyenesek mentén,\n\t\t\t\taz óramutató járásával megegyezően a vízszintestől\n");
                 printf("--blur érték\t\t\ta kép elmosása a megadott értékkel arányosan, kis\n\t\t\t\térték kis elmosás, nagy érték nagy elmosás\n");
+                printf("--median sugár\t\t\tzajszűrés medián szűrővel, minden pixel a\n\t\t\t\t(2 * sugár + 1)^2 méretű környezete mediánját\n\t\t\t\tkapja (sugár: 1-%d); az éleket megtartja, ezért\n\t\t\t\taz élkeresés és a pixelsort előtt fut\n", MEDIAN_MAX_RADIUS);
                 printf("--sharpen érték\t\t\ta kép élesebbé tétele a megadott értékkel\n\t\t\t\tarányosan, kis érték kis élesítés, nagy érték\n\t\t\t\tnagy élesítés\n");
                 printf("--corrupt\t\t\tteljesen véletlenszerűen tönkreteszi a képet\n");
                 printf("--grayscale\t\t\ta kép fekete-fehérre változtatása\n");
                 printf("--3d\t\t\t\ta képet vörös-cián 3D képpé alakítja\n");
                 printf("--edge-detect\t\t\ta kép objektumainak függőleges széleit mutató\n\t\t\t\tképet adja vissza\n");
+                printf("--sequence\t\t\tegymás után fűzött PPM/PGM/QOI képkockák (pl. ffmpeg\n\t\t\t\t-f image2pipe -vcodec ppm) feldolgozása, a \"-\"\n\t\t\t\tbemenet és kimenet a standard be- és kimenet\n");
+                printf("--seed érték\t\t\ta véletlenszám-generátor kezdőértéke\n");
+                printf("--stable-random\t\t\tminden képkocka ugyanazokat a véletlenszerű\n\t\t\t\tbeállításokat kapja (corrupt, pixelsort)\n");
+                printf("--cache könyvtár\t\ta lépések eredményeinek gyorsítótára, az\n\t\t\t\tismételt futás a leghosszabb már kiszámolt\n\t\t\t\tlépéssorozat után folytatódik (a véletlenszerű\n\t\t\t\tlépések csak --seed megadásával)\n");
+                printf("--cache-size MB\t\t\ta gyorsítótár legnagyobb mérete (alapból 1024)\n");
+                printf("--roi x,y,szélesség,magasság\n\t\t\t\ta műveletek csak a kép ezen területén\n\t\t\t\thajtódnak végre\n");
+                printf("--mask fájl\t\t\ta kép méretével megegyező maszk kép, a\n\t\t\t\tműveletek a világos részeken érvényesülnek\n\t\t\t\t(--roi nélkül a maszk világos részeit\n\t\t\t\ttartalmazó területen)\n");
+                printf("--preview-scale 1/2|1/4|1/8\tgyors előnézet: a képet beolvasáskor\n\t\t\t\tkicsinyítjük, a térbeli paraméterek (rgb-shift,\n\t\t\t\troi, pixelsort) is ennek megfelelően változnak\n");
+                printf("--resize szélességxmagasság\ta kép átméretezése minden más művelet előtt,\n\t\t\t\ta --roi és a --mask már az új méretre vonatkozik\n");
+                printf("--resize-filter szűrő\t\taz átméretezés szűrője: box, bilinear vagy\n\t\t\t\tlanczos (alapból lanczos)\n");
+                printf("--adaptive\t\t\ta landscape, macro, fewcolors és dark pixelsort\n\t\t\t\tpresetek a kép fényessége és élsűrűsége alapján\n\t\t\t\tválasztják a küszöböket és a környezetet\n");
+                printf("--stats-only\t\t\tcsak a bemeneti kép statisztikáit írja ki\n\t\t\t\t(hisztogram percentilisek, átlag, szórásnégyzet,\n\t\t\t\télsűrűség), kimeneti kép nem kell\n");
+                printf("--verify-kernels\t\taz optimalizált függvények összevetése a\n\t\t\t\treferencia változatukkal több szálszámon, a\n\t\t\t\tbemeneti képen, vagy ha nincs megadva, szintetikus\n\t\t\t\tképeken\n");
+                printf("--isa generic|sse4.2|avx2|avx512\n\t\t\t\ta gyakran futó függvények ezen utasításkészletre\n\t\t\t\tfordított változatát használja (alapból a\n\t\t\t\tprocesszor által támogatott legjobbat)\n");
+                printf("--stats\t\t\t\ta futás végén kiírja a használt kerneleket, a\n\t\t\t\tmemória csúcsát és az ütemező statisztikáit,\n\t\t\t\tközben lépésenként a memóriahasználatot és a\n\t\t\t\tpárhuzamos feladatok számát\n");
+                printf("--trace FÁJL\t\t\ta lépések, a sávok és a be- és kiírt darabok\n\t\t\t\tidővonalát szálanként Chrome Trace Event\n\t\t\t\tformátumban ebbe a fájlba írja a futás végén\n\t\t\t\t(chrome://tracing, Perfetto)\n");
+                printf("--threads N\t\t\tlegfeljebb N szálon dolgozik (alapból a\n\t\t\t\tprocesszormagok számán), a --sequence olvasó és\n\t\t\t\tíró szála is ugyanezeket a szálakat használja\n");
+                printf("--max-memory MB\t\t\ta képek és a munkaterületek együtt legfeljebb\n\t\t\t\tennyi memóriát foglalhatnak; ha kell, a forgatás\n\t\t\t\thelyben, a blur, sharpen és élkeresés sávonként\n\t\t\t\tfut, ha így sem fér el, a feldolgozás el sem indul\n");
+                printf("--format ppm|pgm|pbm|qoi\ta kimeneti kép formátuma (alapból a kimeneti\n\t\t\t\tfájl kiterjesztése dönt, ennek hiányában a\n\t\t\t\tbemenetével azonos), a pgm szürkeárnyalatos, a\n\t\t\t\tpbm fekete-fehér (pl. --edge-detect maszkhoz),\n\t\t\t\ta bemenet formátumát a tartalmából ismerjük fel\n");
                 return 0;
             case '?':
                 break;
@@ -173,159 +1259,110 @@ int main (int argc, char *argv[]) {
         }
     }
 
-    time_t seconds;
-    seconds = time(NULL);
-
-    srand(seconds);
-    Filter blur;
-    Filter sharpen;
-    if (options.blur > 0)
-        setfilter(&blur, (int[]) {1, 2, 1, 2, 4, 2, 1, 2, 1}, 1/16.0, 3, 3);
+    srand(options.seed);
+    mem_set_limit(options.max_memory);
 
-    if (options.sharpen > 0)
-        setfilter(&sharpen, (int[]) {0, -1, 0, -1, 5, -1, 0, -1, 0}, 1, 3, 3);
+    if (options.verify) {
+        int failures;
+        if (inn_fname != NULL) {
+            PPM_Image image = Image_ParserScaled(inn_fname, options.preview_scale);
+            failures = verify_kernels(&image);
+            freeimage(image.image_data, image.size_x, image.size_y);
+        }
+        else
+            failures = verify_kernels(NULL);
+        free(inn_fname);
+        free(outt_fname);
+        return (failures > 0) ? 1 : 0;
+    }
 
-    if (inn_fname == NULL || outt_fname == NULL) {
+    if (inn_fname == NULL || (outt_fname == NULL && !options.stats_only)) {
         printf("nincs bemeneti, vagy kimeneti kép\n");
         return 1;
     }
 
-    PPM_Image image = PPM_Parser(inn_fname);
-    free(inn_fname);
-
-    for (int i = 0; i < image.size_y; i++) {
-        for (int j = 0; j < image.size_x; j++) {
-            if (options.lightness != 0)
-                change_light(image.image_data[i][j], options.lightness);
-            if (options.contrast != 0)
-                contrast(image.image_data[i][j], options.contrast);
-            if (options.hue_shift != 0)
-                hue_shift(image.image_data[i][j], options.hue_shift);
-            if (options.invert)
-                invert(image.image_data[i][j]);
-            if (options.sinecolor_shft != 0)
-            /*amplitude, frequency, phase, bias*/
-            sinecolor_shift (image.image_data[i][j], 0.5, options.sinecolor_shft, 90, 1);
-        }
-    }
-    if (options.mirror != none) {
-        switch (options.mirror) {
-            case diagonal:
-                mirror_diagonal (image.image_data, image.size_x, image.size_y);
-                break;
-            case vertical:
-                mirror_vertical (image.image_data, image.size_x, image.size_y);
-                break;
-            case horizontal:
-                mirror_horizontal (image.image_data, image.size_x, image.size_y);
-                break;
-            case none:
-                break;
+    if (options.stats_only) {
+        PPM_Image image = Image_ParserScaled(inn_fname, options.preview_scale);
+        ImageStats stats;
+        image_stats(&image, &stats);
+        print_stats(stdout, &stats);
+        if (options.stats) {
+            printf("memória csúcs: %.1f MB\n", megabytes(mem_peak()));
+            parallel_print(stdout);
+            isa_print(stdout);
         }
+        freeimage(image.image_data, image.size_x, image.size_y);
+        free(inn_fname);
+        free(outt_fname);
+        return 0;
     }
 
-    rgb_shift (&image, options.rgbshft);
-    PsOptions preset;
-
-    if (options.ps_preset == allrandom) {
-        preset.pstype = hsl_l;
-        preset.treshold = ran;
-        preset.treshold_bottom_min = 0;
-        preset.treshold_bottom_max = 100;
-        preset.treshold_top_min = 0;
-        preset.treshold_top_max = 100;
-        preset.interval = ran;
-        preset.interval_min = image.size_x/40;
-        preset.interval_max = image.size_x/5;
-        preset.merge = 1.0/(rand()%5)*(0.5+(rand()%10)/10);
+    /* előnézetnél a terület a kicsinyített képre vonatkozik */
+    if (options.region_given && options.preview_scale > 1) {
+        Region *region = &options.region;
+        region->x /= options.preview_scale;
+        region->y /= options.preview_scale;
+        region->size_x = (region->size_x + options.preview_scale - 1) / options.preview_scale;
+        region->size_y = (region->size_y + options.preview_scale - 1) / options.preview_scale;
     }
 
-    if (options.ps_preset == landscape) {
-        preset.pstype = hsl_l;
-        preset.treshold = ran;
-        preset.treshold_bottom_min = 0;
-        preset.treshold_bottom_max = 10;
-        preset.treshold_top_min = 0;
-        preset.treshold_top_max = 70;
-        preset.interval = ran;
-        preset.interval_min = image.size_x/10;
-        preset.interval_max = image.size_x/5;
-        preset.merge = 1;
+    if (mask_fname != NULL) {
+        options.mask = load_mask(mask_fname, options.preview_scale);
+        options.mask_hash = cache_hash_file(mask_fname);
+        free(mask_fname);
+        if (!options.region_given) {
+            options.region = region_from_mask(options.mask.image_data, options.mask.size_x, options.mask.size_y);
+            options.region_given = true;
+        }
+        options.region.mask = options.mask.image_data;
     }
 
-    if (options.ps_preset == macro) {
-        preset.pstype = hsl_l;
-        preset.treshold = ran;
-        preset.treshold_bottom_min = 0;
-        preset.treshold_bottom_max = 70;
-        preset.treshold_top_min = 0;
-        preset.treshold_top_max = 100;
-        preset.interval = ran;
-        preset.interval_min = image.size_x/40;
-        preset.interval_max = image.size_x/35;
-        preset.merge = 1;
-    }
+    if (options.format == format_auto)
+        options.format = format_from_filename(outt_fname);
 
-    if (options.ps_preset == fewcolors) {
-        preset.pstype = hsl_l;
-        preset.treshold = ran;
-        preset.treshold_bottom_min = 0;
-        preset.treshold_bottom_max = 10;
-        preset.treshold_top_min = 0;
-        preset.treshold_top_max = 70;
-        preset.interval = ran;
-        preset.interval_min = image.size_x/30;
-        preset.interval_max = image.size_x/20;
-        preset.merge = 1/2.0;
+    if (options.sequence) {
+        int frames = PPM_Sequence(inn_fname, outt_fname, options.preview_scale, options.format, process_image, &options);
+        free(inn_fname);
+        free(outt_fname);
+        printf("%d képkocka feldolgozva\n", frames);
+        if (options.stats) {
+            printf("memória csúcs: %.1f MB\n", megabytes(mem_peak()));
+            parallel_print(stdout);
+            isa_print(stdout);
+        }
+        printf("A program %ld másodperc alatt végzett\n", time(NULL)-seconds);
+        return 0;
     }
 
-    if (options.ps_preset == dark) {
-        preset.pstype = rgb_sum;
-        preset.treshold = man;
-        preset.treshold_bottom_min = 1;
-        preset.treshold_bottom_max = 1;
-        preset.treshold_top_min = 50;
-        preset.treshold_top_max = 10;
-        preset.interval = ran;
-        preset.interval_min = image.size_x/30;
-        preset.interval_max = image.size_x/20;
-        preset.merge = 1;
-    }
-    if (options.ps_preset == edge) {
-        preset.pstype = edges;
+    if (options.max_memory > 0 && !plan_memory(inn_fname, &options)) {
+        free(inn_fname);
+        free(outt_fname);
+        free(options.cache_dir);
+        if (options.mask.image_data != NULL)
+            freeimage(options.mask.image_data, options.mask.size_x, options.mask.size_y);
+        return 1;
     }
 
-    if (options.ps_preset != psnone)
-        pixelsort(image.image_data, image.size_x, image.size_y, preset);
-
-    convolve(image.image_data, image.size_x, image.size_y, blur, options.blur);
-
-    convolve(image.image_data, image.size_x, image.size_y, sharpen, options.sharpen);
-
-    if (options.corrupt)
-        corrupt(&image);
-
-    for (int i = 0; i < image.size_y; i++) {
-        for (int j = 0; j < image.size_x; j++) {
-            if (options.grayscale)
-                grayscale(image.image_data[i][j]);
-        }
+    PPM_Image image;
+    if (options.cache_dir == NULL && !options.region_given)
+        image = process_streamed(inn_fname, outt_fname, &options);
+    else {
+        image = process_file(inn_fname, &options);
+        Image_Writer(outt_fname, &image, options.format);
     }
-    if (options.a3d)
-        anaglyph3d(&image);
-
-    if (options.edge)
-        image.image_data = detect_edges (image.image_data, image.size_x, image.size_y);
-    PPM_Writer(outt_fname, &image);
+    free(inn_fname);
+    free(options.cache_dir);
     free(outt_fname);
 
-    if (options.blur > 0)
-        freefilter(blur);
-
-    if (options.sharpen > 0)
-        freefilter(sharpen);
-
     freeimage(image.image_data, image.size_x, image.size_y);
+    if (options.mask.image_data != NULL)
+        freeimage(options.mask.image_data, options.mask.size_x, options.mask.size_y);
+
+    if (options.stats) {
+        printf("memória csúcs: %.1f MB\n", megabytes(mem_peak()));
+        parallel_print(stdout);
+        isa_print(stdout);
+    }
 
     printf("A program %ld másodperc alatt végzett\n", time(NULL)-seconds);
 
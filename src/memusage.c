@@ -0,0 +1,220 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "memusage.h"
+
+/**
+ * @file
+ * @brief A képek és a munkaterületek memóriahasználatának nyilvántartása
+ *
+ * A könyvtár minden képét és a méretükkel arányos munkaterületeit ezeken a függvényeken keresztül foglalja le. Így bármikor tudjuk, hogy éppen mennyi memóriát használnak, és mennyi volt a legtöbb, és egy korlátot is meg lehet adni, amin felül a foglalás NULL-t ad, mintha elfogyott volna a memória.
+ * A kis, a kép méretétől független foglalások (pl. a filterek, a szálak adatai) nem kerülnek ide.
+ * A nagy területeket (pl. egy nagy kép pixeleit és mutatóit) huge page-ekre tesszük, mert az oszloponként haladó és a konvolúciós menetek egy-egy sora sok különböző lapra esik, és a 4 KB-os lapokkal a TLB-nek ez már nem fér el.
+ */
+
+/** @brief a huge page mérete, a nagy területeket erre igazítjuk */
+#define HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+/** @brief ennél nagyobb területeket foglalunk huge page-ekre */
+#define HUGE_PAGE_THRESHOLD ((size_t) 32 * 1024 * 1024)
+
+/**
+ * @brief a lefoglalt terület előtt tárolt méret
+ *
+ * Unió, hogy a mögötte visszaadott terület ugyanúgy igazítva legyen, mint a malloc eredménye.
+ */
+typedef union MemHeader {
+    struct {
+        size_t size; /**< a kért méret bájtban */
+        size_t mapped; /**< az mmap-pel lefoglalt terület hossza, 0 ha malloc-kal foglaltuk */
+    };
+    max_align_t align; /**< csak az igazítás miatt */
+} MemHeader;
+
+static atomic_llong current_bytes = 0; /**< a jelenleg lefoglalt bájtok */
+static atomic_llong peak_bytes = 0; /**< a program indulása óta a legtöbb lefoglalt bájt */
+static atomic_llong window_bytes = 0; /**< a mem_window_begin óta a legtöbb lefoglalt bájt */
+static atomic_llong limit_bytes = 0; /**< a korlát bájtban, 0 ha nincs korlát */
+static _Thread_local long long thread_bytes = 0; /**< a szál által a mem_thread_window_begin óta lefoglalt és még fel nem szabadított bájtok */
+static _Thread_local long long thread_peak = 0; /**< a thread_bytes legnagyobb értéke a mem_thread_window_begin óta */
+
+/** @brief a csúcsértéket legalább value-ra emeli */
+static void raise_peak(atomic_llong *peak, long long value) {
+    long long old = atomic_load(peak);
+    while (old < value && !atomic_compare_exchange_weak(peak, &old, value))
+        ;
+}
+
+#ifdef MADV_HUGEPAGE
+/**
+ * @brief huge page-ekre foglal egy területet
+ * @param[in] bytes a terület mérete bájtban, a fejléccel együtt
+ * @param[in] *mapped ide kerül a lefoglalt terület hossza
+ * @param[out] area a huge page határra igazított, kinullázott terület, vagy NULL ha az mmap nem sikerült
+ *
+ * Elsősorban transparent huge page-eket kérünk a madvise-zal. Ehhez a terület elejét a lap határára kell igazítani, ezért egy lappal többet kérünk, és a két végén a fölösleget visszaadjuk. Ha a kernel nem ismeri a transparent huge page-eket, a hugetlbfs lapjaival próbálkozunk, és ha azokból sincs lefoglalva elég, a normál lapok maradnak.
+ */
+static void *map_huge(size_t bytes, size_t *mapped) {
+    size_t length = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    char *raw = (char *) mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+    size_t head = (HUGE_PAGE_SIZE - (uintptr_t) raw % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+    if (head > 0)
+        munmap(raw, head);
+    munmap(raw + head + length, HUGE_PAGE_SIZE - head);
+    void *area = raw + head;
+
+    if (madvise(area, length, MADV_HUGEPAGE) != 0) {
+#ifdef MAP_HUGETLB
+        void *huge = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (huge != MAP_FAILED) {
+            munmap(area, length);
+            area = huge;
+        }
+#endif
+    }
+    *mapped = length;
+    return area;
+}
+#endif
+
+/**
+ * @brief lefoglalja és nyilvántartja a területet
+ * @param[in] size a terület mérete bájtban
+ * @param[in] zero true ha a területet ki kell nullázni
+ * @param[out] ptr a terület, NULL ha nem sikerült, vagy a korlát miatt nem lehetett lefoglalni (ekkor errno ENOMEM)
+ *
+ * A foglalás előtt előre hozzáadjuk a méretet a nyilvántartáshoz, így több szál egyszerre sem lépheti át a korlátot.
+ */
+static void *reserve(size_t size, bool zero) {
+    if (size > SIZE_MAX - sizeof(MemHeader) || size > (size_t) INT64_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    long long now = atomic_fetch_add(&current_bytes, (long long) size) + (long long) size;
+    long long limit = atomic_load(&limit_bytes);
+    if (limit > 0 && now > limit) {
+        atomic_fetch_sub(&current_bytes, (long long) size);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    MemHeader *header = NULL;
+    size_t mapped = 0;
+#ifdef MADV_HUGEPAGE
+    /* az mmap területe eleve nullákkal van tele */
+    if (size >= HUGE_PAGE_THRESHOLD)
+        header = (MemHeader *) map_huge(sizeof(MemHeader) + size, &mapped);
+#endif
+    if (header == NULL)
+        header = zero ? calloc(1, sizeof(MemHeader) + size) : malloc(sizeof(MemHeader) + size);
+    if (header == NULL) {
+        atomic_fetch_sub(&current_bytes, (long long) size);
+        return NULL;
+    }
+    header->size = size;
+    header->mapped = mapped;
+    raise_peak(&peak_bytes, now);
+    raise_peak(&window_bytes, now);
+    thread_bytes += (long long) size;
+    if (thread_bytes > thread_peak)
+        thread_peak = thread_bytes;
+    return header + 1;
+}
+
+/**
+ * @brief nyilvántartott malloc
+ * @param[in] size a terület mérete bájtban
+ * @param[out] ptr a terület, amit a mem_free-vel kell felszabadítani, vagy NULL
+ */
+void *mem_alloc(size_t size) {
+    return reserve(size, false);
+}
+
+/**
+ * @brief nyilvántartott calloc
+ * @param[in] count az elemek száma
+ * @param[in] size egy elem mérete bájtban
+ * @param[out] ptr a kinullázott terület, amit a mem_free-vel kell felszabadítani, vagy NULL
+ */
+void *mem_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return reserve(count * size, true);
+}
+
+/**
+ * @brief felszabadítja a mem_alloc vagy a mem_calloc által lefoglalt területet
+ * @param[in] *ptr a terület, NULL esetén nem csinál semmit
+ */
+void mem_free(void *ptr) {
+    if (ptr == NULL)
+        return;
+    MemHeader *header = (MemHeader *) ptr - 1;
+    atomic_fetch_sub(&current_bytes, (long long) header->size);
+    thread_bytes -= (long long) header->size;
+    if (header->mapped > 0)
+        munmap(header, header->mapped);
+    else
+        free(header);
+}
+
+/** @brief a jelenleg lefoglalt bájtok száma */
+long long mem_current(void) {
+    return atomic_load(&current_bytes);
+}
+
+/** @brief a program indulása óta a legtöbb egyszerre lefoglalt bájt */
+long long mem_peak(void) {
+    return atomic_load(&peak_bytes);
+}
+
+/**
+ * @brief új mérési időszakot kezd, aminek a csúcsát a mem_window_peak adja
+ *
+ * Egy feldolgozási lépés előtt hívjuk, így a lépés saját csúcsát kapjuk, nem a korábbiakét.
+ */
+void mem_window_begin(void) {
+    atomic_store(&window_bytes, atomic_load(&current_bytes));
+}
+
+/** @brief a mem_window_begin óta a legtöbb egyszerre lefoglalt bájt */
+long long mem_window_peak(void) {
+    return atomic_load(&window_bytes);
+}
+
+/**
+ * @brief új mérési időszakot kezd a hívó szál saját foglalásaira, aminek a csúcsát a mem_thread_window_peak adja
+ *
+ * A mem_window_begin az összes szál foglalását méri, ezért nem használható, ha közben más szálak más lépéseket hajtanak végre (pl. az átfedéses feldolgozás sávjainál).
+ */
+void mem_thread_window_begin(void) {
+    thread_bytes = 0;
+    thread_peak = 0;
+}
+
+/** @brief a hívó szál által a mem_thread_window_begin óta egyszerre lefoglalt legtöbb bájt */
+long long mem_thread_window_peak(void) {
+    return thread_peak;
+}
+
+/**
+ * @brief beállítja a lefoglalható memória korlátját
+ * @param[in] bytes a korlát bájtban, 0 ha nincs korlát
+ */
+void mem_set_limit(long long bytes) {
+    atomic_store(&limit_bytes, (bytes > 0) ? bytes : 0);
+}
+
+/** @brief a korlát bájtban, 0 ha nincs korlát */
+long long mem_limit(void) {
+    return atomic_load(&limit_bytes);
+}
+
@@ -0,0 +1,18 @@
+#ifndef MEMUSAGE
+#define MEMUSAGE
+
+#include <stddef.h>
+
+void *mem_alloc(size_t size);
+void *mem_calloc(size_t count, size_t size);
+void mem_free(void *ptr);
+long long mem_current(void);
+long long mem_peak(void);
+void mem_window_begin(void);
+long long mem_window_peak(void);
+void mem_thread_window_begin(void);
+long long mem_thread_window_peak(void);
+void mem_set_limit(long long bytes);
+long long mem_limit(void);
+
+#endif
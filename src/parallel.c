@@ -0,0 +1,414 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "trace.h"
+
+/**
+ * @file
+ * @brief Soronként független műveletek szétosztása szálak között
+ *
+ * Minden párhuzamos lépés (konvolúció, pixelsort, transzponálás, a beolvasás és a kiírás) ugyanazokat a szálakat használja, így akkor sem indul több szál, mint ahány mag van, ha egy sáv feldolgozása maga is párhuzamos, vagy egyszerre több szál (pl. a --sequence olvasó, feldolgozó és író szála) hív párhuzamos lépést.
+ * A szálak az első párhuzamos hívásnál indulnak, és a program végéig futnak. Mindegyiknek saját feladatsora van: a saját sorának végére teszi az új feladatokat és onnan is veszi el őket, ha pedig kiürült, egy másik szál sorának elejéről lop. A nem ütemező szálak (pl. a főszál) közös sort használnak.
+ * Egy feladat a sorok egy tartománya. Végrehajtás előtt a tartomány felső felét új feladatként leválasztjuk, amíg elég kicsi nem lesz, így a szabad szálak mindig a legnagyobb még fel nem dolgozott darabokat lopják el. Ezért a nagyon eltérő munkaigényű sorok (pl. a pixelsort élei) is egyenletesen oszlanak el.
+ */
+
+#define MAX_THREADS 64 /**< legfeljebb ennyi szálat használunk, a hívóval együtt */
+#define TASKS_PER_THREAD 8 /**< egy hívás munkáját szálanként nagyjából ennyi feladatra bontjuk */
+#define DEQUE_SIZE 1024 /**< egy feladatsor legfeljebb ennyi feladatot tárol, ha megtelt, a tartományt nem bontjuk tovább */
+#define SPIN_ROUNDS 64 /**< ennyiszer nézünk körül munka után, mielőtt elaludnánk */
+
+static atomic_int thread_limit = 0; /**< a parallel_set_threads-szel beállított szálszám, 0 ha a magok számát használjuk; futás közben is állítható (pl. --verify-kernels, ip_set_threads), miközben a szálak olvassák */
+
+/**
+ * @brief egy párhuzamos hívás közös adatai
+ */
+typedef struct Group {
+    band_func func; /**< a sávot feldolgozó függvény */
+    void *data; /**< a func-nak átadott adat */
+    const long long *cost; /**< a sorok munkaigényének prefix összege, NULL ha minden sor egyforma */
+    long long grain; /**< ennél kisebb munkaigényű tartományt már nem bontunk */
+    atomic_int pending; /**< a még el nem készült feladatok száma */
+} Group;
+
+/**
+ * @brief egy feladat: a sorok egy tartománya
+ */
+typedef struct Task {
+    int first; /**< az első sor */
+    int last; /**< az utolsó utáni sor */
+    Group *group; /**< a hívás, amihez tartozik */
+} Task;
+
+/**
+ * @brief egy szál feladatsora
+ *
+ * A tulajdonos a végére tesz és onnan vesz el, a többi szál az elejéről lop.
+ */
+typedef struct Deque {
+    pthread_mutex_t lock; /**< a sor zárja */
+    Task tasks[DEQUE_SIZE]; /**< gyűrűpuffer */
+    long long top; /**< a legrégebbi feladat sorszáma */
+    long long bottom; /**< a legújabb feladat utáni sorszám */
+    atomic_int size; /**< bottom - top, zár nélkül is olvasható */
+    atomic_llong executed; /**< a szál által végrehajtott feladatok */
+    atomic_llong steals; /**< ebből más szál sorából lopott */
+    atomic_llong idle_ns; /**< a szál ennyi ideig várt munkára */
+    atomic_llong idle_since; /**< mikor kezdett a szál munkára várni, 0 ha éppen dolgozik */
+} Deque;
+
+/** @brief a feladatsorok, a 0. a nem ütemező szálaké, az i. az i. ütemező szálé */
+static Deque deques[MAX_THREADS];
+static pthread_once_t deques_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER; /**< az ütemező szálak indításához */
+static atomic_int started = 0; /**< az elindított ütemező szálak száma */
+static atomic_int active = 1; /**< a dolgozó szálak száma a hívóval együtt, az ennél nagyobb sorszámú ütemező szálak pihennek */
+
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER; /**< az alvó szálak felébresztéséhez */
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER; /**< jelez, ha új feladat érkezett vagy egy hívás elkészült */
+static unsigned long wake_epoch = 0; /**< minden ébresztéskor nő, hogy az alvó szál ne maradjon le egyről sem */
+static atomic_int sleepers = 0; /**< az éppen elalvó vagy alvó szálak száma */
+
+static _Thread_local int self = 0; /**< a szál feladatsorának sorszáma, 0 ha nem ütemező szál */
+
+/**
+ * @brief a használható szálak száma
+ * @param[out] threads a beállított szálszám, vagy ha nincs beállítva, a processzormagok száma, legalább 1 és legfeljebb MAX_THREADS
+ */
+int parallel_threads(void) {
+    int limit = atomic_load(&thread_limit);
+    if (limit > 0)
+        return limit;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1)
+        return 1;
+    return (cores > MAX_THREADS) ? MAX_THREADS : (int) cores;
+}
+
+/**
+ * @brief beállítja a szálak számát
+ * @param[in] threads a szálak száma (legfeljebb MAX_THREADS), 0 esetén a processzormagok száma
+ *
+ * Futás közben is hívható, a már elindított, de fölösleges szálak ilyenkor pihennek.
+ */
+void parallel_set_threads(int threads) {
+    atomic_store(&thread_limit, (threads > MAX_THREADS) ? MAX_THREADS : threads);
+}
+
+static void init_deques(void) {
+    for (int i = 0; i < MAX_THREADS; i++)
+        pthread_mutex_init(&deques[i].lock, NULL);
+}
+
+/** @brief felébreszti az alvó szálakat, ha vannak */
+static void wake_sleepers(void) {
+    if (atomic_load(&sleepers) == 0)
+        return;
+    pthread_mutex_lock(&sleep_lock);
+    wake_epoch++;
+    pthread_cond_broadcast(&wake_cond);
+    pthread_mutex_unlock(&sleep_lock);
+}
+
+/**
+ * @brief a sor végére tesz egy feladatot
+ * @param[out] success false ha a sor megtelt
+ */
+static bool push_task(Deque *deque, Task task) {
+    pthread_mutex_lock(&deque->lock);
+    bool room = deque->bottom - deque->top < DEQUE_SIZE;
+    if (room) {
+        deque->tasks[deque->bottom % DEQUE_SIZE] = task;
+        deque->bottom++;
+        atomic_store(&deque->size, (int) (deque->bottom - deque->top));
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return room;
+}
+
+/**
+ * @brief elvesz egy feladatot a sorból
+ * @param[in] *deque a sor
+ * @param[in] *task ide kerül a feladat
+ * @param[in] steal true esetén a sor elejéről (a legrégebbit), különben a végéről (a legújabbat)
+ * @param[out] success false ha a sor üres
+ */
+static bool take_task(Deque *deque, Task *task, bool steal) {
+    if (atomic_load(&deque->size) == 0)
+        return false;
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->bottom > deque->top;
+    if (found) {
+        if (steal)
+            *task = deque->tasks[deque->top++ % DEQUE_SIZE];
+        else
+            *task = deque->tasks[--deque->bottom % DEQUE_SIZE];
+        atomic_store(&deque->size, (int) (deque->bottom - deque->top));
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/** @brief a pihenő ütemező szál nem vesz fel munkát */
+static bool parked(void) {
+    return self > 0 && self >= atomic_load(&active);
+}
+
+/**
+ * @brief keres egy feladatot: először a saját sorában, aztán a többi szál sorából lop
+ * @param[out] success false ha egyik sorban sincs feladat
+ */
+static bool find_task(Task *task) {
+    if (parked())
+        return false;
+    if (take_task(&deques[self], task, false))
+        return true;
+    int queues = atomic_load(&started) + 1;
+    for (int i = 1; i < queues; i++) {
+        if (take_task(&deques[(self + i) % queues], task, true)) {
+            atomic_fetch_add_explicit(&deques[self].steals, 1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+/** @brief van-e feladat valamelyik sorban */
+static bool any_task(void) {
+    if (parked())
+        return false;
+    int queues = atomic_load(&started) + 1;
+    for (int i = 0; i < queues; i++)
+        if (atomic_load(&deques[i].size) > 0)
+            return true;
+    return false;
+}
+
+/** @brief a [first, last) sorok munkaigénye */
+static long long range_cost(Group *group, int first, int last) {
+    return (group->cost != NULL) ? group->cost[last] - group->cost[first] : last - first;
+}
+
+/**
+ * @brief hol vágjuk ketté a tartományt
+ * @param[out] mid a felső fél első sora, first < mid < last
+ *
+ * A munkaigény szerint felezünk, így a két fél nagyjából ugyanannyi munka.
+ */
+static int split_point(Group *group, int first, int last) {
+    if (group->cost == NULL)
+        return first + (last - first) / 2;
+    long long half = group->cost[first] + range_cost(group, first, last) / 2;
+    int low = first + 1, high = last - 1;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (group->cost[mid] < half)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/**
+ * @brief végrehajt egy feladatot
+ *
+ * Amíg a tartomány elég nagy, a felső felét új feladatként a saját sorunkba tesszük, ahonnan a szabad szálak ellophatják. A hívás utolsó feladata után a Group-hoz már nem szabad nyúlni, mert a hívó visszatérhet.
+ */
+static void run_task(Task task) {
+    Group *group = task.group;
+    while (task.last - task.first > 1 && range_cost(group, task.first, task.last) > group->grain) {
+        int mid = split_point(group, task.first, task.last);
+        atomic_fetch_add(&group->pending, 1);
+        if (!push_task(&deques[self], (Task) {mid, task.last, group})) {
+            atomic_fetch_sub(&group->pending, 1);
+            break;
+        }
+        wake_sleepers();
+        task.last = mid;
+    }
+    group->func(task.first, task.last, group->data);
+    atomic_fetch_add_explicit(&deques[self].executed, 1, memory_order_relaxed);
+    if (atomic_fetch_sub(&group->pending, 1) == 1)
+        wake_sleepers();
+}
+
+/** @brief nanoszekundumban mért idő */
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** @brief hozzáadja a start óta eltelt időt a szál üresjáratához */
+static void end_idle(long long start) {
+    atomic_store_explicit(&deques[self].idle_since, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&deques[self].idle_ns, now_ns() - start, memory_order_relaxed);
+}
+
+/** @brief elkészült-e a hívás, NULL esetén sosem */
+static bool group_done(Group *group) {
+    return group != NULL && atomic_load(&group->pending) == 0;
+}
+
+/**
+ * @brief végrehajt egy feladatot, vagy ha nincs, vár
+ * @param[in] *waiting a hívás, aminek a végére várunk, NULL ha az ütemező szál munkára vár
+ *
+ * Először egy darabig körbenézünk, aztán elalszunk, amíg új feladat nem érkezik, vagy valamelyik hívás el nem készül. A wake_epoch-ot még a feladatok utolsó ellenőrzése előtt olvassuk ki, így az ellenőrzés és az elalvás között érkezett ébresztés sem veszhet el.
+ */
+static void help_or_sleep(Group *waiting) {
+    long long start = now_ns();
+    atomic_store_explicit(&deques[self].idle_since, start, memory_order_relaxed);
+    Task task;
+    for (int round = 0; round < SPIN_ROUNDS; round++) {
+        if (find_task(&task)) {
+            end_idle(start);
+            run_task(task);
+            return;
+        }
+        if (group_done(waiting))
+            break;
+        sched_yield();
+    }
+
+    atomic_fetch_add(&sleepers, 1);
+    pthread_mutex_lock(&sleep_lock);
+    unsigned long epoch = wake_epoch;
+    pthread_mutex_unlock(&sleep_lock);
+    if (!any_task() && !group_done(waiting)) {
+        pthread_mutex_lock(&sleep_lock);
+        while (wake_epoch == epoch)
+            pthread_cond_wait(&wake_cond, &sleep_lock);
+        pthread_mutex_unlock(&sleep_lock);
+    }
+    atomic_fetch_sub(&sleepers, 1);
+    end_idle(start);
+}
+
+static void *worker_thread(void *arg) {
+    self = (int) (intptr_t) arg;
+    char name[32];
+    snprintf(name, sizeof(name), "ütemező %d", self);
+    trace_thread_name(name);
+    for (;;)
+        help_or_sleep(NULL);
+    return NULL;
+}
+
+/**
+ * @brief elindítja a még hiányzó ütemező szálakat, és beállítja, hány dolgozzon
+ * @param[in] threads a dolgozó szálak száma a hívóval együtt
+ * @param[out] threads ennyi szál dolgozik, kevesebb, ha nem sikerült elindítani őket
+ */
+static int start_workers(int threads) {
+    pthread_once(&deques_once, init_deques);
+    pthread_mutex_lock(&pool_lock);
+    int count = atomic_load(&started);
+    while (count < threads - 1) {
+        pthread_t id;
+        if (pthread_create(&id, NULL, worker_thread, (void *) (intptr_t) (count + 1)) != 0)
+            break;
+        pthread_detach(id);
+        atomic_store(&started, ++count);
+    }
+    if (threads > count + 1)
+        threads = count + 1;
+    if (atomic_exchange(&active, threads) < threads)
+        wake_sleepers();
+    pthread_mutex_unlock(&pool_lock);
+    return threads;
+}
+
+/**
+ * @brief a sorokat feladatokra bontja, és az ütemező szálakkal párhuzamosan feldolgozza
+ * @param[in] rows a sorok száma
+ * @param[in] cost[] a sorok munkaigényének prefix összege, NULL ha minden sor egyforma
+ * @param[in] func a sávot feldolgozó függvény
+ * @param[in] *data a func-nak átadott adat
+ *
+ * Az első feladatot a hívó szál kezdi, és amíg a többi el nem készül, maga is feladatokat hajt végre.
+ */
+static void run_group(int rows, const long long cost[], band_func func, void *data) {
+    int threads = parallel_threads();
+    if (threads > 1 && rows > 1)
+        threads = start_workers(threads);
+    if (threads <= 1 || rows <= 1) {
+        if (rows > 0)
+            func(0, rows, data);
+        return;
+    }
+
+    long long total = (cost != NULL) ? cost[rows] - cost[0] : rows;
+    Group group = {func, data, cost, total / ((long long) threads * TASKS_PER_THREAD), 1};
+    run_task((Task) {0, rows, &group});
+    while (!group_done(&group))
+        help_or_sleep(&group);
+}
+
+/**
+ * @brief a sorokat sávokra osztja, és a sávokat párhuzamosan dolgozza fel
+ * @param[in] rows a sorok száma
+ * @param[in] func a sávot feldolgozó függvény, a [first, last) sorokat kapja
+ * @param[in] *data a func-nak átadott adat
+ *
+ * Csak akkor tér vissza, ha minden sáv elkészült. A func-nak csak a saját sávjának sorait szabad írnia, és egy hívásban többször, különböző sávokkal is meghívódhat. A func maga is hívhat párhuzamos lépést.
+ */
+void parallel_rows(int rows, band_func func, void *data) {
+    run_group(rows, NULL, func, data);
+}
+
+/**
+ * @brief mint a parallel_rows, de a sávokat a sorok munkaigénye alapján osztja ki
+ * @param[in] rows a sorok száma
+ * @param[in] cost[] rows + 1 elemű prefix összeg, az első i sor munkaigénye cost[i], cost[0] = 0
+ * @param[in] func a sávot feldolgozó függvény, a [first, last) sorokat kapja
+ * @param[in] *data a func-nak átadott adat
+ *
+ * Akkor hasznos, ha a sorok munkaigénye nagyon eltérő, például ha a munka csak a kép néhány sorában van. A tartományokat a munkaigényük szerint felezzük, a becslés hibáit pedig a lopás egyenlíti ki.
+ * @see parallel_rows
+ */
+void parallel_rows_weighted(int rows, const long long cost[], band_func func, void *data) {
+    run_group(rows, (rows > 0 && cost[rows] > 0) ? cost : NULL, func, data);
+}
+
+/**
+ * @brief az ütemező eddigi statisztikái
+ * @param[in] *stats ide kerülnek
+ *
+ * Az éppen munkára váró szálak üresjáratába a mostani várakozásuk is beleszámít.
+ */
+void parallel_stats(ParallelStats *stats) {
+    long long now = now_ns();
+    stats->threads = atomic_load(&started) + 1;
+    stats->tasks = 0;
+    stats->steals = 0;
+    stats->idle_ns = 0;
+    for (int i = 0; i < stats->threads; i++) {
+        stats->tasks += atomic_load(&deques[i].executed);
+        stats->steals += atomic_load(&deques[i].steals);
+        if (i > 0) {
+            long long since = atomic_load_explicit(&deques[i].idle_since, memory_order_relaxed);
+            stats->idle_ns += atomic_load(&deques[i].idle_ns) + ((since > 0) ? now - since : 0);
+        }
+    }
+}
+
+/**
+ * @brief kiírja az ütemező statisztikáit
+ * @param[in] *fp ide írunk
+ */
+void parallel_print(FILE *fp) {
+    ParallelStats stats;
+    parallel_stats(&stats);
+    fprintf(fp, "Ütemező: %d szál, %lld feladat, ebből %lld lopott\n", stats.threads, stats.tasks, stats.steals);
+    if (stats.threads > 1)
+        fprintf(fp, "  üresjárat szálanként átlagosan: %.1f ms\n", stats.idle_ns / 1e6 / (stats.threads - 1));
+}
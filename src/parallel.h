@@ -0,0 +1,30 @@
+#ifndef PARALLEL
+#define PARALLEL
+
+#include <stdio.h>
+
+/**
+ * @brief egy sáv feldolgozása
+ * @see parallel_rows
+ */
+typedef void (*band_func)(int first, int last, void *data);
+
+/**
+ * @brief az ütemező statisztikái
+ * @see parallel_stats
+ */
+typedef struct ParallelStats {
+    int threads; /**< az elindított szálak száma a hívóval együtt */
+    long long tasks; /**< a végrehajtott feladatok száma */
+    long long steals; /**< ebből ennyit loptak el egy másik szál sorából */
+    long long idle_ns; /**< az ütemező szálak összesen ennyi nanoszekundumig vártak munkára */
+} ParallelStats;
+
+int parallel_threads(void);
+void parallel_set_threads(int threads);
+void parallel_rows(int rows, band_func func, void *data);
+void parallel_rows_weighted(int rows, const long long cost[], band_func func, void *data);
+void parallel_stats(ParallelStats *stats);
+void parallel_print(FILE *fp);
+
+#endif
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "ppm.h"
+#include "imageio.h"
+#include "isa.h"
+#include "pipeline.h"
+#include "trace.h"
+
+/**
+ * @file
+ * @brief Egy kép beolvasása, feldolgozása és kiírása átfedésben
+ *
+ * A beolvasó szál a kép elkészült sávjait egy sorba teszi, amiből a hívó szál kiveszi és rögtön végrehajtja rajtuk a soronként független lépéseket. Ha nincs a teljes képet igénylő lépés, a kész sávok egy másik soron keresztül egyből az író szálhoz kerülnek, így a beolvasás, a feldolgozás és a kiírás egyszerre halad, és a teljes idő a leglassabb lépéshez közelít.
+ * A teljes képet igénylő lépések (pl. elmosás, pixelsort) határt jelentenek: csak a teljes beolvasás után futnak, és utánuk a maradék soronkénti lépések már a kiírással vannak átfedésben.
+ * A sorok egy termelő és egy fogyasztó között működnek, ezért zár nélkül, csak a két index atomi írásával és olvasásával kezelhetők.
+ */
+
+#define PIPELINE_BLOCK_ROWS 16 /**< ennyi soronként adjuk tovább a sávokat */
+#define PIPELINE_QUEUE_SIZE 64 /**< legfeljebb ennyi sáv várakozhat két szál között */
+
+/**
+ * @brief a kép egy sávja: a [first, last) sorok
+ */
+typedef struct RowBlock {
+    int first; /**< az első sor */
+    int last; /**< az utolsó utáni sor */
+} RowBlock;
+
+/**
+ * @brief korlátos méretű, zár nélküli sor egy termelő és egy fogyasztó szál között
+ *
+ * A tail-t csak a termelő, a head-et csak a fogyasztó írja. Az indexek folyamatosan nőnek, a tömbbeli hely a maradékuk.
+ */
+typedef struct RowQueue {
+    RowBlock blocks[PIPELINE_QUEUE_SIZE]; /**< a várakozó sávok körkörös tömbje */
+    atomic_int head; /**< a következő kiveendő sáv sorszáma */
+    atomic_int tail; /**< a következő beteendő sáv sorszáma */
+    atomic_bool closed; /**< true ha már nem érkezik több sáv */
+} RowQueue;
+
+/**
+ * @brief a szálak közös adatai
+ */
+typedef struct Pipeline {
+    FILE *in; /**< a bemeneti fájl */
+    FILE *out; /**< a kimeneti fájl */
+    char *in_fname; /**< a bemeneti fájl neve a hibaüzenethez */
+    int shrink; /**< a kép kicsinyítésének mértéke beolvasáskor */
+    image_format format; /**< a kimenet formátuma */
+    PPM_Image image; /**< a kép, a beolvasó szál az első sáv előtt tölti ki */
+    int published; /**< a beolvasó szál által eddig továbbadott sorok száma */
+    long long block_began; /**< mikor kezdtük beolvasni a következő sávot, az idővonalhoz */
+    RowQueue parsed; /**< a beolvasott sávok */
+    RowQueue processed; /**< a kiírható sávok */
+} Pipeline;
+
+static void queue_init(RowQueue *queue) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->closed, false);
+}
+
+/**
+ * @brief várakozás a másik szálra: eleinte csak átadjuk a processzort, utána rövid ideig alszunk, hogy ne foglaljunk egy magot
+ * @param[in] *spins az eddigi várakozások száma
+ */
+static void queue_backoff(int *spins) {
+    if ((*spins)++ < 64)
+        sched_yield();
+    else
+        nanosleep(&(struct timespec) {0, 50000}, NULL);
+}
+
+/**
+ * @brief betesz egy sávot a sor végére, ha a sor tele van akkor megvárja amíg lesz hely
+ */
+static void queue_push(RowQueue *queue, RowBlock block) {
+    int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    int spins = 0;
+    while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == PIPELINE_QUEUE_SIZE)
+        queue_backoff(&spins);
+    queue->blocks[tail % PIPELINE_QUEUE_SIZE] = block;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
+
+/**
+ * @brief jelzi, hogy nem érkezik több sáv
+ */
+static void queue_close(RowQueue *queue) {
+    atomic_store_explicit(&queue->closed, true, memory_order_release);
+}
+
+/**
+ * @brief kiveszi a legrégebbi sávot, ha a sor üres akkor megvárja a következőt
+ * @param[in] *queue a sor
+ * @param[in] *block ide kerül a sáv
+ * @param[out] success false ha a sor le van zárva és üres
+ */
+static bool queue_pop(RowQueue *queue, RowBlock *block) {
+    int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    int spins = 0;
+    while (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+        /* a lezárás előtti utolsó sávot a lezárás után még egyszer meg kell nézni */
+        if (atomic_load_explicit(&queue->closed, memory_order_acquire)
+            && head == atomic_load_explicit(&queue->tail, memory_order_acquire))
+            return false;
+        queue_backoff(&spins);
+    }
+    *block = queue->blocks[head % PIPELINE_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief kiveszi a legrégebbi sávot, ha van, várakozás nélkül
+ * @param[in] *queue a sor
+ * @param[in] *block ide kerül a sáv
+ * @param[out] success false ha a sor éppen üres
+ */
+static bool queue_try_pop(RowQueue *queue, RowBlock *block) {
+    int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire))
+        return false;
+    *block = queue->blocks[head % PIPELINE_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief a beolvasás értesítése: ha összegyűlt egy sávnyi kész sor, továbbadja
+ * @see RowProgress
+ */
+static void rows_ready(PPM_Image *image, int rows, void *data) {
+    Pipeline *pipeline = (Pipeline *) data;
+    if (rows - pipeline->published < PIPELINE_BLOCK_ROWS && rows < image->size_y)
+        return;
+    trace_end_range("read_block", pipeline->block_began, pipeline->published, rows);
+    pipeline->block_began = trace_begin();
+    if (pipeline->published == 0)
+        pipeline->image = *image;
+    queue_push(&pipeline->parsed, (RowBlock) {pipeline->published, rows});
+    pipeline->published = rows;
+}
+
+/**
+ * @brief a beolvasó szál: beolvassa a képet és a kész sávokat továbbadja
+ * @param[in] *arg a Pipeline
+ *
+ * Ha a fájl a kép közepén véget ér, a hiányzó (fekete) sorokat a végén egyben adjuk tovább.
+ */
+static void *reader_thread(void *arg) {
+    Pipeline *pipeline = (Pipeline *) arg;
+    trace_thread_name("beolvasó");
+    pipeline->block_began = trace_begin();
+    RowProgress progress = {rows_ready, pipeline};
+    PPM_Image image;
+    if (!Image_ReadFrameProgress(pipeline->in, &image, pipeline->shrink, &progress)) {
+        fprintf(stderr, "üres fájl: %s\n", pipeline->in_fname);
+        abort();
+    }
+    if (pipeline->published < image.size_y) {
+        if (pipeline->published == 0)
+            pipeline->image = image;
+        queue_push(&pipeline->parsed, (RowBlock) {pipeline->published, image.size_y});
+        pipeline->published = image.size_y;
+    }
+    queue_close(&pipeline->parsed);
+    return NULL;
+}
+
+/**
+ * @brief az író szál: a kiírható sávokat sorrendben kiírja
+ * @param[in] *arg a Pipeline
+ *
+ * Az éppen várakozó sávokat egyben írjuk ki, így ha az író lemaradt, egy hívással több sort formázhat (pl. párhuzamosan a P3 kiírás).
+ */
+static void *writer_thread(void *arg) {
+    Pipeline *pipeline = (Pipeline *) arg;
+    trace_thread_name("író");
+    ImageWriter writer;
+    Image_WriteBegin(&writer, pipeline->out, &pipeline->image, pipeline->format);
+    RowBlock block, next;
+    while (queue_pop(&pipeline->processed, &block)) {
+        while (queue_try_pop(&pipeline->processed, &next))
+            block.last = next.last;
+        Image_WriteRows(&writer, &pipeline->image, block.first, block.last);
+    }
+    Image_WriteEnd(&writer);
+    fflush(pipeline->out);
+    return NULL;
+}
+
+/**
+ * @brief végrehajtja a lépéseket a kép egy sávján
+ * @param[in] func a lépések, NULL esetén nem csinál semmit
+ * @param[in] *image a kép
+ * @param[in] block a sáv
+ * @param[in] *data a func-nak átadott adat
+ */
+static void run_block(frame_func func, PPM_Image *image, RowBlock block, void *data) {
+    if (func == NULL)
+        return;
+    long long began = trace_begin();
+    PPM_Image part = *image;
+    part.image_data = image->image_data + block.first;
+    part.size_y = block.last - block.first;
+    func(&part, data);
+    trace_end_range("run_block", began, block.first, block.last);
+}
+
+/**
+ * @brief beolvassa, feldolgozza és kiírja a képet, a három lépést átfedésben végrehajtva
+ * @param[in] in_fname[] a bemeneti fájl
+ * @param[in] out_fname[] a kimeneti fájl
+ * @param[in] shrink a kép kicsinyítésének mértéke beolvasáskor, 1 esetén az eredeti méret
+ * @param[in] format a kimenet formátuma, mint az Image_WriteFrame-nél
+ * @param[in] *stages a végrehajtandó lépések
+ * @param[out] image a feldolgozott kép, már kiírva, a hívónak kell felszabadítania
+ *
+ * A kimenet bájtra ugyanaz, mintha a képet beolvasnánk, a lépéseket sorban végrehajtanánk, majd kiírnánk.
+ * @see PipelineStages
+ */
+PPM_Image pipeline_run(char in_fname[], char out_fname[], int shrink, image_format format, PipelineStages *stages) {
+    Pipeline pipeline;
+    pipeline.in_fname = in_fname;
+    pipeline.shrink = shrink;
+    pipeline.format = format;
+    pipeline.published = 0;
+
+    pipeline.in = fopen(in_fname, "rb");
+    if (pipeline.in == NULL) {
+        perror("error reading file");
+        abort();
+    }
+    pipeline.out = fopen(out_fname, "wb");
+    if (pipeline.out == NULL) {
+        perror("error writing file");
+        abort();
+    }
+
+    queue_init(&pipeline.parsed);
+    queue_init(&pipeline.processed);
+    /* a kernelek kiválasztása ne a szálak között versenyezzen */
+    isa_kernels();
+
+    pthread_t reader, writer;
+    pthread_create(&reader, NULL, reader_thread, &pipeline);
+
+    bool streaming = stages->whole == NULL;
+    bool first = true;
+    RowBlock block;
+    while (queue_pop(&pipeline.parsed, &block)) {
+        if (first) {
+            printf("Szélesség: %d\n", pipeline.image.size_x);
+            printf("Magasság: %d\n", pipeline.image.size_y);
+            if (streaming)
+                pthread_create(&writer, NULL, writer_thread, &pipeline);
+            first = false;
+        }
+        run_block(stages->read_rows, &pipeline.image, block, stages->data);
+        if (streaming) {
+            run_block(stages->write_rows, &pipeline.image, block, stages->data);
+            queue_push(&pipeline.processed, block);
+        }
+    }
+    pthread_join(reader, NULL);
+    fclose(pipeline.in);
+
+    if (!streaming) {
+        stages->whole(&pipeline.image, stages->data);
+        pthread_create(&writer, NULL, writer_thread, &pipeline);
+        for (int line = 0; line < pipeline.image.size_y; line += PIPELINE_BLOCK_ROWS) {
+            block.first = line;
+            block.last = (line + PIPELINE_BLOCK_ROWS < pipeline.image.size_y) ? line + PIPELINE_BLOCK_ROWS : pipeline.image.size_y;
+            run_block(stages->write_rows, &pipeline.image, block, stages->data);
+            queue_push(&pipeline.processed, block);
+        }
+    }
+    queue_close(&pipeline.processed);
+    pthread_join(writer, NULL);
+    fclose(pipeline.out);
+
+    return pipeline.image;
+}
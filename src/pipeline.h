@@ -0,0 +1,23 @@
+#ifndef PIPELINE
+#define PIPELINE
+
+#include "ppm.h"
+#include "imageio.h"
+#include "sequence.h"
+
+/**
+ * @brief a feldolgozás részei, a pipeline_run szerint csoportosítva
+ *
+ * A read_rows és a write_rows a kép egy sávján (a sorok egy részén) fut, ezért csak soronként független lépéseket tartalmazhat, amik a kép méretét és csatornáinak számát nem változtatják.
+ * @see pipeline_run
+ */
+typedef struct PipelineStages {
+    frame_func read_rows; /**< a beolvasással átfedésben futó lépések, NULL ha nincs ilyen */
+    frame_func whole; /**< a teljes képet igénylő lépések, NULL ha nincs ilyen, ekkor a sávok a read_rows után rögtön kiírhatók */
+    frame_func write_rows; /**< a whole utáni, a kiírással átfedésben futó lépések, NULL ha nincs ilyen */
+    void *data; /**< a függvényeknek átadott adat */
+} PipelineStages;
+
+PPM_Image pipeline_run(char in_fname[], char out_fname[], int shrink, image_format format, PipelineStages *stages);
+
+#endif
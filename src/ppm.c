@@ -1,181 +1,714 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "ppm.h"
+#include "isa.h"
+#include "parallel.h"
+#include "memusage.h"
 
 /**
  * @file
- * @brief PPM fájl beolvasása
+ * @brief PPM, PGM és PBM fájl beolvasása és kiírása
+ *
+ * A P1 (PBM), P2 (PGM) és P3 (PPM) szöveges, a P4, P5 és P6 ugyanezek bináris változata. A PGM szürkeárnyalatos, a PBM fekete-fehér bitkép, ahol az 1-es bit a fekete. Beolvasáskor mindegyikből RGB kép lesz, a kép magic-je megmarad, így kiíráskor ugyanabban a formátumban írjuk vissza.
  */
 
+#define SAMPLE_SATURATION 1000000 /**< a szöveges minták ennél nagyobbra nem nőnek beolvasáskor, a maxval-ra vágásig így nem csordulnak túl */
+
 /**
  * A kép tárolására használt 3 dimenziós tömb felszabadítása
  * @param[in] ***image felszabadítandó kép
  * @param[in] size_x a kép oszlopainak száma
  * @param[in] size_y a kép sorainak száma
+ * @see allocateimage_channels
  */
 void freeimage(unsigned char ***image, int size_x, int size_y) {
-    for (int i = 0; i < size_y; i++) {
-        for (int j = 0; j < size_x; j++) {
-            free(image[i][j]);
-        }
-        free(image[i]);
-    }
-    free(image);
+    if (image == NULL)
+        return;
+    if (size_x > 0 && size_y > 0)
+        mem_free(image[0][0]);
+    mem_free(image);
 }
 
 /**
- * @brief A kép tárolására használt 3 dimenziós tömb lefoglalása
+ * @brief a sorok és a pixelek mutatóinak mérete, túlcsordulás ellenőrzéssel
  * @param[in] size_x a kép oszlopainak száma
  * @param[in] size_y a kép sorainak száma
- * @param[out] image a létrehozott 3 dimenziós tömb
+ * @param[in] *bytes ide kerül a méret bájtban
+ * @param[out] success false ha a méret negatív, vagy nem fér el a size_t-ben
+ *
+ * Egy nagy kép pixeleinek száma már nem fér el az int-ben, ezért minden szorzást size_t-ben végzünk.
  */
-unsigned char ***allocateimage(int size_x, int size_y) {
+static bool table_bytes(int size_x, int size_y, size_t *bytes) {
+    size_t pointers;
+    return size_x >= 0 && size_y >= 0
+        && !__builtin_mul_overflow((size_t) size_x * size_y, sizeof(unsigned char *), &pointers)
+        && !__builtin_add_overflow(pointers, (size_t) size_y * sizeof(unsigned char **), bytes);
+}
+
+/**
+ * @brief A kép tárolására használt 3 dimenziós tömb lefoglalása a megadott számú színcsatornával
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] channels a színcsatornák száma (3: RGB, 1: szürkeárnyalatos)
+ * @param[out] image a létrehozott 3 dimenziós tömb, NULL ha nem sikerült lefoglalni, vagy a mérete nem fér el a memóriában
+ *
+ * A pixelek adatai egyetlen, sorfolytonos blokkban vannak, a sorok és a pixelek mutatói egy másikban. Így image[y][x] mindig az image[0][0] + (y*size_x + x)*channels címre mutat, tehát egy sort egyben is lehet kezelni, de a korábbi image[y][x][szín] indexelés is ugyanúgy működik.
+ * A pixelek mutatóit ezért soha nem szabad felcserélni, csak a pixelek tartalmát.
+ */
+unsigned char ***allocateimage_channels(int size_x, int size_y, int channels) {
     unsigned char ***image;
+    size_t table, pixels;
 
-    if ((image = (unsigned char***) malloc(size_y * sizeof(unsigned char**))) == NULL) {
+    if (!table_bytes(size_x, size_y, &table) || __builtin_mul_overflow((size_t) size_x * size_y, (size_t) channels, &pixels)) {
+        errno = ENOMEM;
         return NULL;
     }
-    for (int i=0; i < size_y; i++)
-        image[i] = NULL;
-    for (int i = 0; i < size_y; i++) {
-        if ((image[i] = (unsigned char**) malloc(size_x * sizeof(unsigned char*))) == NULL)
-            return NULL;
+    if ((image = (unsigned char***) mem_alloc(table)) == NULL) {
+        return NULL;
     }
+    unsigned char **row_pixels = (unsigned char **) (image + size_y);
 
+    // azért calloc mert feketére kell állítani, ha nincs elég pixel a fájlban
+    unsigned char *data = (unsigned char *) mem_calloc(pixels, sizeof(unsigned char));
+    if (data == NULL) {
+        mem_free(image);
+        return NULL;
+    }
+
+    unsigned char *pixel = data;
     for (int i = 0; i < size_y; i++) {
+        image[i] = row_pixels + (size_t) i * size_x;
         for (int j = 0; j < size_x; j++) {
-            image[i][j] = NULL;
+            image[i][j] = pixel;
+            pixel += channels;
         }
     }
+    return image;
+}
+
+/**
+ * @brief mennyi memóriát foglal az allocateimage_channels
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] channels a színcsatornák száma
+ * @param[out] bytes a sorok és a pixelek mutatói és a pixelek együtt, bájtban
+ *
+ * A mutatók pixelenként 8 bájtot foglalnak, ami RGB képnél is több, mint maguk a pixelek, ezért a memória becslésénél nem lehet elhanyagolni őket.
+ */
+long long image_bytes(int size_x, int size_y, int channels) {
+    return (long long) size_y * sizeof(unsigned char **) + (long long) size_y * size_x * (sizeof(unsigned char *) + channels);
+}
+
+/**
+ * @brief 3 dimenziós tömb egy már meglévő pixel pufferhez, a pixelek másolása nélkül
+ * @param[in] *pixels a puffer első sorának eleje
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[in] stride két egymás utáni sor kezdete közötti távolság bájtban (legalább size_x * channels)
+ * @param[in] channels a színcsatornák száma
+ * @param[out] image a sorok és a pixelek mutatói, NULL ha nem sikerült lefoglalni
+ *
+ * Csak a mutatókat foglaljuk le, ezért mem_free-vel kell felszabadítani, nem freeimage-dzsel. A sorokon belül a pixelek folytonosak, de a sorok között lehet kihagyás, ezért az így kapott képen csak soronként szabad a pixeleket egyben kezelni.
+ */
+unsigned char ***wrapimage(unsigned char *pixels, int size_x, int size_y, int stride, int channels) {
+    unsigned char ***image;
+    size_t table;
+
+    if (!table_bytes(size_x, size_y, &table)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if ((image = (unsigned char***) mem_alloc(table)) == NULL) {
+        return NULL;
+    }
+    unsigned char **row_pixels = (unsigned char **) (image + size_y);
 
     for (int i = 0; i < size_y; i++) {
+        image[i] = row_pixels + (size_t) i * size_x;
         for (int j = 0; j < size_x; j++) {
-            // azért calloc mert feketére kell állítani, ha nincs elég pixel a fájlban
-            if ((image[i][j] = (unsigned char*) calloc(3, sizeof(unsigned char))) == NULL)
-                return NULL;
+            image[i][j] = pixels + (size_t) i * stride + (size_t) j * channels;
         }
     }
     return image;
 }
 
 /**
- * @brief egy pixel értékeinek beállítása a kapott szó alapján
+ * @brief A kép tárolására használt 3 dimenziós tömb lefoglalása RGB képhez
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ * @param[out] image a létrehozott 3 dimenziós tömb
+ * @see allocateimage_channels
+ */
+unsigned char ***allocateimage(int size_x, int size_y) {
+    return allocateimage_channels(size_x, size_y, 3);
+}
+
+/**
+ * @brief lefoglal egy sorpuffert a beolvasáshoz
+ * @param[in] size a puffer mérete bájtban
+ * @param[out] buffer a puffer; ha nem sikerült lefoglalni (pl. a --max-memory korlát miatt), a program hibaüzenettel leáll, mint a kép lefoglalásánál
  *
- * A megkapott szót unsigned char-rá alakítja és beírja a képbe. Növeli az aktuális oszlop számát, és ha eléri a sorszélességet az aktuális sor számát is növeli. Az rgb értéket mindig növeli, de ha eléri a 3-at, átírja 0-ra. Ha az aktuális sor értéke megegyezik a kép sorainak számával az azt jelenti, hogy betelt a kép és megszakad a beolvasás.
+ * Csak a program beolvasó függvényei használják, amik hibás bemenetnél is leállnak. A kiírás a könyvtárból is elérhető, ezért ott a hívónak jelezzük a hibát.
+ */
+static void *buffer_alloc(size_t size) {
+    void *buffer = mem_alloc(size);
+    if (buffer == NULL) {
+        perror("error allocating buffer");
+        abort();
+    }
+    return buffer;
+}
+
+/**
+ * @brief átugorja a szóközöket és a kommenteket
+ * @param[in] *fp a fájl amiből olvasunk
+ * @param[out] c az első olyan karakter ami nem szóköz és nem komment része (EOF ha vége a fájlnak)
  *
- * @param[in] word[] a szó amit pixellé kell átalakítani
- * @param[in] *image PPM_Image kép aminek az image_data részébe kell beírni a pixelt
- * @param[in] *iter_h a sor, amibe írni kell a pixelt
- * @param[in] *iter_w az oszlop, amibe írni kell a pixelt
- * @param[in] *rgb megadja, hogy ez melyik szín
- * @param[out] ongoing true ha még mindig fér a képbe, false ha betelt
+ * A specifikáció szerint a # karaktertől a sor végéig tart a komment, bárhol is kezdődik.
+ */
+static int skipspace(FILE *fp) {
+    int c = getc_unlocked(fp);
+    while (c != EOF) {
+        if (c == '#') {
+            while (c != EOF && c != '\n')
+                c = getc_unlocked(fp);
+        }
+        else if (c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != '\v' && c != '\f')
+            break;
+        else
+            c = getc_unlocked(fp);
+    }
+    return c;
+}
+
+/**
+ * @brief beolvas egy nem negatív egész számot a fájlból
+ * @param[in] *fp a fájl amiből olvasunk
+ * @param[in] *value ide kerül a beolvasott szám
+ * @param[in] sample true esetén egy minta: a túl nagy szám SAMPLE_SATURATION fölé nem nő tovább (a hívó úgyis a maxval-ra vágja), false esetén (fejléc) a túlcsordulás hiba
+ * @param[out] success false ha vége a fájlnak, nem szám következik, vagy a fejléc egy száma nem fér el az int-ben
  *
- * @see PPM_Image
+ * A számot lezáró karaktert visszatesszük, így a P6 formátumnál a fejléc utáni egyetlen szóköz még olvasható marad.
+ */
+static bool readnumber(FILE *fp, int *value, bool sample) {
+    int c = skipspace(fp);
+    if (c < '0' || c > '9')
+        return false;
+    int number = 0;
+    while (c >= '0' && c <= '9') {
+        if (sample) {
+            if (number < SAMPLE_SATURATION)
+                number = number * 10 + (c - '0');
+        } else if (__builtin_mul_overflow(number, 10, &number) || __builtin_add_overflow(number, c - '0', &number))
+            return false;
+        c = getc_unlocked(fp);
+    }
+    if (c != EOF)
+        ungetc(c, fp);
+    *value = number;
+    return true;
+}
+
+/**
+ * @brief a pixelenként tárolt minták száma a fájlban
+ * @param[in] *image a kép fejléce
+ * @param[out] samples 3 a P3 és P6, 1 a többi formátum esetén
  */
-bool parsepixels(char word[], PPM_Image *image, int *iter_h, int *iter_w, int *rgb) {
-    int temp;
-    sscanf (word, "%d", &temp);
+static int file_channels(PPM_Image *image) {
+    return (image->magic[1] == '3' || image->magic[1] == '6') ? 3 : 1;
+}
+
+/**
+ * @brief beolvassa a kép egy sorát 8 bites mintákká alakítva
+ * @param[in] *fp a fájl amiből olvasunk
+ * @param[in] *image a kép fejléce (magic, size_x, maxval)
+ * @param[in] *raw a bináris formátumok nyers bájtjainak helye (size_x * 3 * bájt/minta méretű)
+ * @param[in] *row ide kerül a sor size_x * 3 mintája
+ * @param[out] success false ha a fájl a sor közepén véget ért, ekkor a sor hiányzó mintái 0-k
+ *
+ * A PGM és PBM sorok mintáit a sor utolsó harmadába olvassuk, majd elölről haladva mindhárom színbe átmásoljuk őket, így nem kell külön puffer.
+ */
+static bool readrow(FILE *fp, PPM_Image *image, unsigned char *raw, unsigned char *row) {
     // csak 8 bites képeket kezelünk. Mindent mást át kell alakítani.
-    image->image_data[*iter_h][*iter_w][*rgb] = (unsigned char) temp*(255.0f/image->maxval);
+    float scale = 255.0f/image->maxval;
+    int channels = file_channels(image);
+    int samples = image->size_x * channels;
+    unsigned char *target = row + image->size_x * 3 - samples;
+    int got = 0;
 
-    *rgb += 1;
-    if (*rgb == 3) {
-        *iter_w += 1;
-        *rgb = 0;
+    switch (image->magic[1]) {
+        case '1':
+            for (; got < samples; got++) {
+                int c = skipspace(fp);
+                if (c != '0' && c != '1')
+                    break;
+                target[got] = (c == '1') ? 0 : 255;
+            }
+            break;
+        case '4': {
+            int bytes = (image->size_x + 7) / 8;
+            int read = (int) fread(raw, 1, bytes, fp);
+            got = (read == bytes) ? samples : read * 8;
+            for (int i = 0; i < got; i++)
+                target[i] = (raw[i / 8] & (0x80 >> (i % 8))) ? 0 : 255;
+            break;
+        }
+        case '2':
+        case '3':
+            for (; got < samples; got++) {
+                int temp;
+                if (!readnumber(fp, &temp, true))
+                    break;
+                if (temp > image->maxval)
+                    temp = image->maxval;
+                target[got] = (unsigned char) (temp*scale);
+            }
+            break;
+        default: {
+            int bytes = (image->maxval < 256) ? 1 : 2;
+            got = (int) fread(raw, bytes, samples, fp);
+            isa_kernels()->scale_samples(raw, target, got, bytes, image->maxval);
+            break;
+        }
     }
-    if (*iter_w == image->size_x) {
-        *iter_w = 0;
-        *iter_h += 1;
+    memset(target + got, 0, samples - got);
+
+    if (channels == 1) {
+        for (int col = 0; col < image->size_x; col++) {
+            unsigned char value = target[col];
+            for (int color = 0; color < 3; color++)
+                row[col*3 + color] = value;
+        }
     }
-    if (*iter_h == image->size_y)
-        return false;
-    return true;
+    return got == samples;
 }
 
 /**
- * @brief Eldönti, hogy mit kell kezdeni a kapott szóval.
- * Először azt nézi meg, hogy van-e magic. Ha nincs ezt kell beállítani. Majd sorban a sorszámot, oszlopszámot és a maxvalt. Ha megvan az oszlopszám, le lehet foglalni a kép tömbjét. Ezek után a maradék biztosan pixel érték lesz.
+ * @brief beolvassa a kép fejlécét: a magic-et, az oszlopok és a sorok számát és a maxval-t
+ * @param[in] *fp a megnyitott fájl, a kép elejére állva
+ * @param[in] *image ide kerülnek a fejléc adatai, a pixeleket nem foglaljuk le
+ * @param[out] status ppm_ok ha sikerült, ppm_end ha nincs több kép a fájlban, különben a hiba oka
  *
- * @param[in] word[] a szó amit le kell ellenőrizni
- * @param[in] *image PPM_Image kép aminek az image_data részébe kell beírni a pixelt
- * @param[in] *iter_h a sor, amibe írni kell a pixelt
- * @param[in] *iter_w az oszlop, amibe írni kell a pixelt
- * @param[in] *rgb megadja, hogy ez melyik szín
+ * A PBM fájloknak nincs maxval-ja, ezeknél 1-et tárolunk. A bináris formátumoknál a fejléc utáni egyetlen szóközt is beolvassuk, így utána közvetlenül a pixelek következnek.
+ */
+ppm_status PPM_ReadHeader(FILE *fp, PPM_Image *image) {
+    int c = skipspace(fp);
+    if (c == EOF)
+        return ppm_end;
+
+    image->magic[0] = c;
+    image->magic[1] = getc_unlocked(fp);
+    image->magic[2] = '\0';
+    if (image->magic[0] != 'P' || image->magic[1] < '1' || image->magic[1] > '6')
+        return ppm_bad_magic;
+    bool bitmap = image->magic[1] == '1' || image->magic[1] == '4';
+
+    int size_x = 0, size_y = 0;
+    image->maxval = 1;
+    if (!readnumber(fp, &size_x, false) || !readnumber(fp, &size_y, false) || (!bitmap && !readnumber(fp, &image->maxval, false))
+        || size_x <= 0 || size_y <= 0 || image->maxval <= 0 || image->maxval > 65535)
+        return ppm_bad_header;
+
+    // P4-P6: a fejléc után pontosan egy szóköz jön, utána a bináris adat
+    if (image->magic[1] >= '4')
+        getc_unlocked(fp);
+
+    image->size_x = size_x;
+    image->size_y = size_y;
+    image->channels = 3;
+    image->image_data = NULL;
+    return ppm_ok;
+}
+
+/**
+ * @brief beolvassa a kép pixeleit a fejléc után, a megadott sorokba
+ * @param[in] *fp a megnyitott fájl, a fejléc után állva
+ * @param[in] *image a kép fejléce (PPM_ReadHeader)
+ * @param[in] ***dst a kép sorai, soronként size_x * 3 folytonos bájttal (pl. allocateimage vagy wrapimage)
+ * @param[out] status ppm_ok ha minden pixel megvolt, ppm_truncated ha a fájl a kép közepén véget ért (a hiányzó pixelek feketék), ppm_no_memory ha nem sikerült lefoglalni a sorpuffert
+ */
+ppm_status PPM_ReadPixels(FILE *fp, PPM_Image *image, unsigned char ***dst) {
+    int bytes = (image->maxval < 256) ? 1 : 2;
+    unsigned char *raw = (unsigned char *) mem_alloc(image->size_x * 3 * bytes);
+    if (raw == NULL)
+        return ppm_no_memory;
+
+    bool complete = true;
+    for (int line = 0; line < image->size_y; line++) {
+        if (complete)
+            complete = readrow(fp, image, raw, dst[line][0]);
+        else
+            memset(dst[line][0], 0, image->size_x * 3);
+    }
+    mem_free(raw);
+    return complete ? ppm_ok : ppm_truncated;
+}
+
+/**
+ * @brief beolvassa egy kép sorait a megadott mértékben kicsinyítve, a formátumtól függetlenül
+ * @param[in] *fp a megnyitott fájl, a pixelek elejére állva
+ * @param[in] *image a kép fejléce (size_x, size_y), ide kerülnek a pixelek és a kicsinyített méret
+ * @param[in] shrink a kicsinyítés mértéke, 1 esetén az eredeti méretben olvassuk be
+ * @param[in] read a formátum egy sorát size_x * 3 mintává alakító függvény
+ * @param[in] *state a read saját adatai
+ * @param[in] *progress minden elkészült (kicsinyített) sor után értesítjük, NULL ha nem kell
+ * @param[out] complete false ha a fájl a kép közepén véget ért, ekkor a hiányzó pixelek feketék
  *
- * @see allocateimage
- * @see parsepixels
+ * Kicsinyítésnél a shrink x shrink méretű blokkok pixeleinek átlaga lesz egy pixel (a jobb és az alsó szélen a csonka blokkoké), és csak a kicsinyített képet foglaljuk le, a beolvasott sorokat egy soronkénti összegző tömbbe gyűjtjük.
+ * Ha a fájl a kép közepén véget ér, a hiányzó sorokról már nem értesítünk.
+ * @see row_reader
  */
-void parseword(char word[], PPM_Image *image,  int *iter_h, int *iter_w, int *rgb) {
+bool readimage_scaled(FILE *fp, PPM_Image *image, int shrink, row_reader read, void *state, RowProgress *progress) {
+    int size_x = image->size_x;
+    int size_y = image->size_y;
+    int out_x = (size_x + shrink - 1) / shrink;
+    int out_y = (size_y + shrink - 1) / shrink;
+    image->channels = 3;
+    image->image_data = allocateimage(out_x, out_y);
+    if (image->image_data == NULL) {
+        perror("error allocating image");
+        abort();
+    }
 
-    if (image->magic[0] == '0') {
-        strcpy(image->magic, word);
-        return;
+    /* az értesítésben már a kicsinyített méret szerepel, a read-nek viszont még az eredeti kell */
+    PPM_Image result = *image;
+    result.size_x = out_x;
+    result.size_y = out_y;
+
+    bool complete = true;
+    if (shrink == 1) {
+        /* a sorok folytonosak, így közvetlenül a képbe olvashatunk, a hiányzó sorok a calloc miatt feketék */
+        for (int line = 0; complete && line < size_y; line++) {
+            complete = read(fp, image, state, image->image_data[line][0]);
+            if (complete && progress != NULL)
+                progress->ready(&result, line + 1, progress->data);
+        }
+        return complete;
     }
-    if (strcmp(image->magic, "P3") == 0) {
-        //P3 filetype
-        if (image->size_x == 0) {
-            sscanf (word, "%d", &image->size_x);
-            return;
+
+    unsigned char *row = (unsigned char *) buffer_alloc(size_x * 3);
+    int *sums = (int *) buffer_alloc(out_x * 3 * sizeof(int));
+    memset(sums, 0, out_x * 3 * sizeof(int));
+
+    for (int line = 0; line < size_y; line++) {
+        if (complete)
+            complete = read(fp, image, state, row);
+        else
+            memset(row, 0, size_x * 3);
+
+        for (int col = 0; col < size_x; col++) {
+            for (int color = 0; color < 3; color++)
+                sums[(col / shrink) * 3 + color] += row[col * 3 + color];
+        }
+        if (line % shrink == shrink - 1 || line == size_y - 1) {
+            int rows = line % shrink + 1;
+            for (int col = 0; col < out_x; col++) {
+                int count = rows * ((col == out_x - 1) ? size_x - col * shrink : shrink);
+                for (int color = 0; color < 3; color++)
+                    image->image_data[line / shrink][col][color] = (sums[col * 3 + color] + count / 2) / count;
+            }
+            memset(sums, 0, out_x * 3 * sizeof(int));
+            if (complete && progress != NULL)
+                progress->ready(&result, line / shrink + 1, progress->data);
         }
-        if (image->size_y == 0) {
-            sscanf (word, "%d", &image->size_y);
-            image->image_data = allocateimage(image->size_x, image->size_y);
-            return;
+    }
+    mem_free(sums);
+    mem_free(row);
+
+    image->size_x = out_x;
+    image->size_y = out_y;
+    return complete;
+}
+
+#define PARSE_CHUNK (64 * 1024) /**< a szöveges képek párhuzamos beolvasásánál egy darab legkisebb mérete bájtban */
+
+/**
+ * @brief a szöveges pixeladatok egy darabja a párhuzamos beolvasáshoz
+ */
+typedef struct TextChunk {
+    const char *start; /**< a darab eleje, mindig egy sor eleje */
+    const char *end; /**< a darab vége, egy sorvége után */
+    int tokens; /**< a darabban lévő számok száma (egy nem szám karakterig) */
+    const char *stop; /**< az első olyan karakter után, ami nem szám, szóköz vagy komment, NULL ha nincs ilyen */
+    long long first; /**< a darab első számának sorszáma a képben */
+} TextChunk;
+
+/**
+ * @brief a párhuzamos beolvasás közös adatai
+ */
+typedef struct TextParse {
+    TextChunk *chunks; /**< a darabok */
+    PPM_Image *image; /**< a kép fejléce és a lefoglalt pixelek */
+    long long samples; /**< a képhez szükséges számok száma */
+    const char *consumed; /**< az utolsó szükséges szám vége, ezt a dekódoló szál állítja be */
+} TextParse;
+
+/**
+ * @brief végigolvassa a darabot, és megszámolja vagy a képbe írja a számokat
+ * @param[in] *chunk a darab
+ * @param[in] *parse a közös adatok
+ * @param[in] decode false esetén csak megszámoljuk a számokat, true esetén a képbe írjuk őket a chunk->first sorszámtól
+ *
+ * A szóközöket és a kommenteket ugyanúgy kezeljük, mint a skipspace és a readnumber, így az eredmény ugyanaz, mintha sorban olvasnánk be.
+ */
+static void scan_chunk(TextChunk *chunk, TextParse *parse, bool decode) {
+    PPM_Image *image = parse->image;
+    unsigned char *pixels = image->image_data[0][0];
+    bool gray = file_channels(image) == 1;
+    float scale = 255.0f/image->maxval;
+    long long index = chunk->first;
+    int tokens = 0;
+
+    const char *p = chunk->start;
+    while (p < chunk->end) {
+        char c = *p;
+        if (c == '#') {
+            while (p < chunk->end && *p != '\n')
+                p++;
+            continue;
         }
-        if (image->maxval == 0) {
-            sscanf (word, "%d", &image->maxval);
-            return;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') {
+            p++;
+            continue;
         }
-        if (!parsepixels(word, image, iter_h, iter_w, rgb)) {
-            return;
+        if (c < '0' || c > '9') {
+            if (!decode)
+                chunk->stop = p + 1;
+            break;
+        }
+        int number = 0;
+        while (p < chunk->end && *p >= '0' && *p <= '9') {
+            /* a maxval-nál nagyobb számokat úgyis levágjuk, csak a túlcsordulást kell elkerülni, mint a readnumber */
+            if (number < SAMPLE_SATURATION)
+                number = number * 10 + (*p - '0');
+            p++;
+        }
+        tokens++;
+        if (!decode)
+            continue;
+
+        if (number > image->maxval)
+            number = image->maxval;
+        unsigned char value = (unsigned char) (number*scale);
+        if (gray)
+            memset(pixels + index * 3, value, 3);
+        else
+            pixels[index] = value;
+        if (++index == parse->samples) {
+            parse->consumed = p;
+            break;
         }
     }
+    if (!decode)
+        chunk->tokens = tokens;
+}
+
+static void count_chunks(int first, int last, void *data) {
+    TextParse *parse = (TextParse *) data;
+    for (int i = first; i < last; i++)
+        scan_chunk(&parse->chunks[i], parse, false);
+}
+
+static void decode_chunks(int first, int last, void *data) {
+    TextParse *parse = (TextParse *) data;
+    for (int i = first; i < last; i++) {
+        if (parse->chunks[i].first < parse->samples)
+            scan_chunk(&parse->chunks[i], parse, true);
+    }
 }
 
 /**
- * @brief Eldönti, hogy a megadott sor mit tartalmaz és mit kell vele csinálni
- * Ha comment akkor kimarad, egyébként szóközönként fel kell bontani. Ezek lesznek a szavak, amiket utána tovább kell kategorizálni.
- * @param[in] line[] a sor amit vizsgálni kell
- * @param[in] *image PPM_Image kép aminek az image_data részébe kell beírni a pixelt
- * @param[in] *iter_h a sor, amibe írni kell a pixelt
- * @param[in] *iter_w az oszlop, amibe írni kell a pixelt
- * @param[in] *rgb megadja, hogy ez melyik szín
+ * @brief a szöveges (P2, P3) képek pixeleinek párhuzamos beolvasása egy fájlból
+ * @param[in] *fp a megnyitott fájl, a fejléc után állva
+ * @param[in] *image a kép fejléce, ide kerülnek a pixelek
+ * @param[in] *progress a végén egyszerre értesítjük az összes kész sorról, NULL ha nem kell
+ * @param[out] success false ha a fájl nem képezhető le a memóriába (pl. standard bemenet), túl kicsi ahhoz, hogy megérje, vagy nem sikerült lefoglalni a munkaterületet; ekkor a fájlból még nem olvastunk, és a kép nincs lefoglalva
  *
- * @see parseword
+ * A fájl fejléc utáni részét memóriába képezzük és PARSE_CHUNK méretű darabokra vágjuk. A darabok mindig egy sor elején kezdődnek, így sem szám, sem komment nem lóghat át két darab között (a komment a sor végéig tart).
+ * A darabokat csoportonként, párhuzamosan számoljuk meg, amíg meg nem lesz a képhez szükséges összes szám, így egymás után fűzött képeknél csak az aktuális kép darabjait olvassuk végig, nem a fájl egész hátralévő részét. A csoport méretét a még hiányzó számokból becsüljük (számonként legalább két karakter).
+ * A darabok számainak összegeiből megkapjuk, hogy melyik darab hányadik mintától kezdődik, majd újra párhuzamosan, közvetlenül a képbe írjuk a számokat.
+ * A fájlban az utolsó szükséges szám után folytatjuk, így egymás után fűzött képek is beolvashatók. Ha a fájl a kép közepén véget ér, a hiányzó pixelek feketék maradnak.
  */
+static bool readimage_text_parallel(FILE *fp, PPM_Image *image, RowProgress *progress) {
+    struct stat info;
+    off_t offset = ftello(fp);
+    if (offset < 0 || fstat(fileno(fp), &info) != 0 || !S_ISREG(info.st_mode) || info.st_size - offset < 2 * PARSE_CHUNK)
+        return false;
+    const char *map = (const char *) mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (map == MAP_FAILED)
+        return false;
+    madvise((void *) map, info.st_size, MADV_SEQUENTIAL);
 
-void checktype(char line[], PPM_Image *image, int *iter_h, int *iter_w, int *rgb) {
-    if (line[0] == '#')
-        // comment
-        return;
-    char *token;
+    image->channels = 3;
+    image->image_data = allocateimage(image->size_x, image->size_y);
+    if (image->image_data == NULL) {
+        perror("error allocating image");
+        abort();
+    }
 
-    token = strtok(line, " ");
+    const char *data = map + offset;
+    const char *data_end = map + info.st_size;
+    TextParse parse;
+    parse.chunks = NULL;
+    parse.image = image;
+    parse.samples = (long long) image->size_x * image->size_y * file_channels(image);
+    parse.consumed = NULL;
 
-    while( token != NULL ) {
-        if (strcmp(token, "#") == 0 || strstr(token, "#") != NULL)
-            // sorközi komment
-            return;
-        parseword(token, image, iter_h, iter_w, rgb);
-        token = strtok(NULL, " ");
-   }
+    /* a darabok határát a következő sorvége utánra toljuk, hosszú sorok esetén így kevesebb darab lesz */
+    int chunks = 0;
+    int capacity = 0;
+    long long available = 0;
+    const char *stop = NULL;
+    const char *start = data;
+    while (stop == NULL && available < parse.samples && start < data_end) {
+        long long missing = (parse.samples - available) * 2 / PARSE_CHUNK + 1;
+        int batch = (missing < 4 * parallel_threads()) ? 4 * parallel_threads() : (int) ((missing < INT_MAX / 4) ? missing : INT_MAX / 4);
+        if (chunks + batch > capacity) {
+            int grown = (chunks + batch > 2 * capacity) ? chunks + batch : 2 * capacity;
+            TextChunk *larger = (TextChunk *) mem_alloc((size_t) grown * sizeof(TextChunk));
+            if (larger == NULL) {
+                mem_free(parse.chunks);
+                freeimage(image->image_data, image->size_x, image->size_y);
+                image->image_data = NULL;
+                munmap((void *) map, info.st_size);
+                return false;
+            }
+            if (chunks > 0)
+                memcpy(larger, parse.chunks, chunks * sizeof(TextChunk));
+            mem_free(parse.chunks);
+            parse.chunks = larger;
+            capacity = grown;
+        }
+
+        int first = chunks;
+        while (chunks < first + batch && start < data_end) {
+            const char *end = start + PARSE_CHUNK;
+            if (end >= data_end)
+                end = data_end;
+            else {
+                end = memchr(end, '\n', data_end - end);
+                end = (end == NULL) ? data_end : end + 1;
+            }
+            parse.chunks[chunks] = (TextChunk) {start, end, 0, NULL, 0};
+            chunks++;
+            start = end;
+        }
+
+        TextParse counted = parse;
+        counted.chunks += first;
+        parallel_rows(chunks - first, count_chunks, &counted);
+
+        /* az első nem szám karakter után már semmit nem olvasunk be, mint a readnumber */
+        for (int i = first; i < chunks; i++) {
+            parse.chunks[i].first = (stop == NULL) ? available : parse.samples;
+            if (stop == NULL) {
+                available += parse.chunks[i].tokens;
+                stop = parse.chunks[i].stop;
+            }
+        }
+    }
+
+    parallel_rows(chunks, decode_chunks, &parse);
+
+    const char *consumed = (available >= parse.samples) ? parse.consumed : (stop != NULL) ? stop : data_end;
+    fseeko(fp, offset + (consumed - data), SEEK_SET);
+    mem_free(parse.chunks);
+    munmap((void *) map, info.st_size);
+
+    long long row_samples = (long long) image->size_x * file_channels(image);
+    int rows = (available >= parse.samples) ? image->size_y : (int) (available / row_samples);
+    if (progress != NULL && rows > 0)
+        progress->ready(image, rows, progress->data);
+    return true;
 }
 
 /**
- * @brief beolvas egy képet
- * Megnyitja a fájlt, majd létrehozza a PPM_Image struktúra egy példányát és beállítja a kezdő értékeit. Ezek után maximum 4096 karakter hosszú soronként beolvassa a fájlt és átadja a checktype -nak. Végül bezárja a fájlt.
- * @param[in] filename[] ezt a fájlt fogja megnyitni
+ * @brief a PPM egy sora a readimage_scaled számára, a state a P6 nyers bájtjainak helye
+ */
+static bool ppm_row(FILE *fp, PPM_Image *image, void *state, unsigned char *row) {
+    return readrow(fp, image, (unsigned char *) state, row);
+}
+
+/**
+ * @brief beolvas egy képet egy már megnyitott fájlból, a megadott mértékben kicsinyítve
+ *
+ * Először a magic-et olvassuk be, ami P1-P3 (szöveges) vagy P4-P6 (bináris) lehet, majd az oszlopok, a sorok számát és a maxvalt. Ezek után lefoglaljuk a képet és soronként beolvassuk a pixeleket. A P5 és P6 formátumban a minták 255-nél nagyobb maxval esetén két bájtosak.
+ * Pontosan egy kép adatait olvassuk be, így egymás után fűzött képeket (pl. ffmpeg -f image2pipe -vcodec ppm kimenete) is egyenként be lehet olvasni. Ha a fájl a kép közepén véget ér, a hiányzó pixelek feketék maradnak.
+ * @param[in] *fp a megnyitott fájl
+ * @param[in] *image ebbe a PPM_Image-be kerül a kép
+ * @param[in] shrink a kicsinyítés mértéke, 1 esetén az eredeti méretben olvassuk be
+ * @param[out] success false ha nincs több kép a fájlban
  *
- * @see checktype
  * @see PPM_Image
+ * @see readimage_scaled
+ */
+bool PPM_ReadFrameScaled(FILE *fp, PPM_Image *image, int shrink) {
+    return PPM_ReadFrameProgress(fp, image, shrink, NULL);
+}
+
+/**
+ * @brief mint a PPM_ReadFrameScaled, de a beolvasás közben értesít az elkészült sorokról
+ * @param[in] *progress az értesítés, NULL ha nem kell
+ * @see RowProgress
  */
+bool PPM_ReadFrameProgress(FILE *fp, PPM_Image *image, int shrink, RowProgress *progress) {
+    switch (PPM_ReadHeader(fp, image)) {
+        case ppm_end:
+            return false;
+        case ppm_bad_magic:
+            fprintf(stderr, "ismeretlen képformátum: %s\n", image->magic);
+            abort();
+        case ppm_bad_header:
+            fprintf(stderr, "hibás PPM fejléc\n");
+            abort();
+        default:
+            break;
+    }
 
-PPM_Image PPM_Parser(char filename[]) {
+    /* a nagy szöveges képeket párhuzamosan olvassuk be, ha a fájl a memóriába képezhető */
+    bool text = image->magic[1] == '2' || image->magic[1] == '3';
+    if (shrink == 1 && text && readimage_text_parallel(fp, image, progress))
+        return true;
+
+    int bytes = (image->maxval < 256) ? 1 : 2;
+    unsigned char *raw = (unsigned char *) buffer_alloc(image->size_x * 3 * bytes);
+    readimage_scaled(fp, image, shrink, ppm_row, raw, progress);
+    mem_free(raw);
+    return true;
+}
+
+/**
+ * @brief beolvas egy képet egy már megnyitott fájlból
+ * @param[in] *fp a megnyitott fájl
+ * @param[in] *image ebbe a PPM_Image-be kerül a kép
+ * @param[out] success false ha nincs több kép a fájlban
+ * @see PPM_ReadFrameScaled
+ */
+bool PPM_ReadFrame(FILE *fp, PPM_Image *image) {
+    return PPM_ReadFrameScaled(fp, image, 1);
+}
+
+/**
+ * @brief beolvas egy képet, a megadott mértékben kicsinyítve
+ * Megnyitja a fájlt, beolvassa belőle az első képet a PPM_ReadFrameScaled segítségével, majd bezárja a fájlt.
+ * @param[in] filename[] ezt a fájlt fogja megnyitni
+ * @param[in] shrink a kicsinyítés mértéke, 1 esetén az eredeti méretben olvassuk be
+ *
+ * @see PPM_ReadFrameScaled
+ * @see PPM_Image
+ */
+PPM_Image PPM_ParserScaled(char filename[], int shrink) {
     FILE *fp;
-    fp = fopen(filename, "r");
+    fp = fopen(filename, "rb");
 
     PPM_Image image;
 
@@ -185,21 +718,11 @@ PPM_Image PPM_Parser(char filename[]) {
         return image;
     }
 
-    strcpy(image.magic, "00");
-    image.size_x = 0;
-    image.size_y = 0;
-    image.maxval = 0;
-    int iter_h = 0;
-    int iter_w = 0;
-    int rgb = 0;
-    char line[4096]; /* a specifikáció szerint maximum 70 karakter lehetne egy sorban, de az ImageMagick többet tesz bele, ezért maximum 4096 lesz a mérete */
-
-    while((fscanf(fp, "%[^\n]", line)) != EOF) {
-        fgetc(fp);
-        checktype(line, &image, &iter_h, &iter_w, &rgb);
+    if (!PPM_ReadFrameScaled(fp, &image, shrink)) {
+        fprintf(stderr, "üres fájl: %s\n", filename);
+        abort();
     }
 
-
     //printf("magic: %s\n", image.magic);
     printf("Szélesség: %d\n", image.size_x);
     printf("Magasság: %d\n", image.size_y);
@@ -209,31 +732,327 @@ PPM_Image PPM_Parser(char filename[]) {
     return image;
 }
 
+/**
+ * @brief beolvas egy képet
+ * @param[in] filename[] ezt a fájlt fogja megnyitni
+ * @see PPM_ParserScaled
+ */
+PPM_Image PPM_Parser(char filename[]) {
+    return PPM_ParserScaled(filename, 1);
+}
+
+/**
+ * @brief egy pixel szürkeárnyalatos értéke a PGM és PBM kiíráshoz
+ * @param[in] *image a kép
+ * @param[in] line a pixel sora
+ * @param[in] col a pixel oszlopa
+ * @param[out] value egycsatornás képnél a pixel értéke, RGB képnél a grayscale_image-dzsel azonos súlyozású átlag
+ */
+static unsigned char gray_value(PPM_Image *image, int line, int col) {
+    unsigned char *pixel = image->image_data[line][col];
+    if (image->channels == 1)
+        return pixel[0];
+    return pixel[0] * 0.2989 + pixel[1] * 0.5870 + pixel[2] * 0.1140;
+}
+
+/**
+ * @brief PBM (P1 vagy P4) pixelek kiírása, a 128-nál sötétebb pixelek lesznek feketék
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép
+ * @param[in] first az első kiírandó sor
+ * @param[in] last az utolsó utáni kiírandó sor
+ * @param[in] binary true esetén P4: soronként 8 pixel egy bájtban, a sorok bájthatáron kezdődnek
+ *
+ * @param[out] success false ha nem sikerült lefoglalni a sorpuffert, ekkor semmit nem írtunk ki
+ *
+ * Egycsatornás maszkból (pl. élkeresés) közvetlenül a bitekbe csomagoljuk a pixeleket. P1 esetén a sorok a szabvány szerint legfeljebb 70 karakteresek.
+ */
+static bool write_bitmap(FILE *fp, PPM_Image *image, int first, int last, bool binary) {
+    int bytes = (image->size_x + 7) / 8;
+    unsigned char *row = (unsigned char *) mem_alloc(binary ? bytes : image->size_x + image->size_x / 70 + 1);
+    if (row == NULL)
+        return false;
+    for (int line = first; line < last; line++) {
+        int length = 0;
+        if (binary) {
+            memset(row, 0, bytes);
+            for (int col = 0; col < image->size_x; col++) {
+                if (gray_value(image, line, col) < 128)
+                    row[col / 8] |= 0x80 >> (col % 8);
+            }
+            length = bytes;
+        }
+        else {
+            for (int col = 0; col < image->size_x; col++) {
+                row[length++] = (gray_value(image, line, col) < 128) ? '1' : '0';
+                if (col % 70 == 69 || col == image->size_x - 1)
+                    row[length++] = '\n';
+            }
+        }
+        fwrite(row, 1, length, fp);
+    }
+    mem_free(row);
+    return true;
+}
+
+#define FORMAT_ROUND_BYTES (4 * 1024 * 1024) /**< a szöveges kiírásnál egy menetben legfeljebb ennyi bájtnyi sort formázunk meg */
+#define WRITE_VECTORS 16 /**< egy writev hívással legfeljebb ennyi sort írunk ki (a POSIX által garantált legkisebb IOV_MAX) */
+
+/**
+ * @brief a szöveges (P2, P3) kiírás egy menetének adatai
+ */
+typedef struct TextWrite {
+    PPM_Image *image; /**< a kiírandó kép */
+    int first; /**< a menet első sora a képben */
+    int row_max; /**< egy megformázott sor legnagyobb mérete, a sorok ilyen távolságra kezdődnek a pufferben */
+    char *buffer; /**< a megformázott sorok helye */
+    int *lengths; /**< a megformázott sorok hossza */
+} TextWrite;
+
+/**
+ * @brief egy minta szöveges alakja, ugyanaz mint a "%d" és utána az elválasztó
+ * @param[in] *out ide írunk
+ * @param[in] value a minta
+ * @param[in] separator a minta után írt karakter
+ * @param[out] end a kiírt karakterek után
+ */
+static inline char *format_sample(char *out, unsigned char value, char separator) {
+    if (value >= 100)
+        *out++ = '0' + value / 100;
+    if (value >= 10)
+        *out++ = '0' + value / 10 % 10;
+    *out++ = '0' + value % 10;
+    *out++ = separator;
+    return out;
+}
+
+/**
+ * @brief megformázza a menet [first, last) sorait a saját helyükre
+ * @see parallel_rows
+ */
+static void format_rows(int first, int last, void *data) {
+    TextWrite *job = (TextWrite *) data;
+    PPM_Image *image = job->image;
+    bool gray = image->magic[1] == '2';
+    int channel_step = (image->channels == 1) ? 0 : 1;
+
+    for (int row = first; row < last; row++) {
+        int line = job->first + row;
+        char *start = job->buffer + (size_t) row * job->row_max;
+        char *out = start;
+        for (int col = 0; col < image->size_x; col++) {
+            if (gray) {
+                out = format_sample(out, gray_value(image, line, col), '\n');
+                continue;
+            }
+            unsigned char *pixel = image->image_data[line][col];
+            for (int color = 0; color < 3; color++)
+                out = format_sample(out, pixel[color * channel_step], ' ');
+            *out++ = '\n';
+        }
+        job->lengths[row] = (int) (out - start);
+    }
+}
+
+/**
+ * @brief sorrendben kiírja a megformázott sorokat
+ * @param[in] *fp a kimeneti fájl
+ * @param[in] *job a menet, a sorai már meg vannak formázva
+ * @param[in] rows a menet sorainak száma
+ *
+ * Ha a fájlnak van leírója, a FILE pufferének kiürítése után writev hívásokkal (egyszerre WRITE_VECTORS sort) írjuk ki a sorokat, különben (pl. a könyvtár memóriába író FILE-jánál) soronként fwrite-tal.
+ */
+static void emit_rows(FILE *fp, TextWrite *job, int rows) {
+    int fd = fileno(fp);
+    if (fd < 0) {
+        for (int row = 0; row < rows; row++)
+            fwrite(job->buffer + (size_t) row * job->row_max, 1, job->lengths[row], fp);
+        return;
+    }
+
+    fflush(fp);
+    struct iovec vectors[WRITE_VECTORS];
+    int row = 0;
+    while (row < rows) {
+        int count = 0;
+        while (count < WRITE_VECTORS && row + count < rows) {
+            vectors[count].iov_base = job->buffer + (size_t) (row + count) * job->row_max;
+            vectors[count].iov_len = job->lengths[row + count];
+            count++;
+        }
+        /* a writev kevesebbet is kiírhat, ekkor a maradékkal folytatjuk */
+        int done = 0;
+        while (done < count) {
+            ssize_t written = writev(fd, vectors + done, count - done);
+            if (written < 0) {
+                perror("error writing file");
+                return;
+            }
+            while (done < count && (size_t) written >= vectors[done].iov_len) {
+                written -= vectors[done].iov_len;
+                done++;
+            }
+            if (done < count) {
+                vectors[done].iov_base = (char *) vectors[done].iov_base + written;
+                vectors[done].iov_len -= written;
+            }
+        }
+        row += count;
+    }
+}
+
+/**
+ * @brief P3 vagy P2 pixelek kiírása, a sorokat párhuzamosan formázva
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép, P2 esetén a szürkeárnyalatos változatát írjuk ki
+ * @param[in] first az első kiírandó sor
+ * @param[in] last az utolsó utáni kiírandó sor
+ *
+ * A kimenet bájtra ugyanaz, mintha mintánként "%d "-t (P2 esetén "%d\n"-t) írnánk. A sorok hossza a pixelektől függ, ezért minden sort egy a lehető leghosszabb sornak elég helyre formázunk, így a sorok egymástól függetlenül, párhuzamosan formázhatók. A sorokat menetenként (legfeljebb FORMAT_ROUND_BYTES) formázzuk meg és írjuk ki, így a puffer mérete nem függ a kép méretétől.
+ * @param[out] success false ha nem sikerült lefoglalni a puffert, ekkor semmit nem írtunk ki
+ * @see format_rows
+ * @see emit_rows
+ */
+static bool write_text_rows(FILE *fp, PPM_Image *image, int first, int last) {
+    TextWrite job;
+    job.image = image;
+    job.row_max = image->size_x * ((image->magic[1] == '2') ? 4 : 13);
+    int round = FORMAT_ROUND_BYTES / job.row_max;
+    if (round < 1)
+        round = 1;
+    if (round > last - first)
+        round = last - first;
+    if (round < 1)
+        return true;
+    job.buffer = (char *) mem_alloc((size_t) round * job.row_max);
+    job.lengths = (int *) mem_alloc(round * sizeof(int));
+    if (job.buffer == NULL || job.lengths == NULL) {
+        mem_free(job.lengths);
+        mem_free(job.buffer);
+        return false;
+    }
+
+    for (job.first = first; job.first < last; job.first += round) {
+        int rows = (last - job.first < round) ? last - job.first : round;
+        parallel_rows(rows, format_rows, &job);
+        emit_rows(fp, &job, rows);
+    }
+    mem_free(job.lengths);
+    mem_free(job.buffer);
+    return true;
+}
+
+/**
+ * @brief PGM (P2 vagy P5) pixelek kiírása
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép
+ * @param[in] first az első kiírandó sor
+ * @param[in] last az utolsó utáni kiírandó sor
+ * @param[in] binary true esetén P5, soronként binárisan, különben P2, egy sorba egy pixelt
+ * @param[out] success false ha nem sikerült lefoglalni a puffert
+ * @see write_text_rows
+ */
+static bool write_graymap(FILE *fp, PPM_Image *image, int first, int last, bool binary) {
+    if (binary) {
+        unsigned char *row = (unsigned char *) mem_alloc(image->size_x);
+        if (row == NULL)
+            return false;
+        for (int line = first; line < last; line++) {
+            for (int col = 0; col < image->size_x; col++)
+                row[col] = gray_value(image, line, col);
+            fwrite(row, 1, image->size_x, fp);
+        }
+        mem_free(row);
+        return true;
+    }
+    return write_text_rows(fp, image, first, last);
+}
+
+/**
+ * @brief kiírja a kép fejlécét: a magic-et az oszlopok számát, a sorok számát és a maxvalt, ami mindig 255, mivel a pixeleket 8 biten tároljuk. A PBM formátumnak nincs maxval-ja.
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép, a magic-je dönti el a formátumot
+ * @see PPM_WriteRows
+ */
+void PPM_WriteHeader(FILE *fp, PPM_Image *image) {
+    fprintf(fp, "%s\n", image->magic);
+    fprintf(fp, "%d %d\n", image->size_x, image->size_y);
+    if (image->magic[1] != '1' && image->magic[1] != '4')
+        fprintf(fp, "%d\n", 255);
+}
+
+/**
+ * @brief kiírja a kép [first, last) sorait a fejléc, vagy az előző sorok után
+ * P3 esetén egy sorba egy pixelt, tehát három számot írunk. P6 esetén soronként, binárisan írjuk ki a pixeleket. P1, P2, P4 és P5 esetén a kép szürkeárnyalatos változatát írjuk ki.
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép, a magic-je dönti el a formátumot
+ * @param[in] first az első kiírandó sor
+ * @param[in] last az utolsó utáni kiírandó sor
+ *
+ * @param[out] success false ha nem sikerült lefoglalni a sorpuffert (pl. a --max-memory korlát miatt), ekkor a sorokat nem írtuk ki
+ *
+ * A sorokat egymástól függetlenül kódoljuk, így a kép darabokban is kiírható, amint a sorai elkészültek.
+ * @see write_bitmap
+ * @see write_graymap
+ */
+bool PPM_WriteRows(FILE *fp, PPM_Image *image, int first, int last) {
+    char type = image->magic[1];
+    if (type == '1' || type == '4')
+        return write_bitmap(fp, image, first, last, type == '4');
+    if (type == '2' || type == '5')
+        return write_graymap(fp, image, first, last, type == '5');
+
+    /* szürkeárnyalatos képnél mindhárom színbe ugyanazt a csatornát írjuk */
+    int channel_step = (image->channels == 1) ? 0 : 1;
+
+    if (type == '6') {
+        unsigned char *row = (unsigned char *) mem_alloc(image->size_x * 3);
+        if (row == NULL)
+            return false;
+        for (int line = first; line < last; line++) {
+            for (int col = 0; col < image->size_x; col++) {
+                for (int color = 0; color < 3; color++)
+                    row[col*3 + color] = image->image_data[line][col][color * channel_step];
+            }
+            fwrite(row, 1, image->size_x * 3, fp);
+        }
+        mem_free(row);
+        return true;
+    }
+    return write_text_rows(fp, image, first, last);
+}
+
+/**
+ * @brief egy már megnyitott fájlba írja a PPM_Image tartalmát
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép, a magic-je dönti el a formátumot
+ * @param[out] success false ha nem sikerült lefoglalni a sorpuffert, ekkor csak a fejlécet írtuk ki
+ * @see PPM_WriteHeader
+ * @see PPM_WriteRows
+ */
+bool PPM_WriteFrame(FILE *fp, PPM_Image *image) {
+    PPM_WriteHeader(fp, image);
+    return PPM_WriteRows(fp, image, 0, image->size_y);
+}
+
 /**
  * @brief Fájlba írja a PPM_Image tartalmát
- * A megnyitott fájlba először kiírjuk sorrendben a magic-et az oszlopok számát, a sorok számát, a maxvalt. Ezek után a pixelek adatait írjuk ki, egy sorba egy pixelt, tehát három számot. Végül bezárjuk a fájlt.
+ * Megnyitja a fájlt, beleírja a képet a PPM_WriteFrame segítségével, majd bezárja.
  * @param[in] filename[] a kimenti fájl neve
  * @param[in] *image a kiírandó kép
+ * @see PPM_WriteFrame
  */
 void PPM_Writer(char filename[], PPM_Image *image) {
     FILE *fp;
-    fp = fopen(filename, "w");
+    fp = fopen(filename, "wb");
     if (fp == NULL) {
         perror("error reading file");
         abort();
     }
 
-    fprintf(fp, "%s\n", image->magic);
-    fprintf(fp, "%d %d\n", image->size_x, image->size_y);
-    fprintf(fp, "%d\n", image->maxval);
-
-    for (int line = 0; line < image->size_y; line++) {
-        for (int col = 0; col < image->size_x; col++) {
-            for (int color = 0; color < 3; color++) {
-                fprintf(fp, "%d ", (image->image_data[line][col][color]));
-            }
-            fprintf(fp, "\n");
-        }
+    if (!PPM_WriteFrame(fp, image)) {
+        perror("error allocating buffer");
+        abort();
     }
     fclose(fp);
 }
@@ -2,6 +2,7 @@
 #define PPM
 
 #include <stdbool.h>
+#include <stdio.h>
 
 /**
  * @brief a PPM fájl tárolására használt struktúra
@@ -10,19 +11,62 @@ typedef struct PPM_Image {
     unsigned char ***image_data; /**< 3 dimenziós tömb amiben a kép pixeleinek az értékeit tároljuk */
     int size_x; /**< a kép oszlopainak száma */
     int size_y; /**< a kép sorainak száma */
+    int channels; /**< a pixelenként tárolt színcsatornák száma: 3 (RGB), vagy 1 ha a kép szürkeárnyalatos és a három szín azonos */
     char magic[2+1]; /**< a kép két karakterből álló magic-je */
     int maxval; /**< a kép maxval-ja */
 } PPM_Image;
 
+/**
+ * @brief a PPM beolvasás eredménye
+ */
+typedef enum ppm_status {
+  ppm_ok,         /**< sikeres beolvasás */
+  ppm_end,        /**< nincs több kép a fájlban */
+  ppm_bad_magic,  /**< nem P1-P6 a magic */
+  ppm_bad_header, /**< hibás méret vagy maxval */
+  ppm_truncated,  /**< a fájl a kép közepén véget ért */
+  ppm_no_memory   /**< nem sikerült lefoglalni a memóriát */
+} ppm_status;
+
+/**
+ * @brief egy képformátum egy sorát beolvasó függvény
+ * @param[in] *fp a fájl amiből olvasunk
+ * @param[in] *image a kép fejléce
+ * @param[in] *state a formátum saját adatai
+ * @param[in] *row ide kerül a sor size_x * 3 mintája
+ * @param[out] success false ha a fájl a sor közepén véget ért, ekkor a sor hiányzó mintái 0-k
+ * @see readimage_scaled
+ */
+typedef bool (*row_reader)(FILE *fp, PPM_Image *image, void *state, unsigned char *row);
+
+/**
+ * @brief értesítés a beolvasás közben elkészült sorokról
+ * @see readimage_scaled
+ */
+typedef struct RowProgress {
+    void (*ready)(PPM_Image *image, int rows, void *data); /**< a kép első rows sora elkészült, az image már a végleges (kicsinyített) méretű kép */
+    void *data; /**< a ready-nek átadott adat */
+} RowProgress;
+
 unsigned char getpixelcolor(unsigned char *image, int x, int y, int z, int size_x);
 void setpixelcolor(unsigned char *image, int x, int y, int z, int size_x, unsigned char value);
 unsigned char *allocateimage1d(int size_x, int size_y);
 void freeimage(unsigned char ***image, int size_x, int size_y);
 unsigned char ***allocateimage(int size_x, int size_y);
-bool parsepixels(char word[], PPM_Image *image, int *iter_h, int *iter_w, int *rgb);
-void parseword(char word[], PPM_Image *image,  int *iter_h, int *iter_w, int *rgb);
-void checktype(char line[], PPM_Image *image, int *iter_h, int *iter_w, int *rgb);
+unsigned char ***allocateimage_channels(int size_x, int size_y, int channels);
+long long image_bytes(int size_x, int size_y, int channels);
+unsigned char ***wrapimage(unsigned char *pixels, int size_x, int size_y, int stride, int channels);
+ppm_status PPM_ReadHeader(FILE *fp, PPM_Image *image);
+ppm_status PPM_ReadPixels(FILE *fp, PPM_Image *image, unsigned char ***dst);
+bool readimage_scaled(FILE *fp, PPM_Image *image, int shrink, row_reader read, void *state, RowProgress *progress);
+bool PPM_ReadFrameScaled(FILE *fp, PPM_Image *image, int shrink);
+bool PPM_ReadFrameProgress(FILE *fp, PPM_Image *image, int shrink, RowProgress *progress);
+bool PPM_ReadFrame(FILE *fp, PPM_Image *image);
+PPM_Image PPM_ParserScaled(char filename[], int shrink);
 PPM_Image PPM_Parser(char filename[]);
+void PPM_WriteHeader(FILE *fp, PPM_Image *image);
+bool PPM_WriteRows(FILE *fp, PPM_Image *image, int first, int last);
+bool PPM_WriteFrame(FILE *fp, PPM_Image *image);
 void PPM_Writer(char filename[], PPM_Image *image);
 
 #endif
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "ppm.h"
+#include "qoi.h"
+#include "memusage.h"
+
+/**
+ * @file
+ * @brief QOI (Quite OK Image) fájl beolvasása és kiírása
+ *
+ * A QOI egy egyszerű, veszteségmentes formátum: minden pixelt az előzőhöz képest kódolunk, vagy az előző pixel ismétléseként (run), vagy a korábban látott színek 64 elemű táblázatának indexeként, vagy az előzőtől való kis eltérésként, vagy teljes RGB értékként.
+ * A kódolás és a dekódolás is egyetlen menetben, soronként halad, így a képből egyszerre csak egy sornyi kódolt adatot kell tárolni.
+ * @see https://qoiformat.org/qoi-specification.pdf
+ */
+
+#define QOI_MAGIC "qoif" /**< a QOI fájlok első négy bájtja */
+#define QOI_HEADER_SIZE 14 /**< a fejléc mérete: magic, szélesség, magasság, csatornák, színtér */
+#define QOI_PADDING 8 /**< a kép végét jelző bájtok száma: hét 0 és egy 1 */
+
+#define QOI_OP_INDEX 0x00 /**< 00xxxxxx: a színtáblázat eleme */
+#define QOI_OP_DIFF 0x40 /**< 01rrggbb: kis eltérés az előző pixeltől */
+#define QOI_OP_LUMA 0x80 /**< 10gggggg rrrrbbbb: a zöld eltérése, és a vörös és kék eltérése ahhoz képest */
+#define QOI_OP_RUN 0xc0 /**< 11xxxxxx: az előző pixel ismétlése */
+#define QOI_OP_RGB 0xfe /**< teljes RGB érték */
+#define QOI_OP_RGBA 0xff /**< teljes RGBA érték */
+#define QOI_MASK 0xc0 /**< a két bites műveletek maszkja */
+#define QOI_MAX_RUN 62 /**< egy run művelet legfeljebb ennyi pixelt ismétel */
+
+/**
+ * @brief a kódolás és a dekódolás állapota
+ */
+typedef struct QoiState {
+    unsigned char index[64][4]; /**< a korábban látott színek táblázata, a hash-ük szerint */
+    unsigned char prev[4]; /**< az előző pixel RGBA értéke */
+    int run; /**< az előző pixel még hátralévő (dekódolás), vagy eddigi (kódolás) ismétléseinek száma */
+} QoiState;
+
+/**
+ * @brief a szín helye a táblázatban
+ */
+static inline int qoi_hash(const unsigned char pixel[4]) {
+    return (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+}
+
+/**
+ * @brief a kezdőállapot: üres táblázat és átlátszatlan fekete előző pixel
+ */
+static void qoi_init(QoiState *state) {
+    memset(state, 0, sizeof(QoiState));
+    state->prev[3] = 255;
+}
+
+/**
+ * @brief egy 32 bites, big endian szám
+ */
+static unsigned int read_u32(const unsigned char *bytes) {
+    return (unsigned int) bytes[0] << 24 | (unsigned int) bytes[1] << 16 | (unsigned int) bytes[2] << 8 | bytes[3];
+}
+
+static void write_u32(unsigned char *bytes, unsigned int value) {
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+/**
+ * @brief dekódolja a kép egy sorát, a readimage_scaled számára
+ * @param[in] *fp a fájl amiből olvasunk
+ * @param[in] *image a kép fejléce
+ * @param[in] *data a dekódolás állapota (QoiState), soronként folytatódik
+ * @param[in] *row ide kerül a sor size_x * 3 mintája, az alfa csatornát elhagyjuk
+ * @param[out] success false ha a fájl a sor közepén véget ért, ekkor a sor hiányzó mintái 0-k
+ */
+static bool qoi_row(FILE *fp, PPM_Image *image, void *data, unsigned char *row) {
+    QoiState *state = (QoiState *) data;
+    unsigned char *pixel = state->prev;
+
+    for (int col = 0; col < image->size_x; col++) {
+        if (state->run > 0)
+            state->run--;
+        else {
+            int b1 = getc_unlocked(fp);
+            if (b1 == EOF) {
+                memset(row + col * 3, 0, (image->size_x - col) * 3);
+                return false;
+            }
+            if (b1 == QOI_OP_RGB) {
+                pixel[0] = getc_unlocked(fp);
+                pixel[1] = getc_unlocked(fp);
+                pixel[2] = getc_unlocked(fp);
+            }
+            else if (b1 == QOI_OP_RGBA) {
+                for (int color = 0; color < 4; color++)
+                    pixel[color] = getc_unlocked(fp);
+            }
+            else if ((b1 & QOI_MASK) == QOI_OP_INDEX)
+                memcpy(pixel, state->index[b1], 4);
+            else if ((b1 & QOI_MASK) == QOI_OP_DIFF) {
+                pixel[0] += ((b1 >> 4) & 0x03) - 2;
+                pixel[1] += ((b1 >> 2) & 0x03) - 2;
+                pixel[2] += (b1 & 0x03) - 2;
+            }
+            else if ((b1 & QOI_MASK) == QOI_OP_LUMA) {
+                int b2 = getc_unlocked(fp);
+                int dg = (b1 & 0x3f) - 32;
+                pixel[0] += dg - 8 + ((b2 >> 4) & 0x0f);
+                pixel[1] += dg;
+                pixel[2] += dg - 8 + (b2 & 0x0f);
+            }
+            else
+                state->run = b1 & 0x3f;
+            memcpy(state->index[qoi_hash(pixel)], pixel, 4);
+        }
+        memcpy(row + col * 3, pixel, 3);
+    }
+    return true;
+}
+
+/**
+ * @brief beolvassa a QOI fejlécet, a pixelek nélkül
+ * @param[in] *fp a megnyitott fájl, a kép elejére állva
+ * @param[in] *image ide kerül a kép mérete, a magic-je P6 lesz
+ * @param[out] status ppm_ok ha sikerült, ppm_end ha nincs több kép a fájlban, ppm_bad_header ha a fejléc hibás
+ * @see PPM_ReadHeader
+ */
+ppm_status QOI_ReadHeader(FILE *fp, PPM_Image *image) {
+    unsigned char header[QOI_HEADER_SIZE];
+    size_t got = fread(header, 1, QOI_HEADER_SIZE, fp);
+    if (got == 0)
+        return ppm_end;
+
+    unsigned int size_x = read_u32(header + 4);
+    unsigned int size_y = read_u32(header + 8);
+    if (got != QOI_HEADER_SIZE || memcmp(header, QOI_MAGIC, 4) != 0)
+        return ppm_bad_header;
+    if (size_x == 0 || size_y == 0 || (header[12] != 3 && header[12] != 4)
+        || size_x > INT_MAX || size_y > INT_MAX)
+        return ppm_bad_header;
+
+    image->size_x = (int) size_x;
+    image->size_y = (int) size_y;
+    image->channels = 3;
+    image->image_data = NULL;
+    strcpy(image->magic, "P6");
+    image->maxval = 255;
+    return ppm_ok;
+}
+
+/**
+ * @brief beolvas egy QOI képet egy már megnyitott fájlból, a megadott mértékben kicsinyítve
+ * @param[in] *fp a megnyitott fájl, a kép elejére állva
+ * @param[in] *image ebbe a PPM_Image-be kerül a kép, mindig RGB, a magic-je P6 (így PPM-ként binárisan írjuk ki)
+ * @param[in] shrink a kicsinyítés mértéke, 1 esetén az eredeti méretben olvassuk be
+ * @param[out] success false ha nincs több kép a fájlban
+ *
+ * A kép végét jelző bájtokat is beolvassuk, így egymás után fűzött QOI képeket is egyenként be lehet olvasni. Ha a fájl a kép közepén véget ér, a hiányzó pixelek feketék maradnak.
+ * @see readimage_scaled
+ */
+bool QOI_ReadFrameScaled(FILE *fp, PPM_Image *image, int shrink) {
+    return QOI_ReadFrameProgress(fp, image, shrink, NULL);
+}
+
+/**
+ * @brief mint a QOI_ReadFrameScaled, de a beolvasás közben értesít az elkészült sorokról
+ * @param[in] *progress az értesítés, NULL ha nem kell
+ * @see RowProgress
+ */
+bool QOI_ReadFrameProgress(FILE *fp, PPM_Image *image, int shrink, RowProgress *progress) {
+    ppm_status status = QOI_ReadHeader(fp, image);
+    if (status == ppm_end)
+        return false;
+    if (status != ppm_ok) {
+        fprintf(stderr, "hibás QOI fejléc\n");
+        abort();
+    }
+
+    QoiState state;
+    qoi_init(&state);
+    if (readimage_scaled(fp, image, shrink, qoi_row, &state, progress)) {
+        unsigned char padding[QOI_PADDING];
+        if (fread(padding, 1, QOI_PADDING, fp) != QOI_PADDING) {
+            /* a lezárás hiányát nem tekintjük hibának, a pixelek már megvannak */
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief beolvassa egy QOI kép pixeleit a fejléc után, a megadott sorokba, és ellenőrzi a kép végét
+ * @param[in] *fp a megnyitott fájl, a fejléc után állva
+ * @param[in] *image a kép fejléce (QOI_ReadHeader)
+ * @param[in] ***dst a kép sorai, soronként size_x * 3 folytonos bájttal
+ * @param[out] status ppm_ok ha pontosan size_x * size_y pixel volt a kép végét jelző bájtok előtt, ppm_truncated ha a fájl korábban véget ért, vagy a kép vége nem a pixelek után következik
+ *
+ * A QOI_ReadFrame-mel szemben a hiányzó vagy hibás lezárást is hibának tekintjük, így a félbeszakadt vagy sérült fájlok (pl. a gyorsítótárban) nem adnak részben fekete képet.
+ * @see PPM_ReadPixels
+ */
+ppm_status QOI_ReadPixels(FILE *fp, PPM_Image *image, unsigned char ***dst) {
+    QoiState state;
+    qoi_init(&state);
+    for (int line = 0; line < image->size_y; line++) {
+        if (!qoi_row(fp, image, &state, dst[line][0]))
+            return ppm_truncated;
+    }
+
+    /* a pixelek után nem maradhat ismétlés, és pontosan a lezárásnak kell következnie */
+    static const unsigned char end[QOI_PADDING] = {0, 0, 0, 0, 0, 0, 0, 1};
+    unsigned char padding[QOI_PADDING];
+    if (state.run != 0 || fread(padding, 1, QOI_PADDING, fp) != QOI_PADDING || memcmp(padding, end, QOI_PADDING) != 0)
+        return ppm_truncated;
+    return ppm_ok;
+}
+
+/**
+ * @brief beolvas egy QOI képet egy már megnyitott fájlból
+ * @see QOI_ReadFrameScaled
+ */
+bool QOI_ReadFrame(FILE *fp, PPM_Image *image) {
+    return QOI_ReadFrameScaled(fp, image, 1);
+}
+
+/**
+ * @brief kódol egy pixelt
+ * @param[in] *state a kódolás állapota
+ * @param[in] pixel[] a pixel RGBA értéke
+ * @param[in] *out ide írjuk a kódolt bájtokat
+ * @param[out] length a kiírt bájtok száma (legfeljebb 5)
+ */
+static int qoi_encode_pixel(QoiState *state, const unsigned char pixel[4], unsigned char *out) {
+    int length = 0;
+    if (memcmp(pixel, state->prev, 4) == 0) {
+        state->run++;
+        if (state->run == QOI_MAX_RUN) {
+            out[length++] = QOI_OP_RUN | (state->run - 1);
+            state->run = 0;
+        }
+        return length;
+    }
+
+    if (state->run > 0) {
+        out[length++] = QOI_OP_RUN | (state->run - 1);
+        state->run = 0;
+    }
+
+    int hash = qoi_hash(pixel);
+    if (memcmp(state->index[hash], pixel, 4) == 0)
+        out[length++] = QOI_OP_INDEX | hash;
+    else {
+        memcpy(state->index[hash], pixel, 4);
+        if (pixel[3] == state->prev[3]) {
+            signed char dr = pixel[0] - state->prev[0];
+            signed char dg = pixel[1] - state->prev[1];
+            signed char db = pixel[2] - state->prev[2];
+            signed char dr_dg = dr - dg;
+            signed char db_dg = db - dg;
+
+            if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2)
+                out[length++] = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+            else if (dr_dg > -9 && dr_dg < 8 && dg > -33 && dg < 32 && db_dg > -9 && db_dg < 8) {
+                out[length++] = QOI_OP_LUMA | (dg + 32);
+                out[length++] = (dr_dg + 8) << 4 | (db_dg + 8);
+            }
+            else {
+                out[length++] = QOI_OP_RGB;
+                memcpy(out + length, pixel, 3);
+                length += 3;
+            }
+        }
+        else {
+            out[length++] = QOI_OP_RGBA;
+            memcpy(out + length, pixel, 4);
+            length += 4;
+        }
+    }
+    memcpy(state->prev, pixel, 4);
+    return length;
+}
+
+/**
+ * @brief a soronkénti kódolás állapota
+ */
+struct QoiEncoder {
+    FILE *fp; /**< a kimeneti fájl */
+    QoiState state; /**< a kódolás állapota, a sorok határán is folytatódik */
+    unsigned char *out; /**< egy kódolt sor helye */
+};
+
+/**
+ * @brief kiírja a QOI fejlécet és előkészíti a sorok kódolását
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép (csak a mérete számít)
+ * @param[out] *encoder a kódolás állapota, a QOI_WriteEnd szabadítja fel
+ *
+ * A QOI-ban nincs egycsatornás kép, és alfa csatornát sem használunk, ezért mindig 3 csatornás, sRGB képet írunk.
+ */
+QoiEncoder *QOI_WriteBegin(FILE *fp, PPM_Image *image) {
+    unsigned char header[QOI_HEADER_SIZE];
+    memcpy(header, QOI_MAGIC, 4);
+    write_u32(header + 4, image->size_x);
+    write_u32(header + 8, image->size_y);
+    header[12] = 3;
+    header[13] = 0;
+    fwrite(header, 1, QOI_HEADER_SIZE, fp);
+
+    QoiEncoder *encoder = (QoiEncoder *) mem_alloc(sizeof(QoiEncoder));
+    unsigned char *out = (unsigned char *) mem_alloc(image->size_x * 5 + QOI_PADDING + 1);
+    if (encoder == NULL || out == NULL) {
+        perror("error allocating buffer");
+        abort();
+    }
+    encoder->fp = fp;
+    qoi_init(&encoder->state);
+    encoder->out = out;
+    return encoder;
+}
+
+/**
+ * @brief kódolja és kiírja a kép [first, last) sorait, a korábban kiírt sorok után
+ * @param[in] *encoder a kódolás állapota
+ * @param[in] *image a kiírandó kép, egycsatornás képnél mindhárom színbe ugyanaz kerül
+ * @param[in] first az első kiírandó sor
+ * @param[in] last az utolsó utáni kiírandó sor
+ *
+ * A képet soronként kódoljuk egy pufferbe és azt írjuk ki, a run a sorok határán is folytatódik.
+ */
+void QOI_WriteRows(QoiEncoder *encoder, PPM_Image *image, int first, int last) {
+    /* szürkeárnyalatos képnél mindhárom színbe ugyanazt a csatornát írjuk */
+    int channel_step = (image->channels == 1) ? 0 : 1;
+
+    unsigned char pixel[4] = {0, 0, 0, 255};
+    for (int line = first; line < last; line++) {
+        int length = 0;
+        for (int col = 0; col < image->size_x; col++) {
+            const unsigned char *source = image->image_data[line][col];
+            for (int color = 0; color < 3; color++)
+                pixel[color] = source[color * channel_step];
+            length += qoi_encode_pixel(&encoder->state, pixel, encoder->out + length);
+        }
+        fwrite(encoder->out, 1, length, encoder->fp);
+    }
+}
+
+/**
+ * @brief lezárja a képet: kiírja a függőben lévő run-t és a kép végét jelző bájtokat, majd felszabadítja az állapotot
+ * @param[in] *encoder a kódolás állapota
+ */
+void QOI_WriteEnd(QoiEncoder *encoder) {
+    unsigned char *out = encoder->out;
+    int length = 0;
+    if (encoder->state.run > 0)
+        out[length++] = QOI_OP_RUN | (encoder->state.run - 1);
+    memset(out + length, 0, QOI_PADDING - 1);
+    out[length + QOI_PADDING - 1] = 1;
+    fwrite(out, 1, length + QOI_PADDING, encoder->fp);
+    mem_free(out);
+    mem_free(encoder);
+}
+
+/**
+ * @brief egy már megnyitott fájlba írja a képet QOI formátumban
+ * @param[in] *fp a megnyitott kimeneti fájl
+ * @param[in] *image a kiírandó kép, egycsatornás képnél mindhárom színbe ugyanaz kerül
+ * @see QOI_WriteBegin
+ * @see QOI_WriteRows
+ * @see QOI_WriteEnd
+ */
+void QOI_WriteFrame(FILE *fp, PPM_Image *image) {
+    QoiEncoder *encoder = QOI_WriteBegin(fp, image);
+    QOI_WriteRows(encoder, image, 0, image->size_y);
+    QOI_WriteEnd(encoder);
+}
@@ -0,0 +1,25 @@
+#ifndef QOI
+#define QOI
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ppm.h"
+
+/**
+ * @brief a soronkénti QOI kódolás állapota
+ * @see QOI_WriteBegin
+ */
+typedef struct QoiEncoder QoiEncoder;
+
+ppm_status QOI_ReadHeader(FILE *fp, PPM_Image *image);
+ppm_status QOI_ReadPixels(FILE *fp, PPM_Image *image, unsigned char ***dst);
+bool QOI_ReadFrameScaled(FILE *fp, PPM_Image *image, int shrink);
+bool QOI_ReadFrameProgress(FILE *fp, PPM_Image *image, int shrink, RowProgress *progress);
+bool QOI_ReadFrame(FILE *fp, PPM_Image *image);
+QoiEncoder *QOI_WriteBegin(FILE *fp, PPM_Image *image);
+void QOI_WriteRows(QoiEncoder *encoder, PPM_Image *image, int first, int last);
+void QOI_WriteEnd(QoiEncoder *encoder);
+void QOI_WriteFrame(FILE *fp, PPM_Image *image);
+
+#endif
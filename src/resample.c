@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#include "ppm.h"
+#include "resample.h"
+#include "parallel.h"
+#include "memusage.h"
+
+/**
+ * @file
+ * @brief Kép átméretezése szeparálható szűrővel
+ */
+
+#define WEIGHT_BITS 14 /**< a súlyok fixpontos ábrázolásának törtbitjei */
+#define MID_BITS 6 /**< a két lépés közötti értékek törtbitjei */
+
+/**
+ * @brief egy irány előre kiszámolt súlyai
+ *
+ * A kimenet i-edik pixele a bemenet start[i] és start[i] + count[i] közötti pixeleinek súlyozott összege, a súlyok a coeffs[i * taps] helytől kezdődnek.
+ */
+typedef struct Weights {
+    int *start; /**< az első felhasznált bemeneti pixel indexe */
+    int *count; /**< a felhasznált bemeneti pixelek száma */
+    int *coeffs; /**< a súlyok, 1 << WEIGHT_BITS jelenti az 1-et */
+    int taps; /**< a kimeneti pixelenkénti súlyok legnagyobb száma */
+} Weights;
+
+/**
+ * @brief az átméretezés adatai a szálak számára
+ */
+typedef struct ResampleJob {
+    unsigned char ***src; /**< a bemeneti kép */
+    short *mid; /**< a vízszintes lépés eredménye MID_BITS törtbittel, levágás nélkül */
+    unsigned char ***dst; /**< a kimeneti kép */
+    int size_x; /**< a bemenet oszlopainak száma */
+    int new_x; /**< a kimenet oszlopainak száma */
+    int channels; /**< a színcsatornák száma */
+    Weights *weights_x; /**< a vízszintes súlyok, NULL ha a szélesség nem változik */
+    Weights *weights_y; /**< a függőleges súlyok, NULL ha a magasság nem változik */
+} ResampleJob;
+
+static double sinc(double x) {
+    if (x == 0.0)
+        return 1.0;
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+/**
+ * @brief a szűrő értéke
+ * @param[in] filter a szűrő
+ * @param[in] x a távolság a kimeneti pixel középpontjától, bemeneti pixelben (kicsinyítésnél a lépésközzel osztva)
+ */
+static double filter_value(resample_filter filter, double x) {
+    switch (filter) {
+        case box_filter:
+            return (x > -0.5 && x <= 0.5) ? 1.0 : 0.0;
+        case bilinear_filter:
+            x = fabs(x);
+            return (x < 1.0) ? 1.0 - x : 0.0;
+        case lanczos_filter:
+            return (x > -3.0 && x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+    }
+    return 0.0;
+}
+
+/**
+ * @brief a szűrő tartója, ezen kívül a szűrő értéke 0
+ */
+static double filter_support(resample_filter filter) {
+    switch (filter) {
+        case box_filter:
+            return 0.5;
+        case bilinear_filter:
+            return 1.0;
+        case lanczos_filter:
+            return 3.0;
+    }
+    return 0.0;
+}
+
+/**
+ * @brief kiszámolja egy irány súlyait
+ * @param[in] in a bemenet mérete az adott irányban
+ * @param[in] out a kimenet mérete az adott irányban
+ * @param[in] filter a szűrő
+ * @param[in] *weights ide kerülnek a súlyok, freeweights-szel kell felszabadítani
+ * @param[out] success false ha nem sikerült lefoglalni a súlyokat, ekkor nincs mit felszabadítani
+ *
+ * Kicsinyítésnél a szűrőt a lépésközzel széthúzzuk, így minden bemeneti pixel hozzájárul valamelyik kimeneti pixelhez. A súlyok összege minden kimeneti pixelnél pontosan 1, így a kép szélén is megmarad a fényesség.
+ */
+static bool setweights(int in, int out, resample_filter filter, Weights *weights) {
+    double scale = (double) in / out;
+    double stretch = (scale > 1.0) ? scale : 1.0;
+    double support = filter_support(filter) * stretch;
+
+    weights->taps = (int) ceil(support) * 2 + 1;
+    weights->start = (int *) mem_alloc(out * sizeof(int));
+    weights->count = (int *) mem_alloc(out * sizeof(int));
+    weights->coeffs = (int *) mem_calloc(out * weights->taps, sizeof(int));
+    double *values = (double *) mem_alloc(weights->taps * sizeof(double));
+    if (weights->start == NULL || weights->count == NULL || weights->coeffs == NULL || values == NULL) {
+        mem_free(weights->start);
+        mem_free(weights->count);
+        mem_free(weights->coeffs);
+        mem_free(values);
+        return false;
+    }
+
+    for (int i = 0; i < out; i++) {
+        double center = (i + 0.5) * scale;
+        int first = (int) floor(center - support + 0.5);
+        int last = (int) floor(center + support + 0.5);
+        if (first < 0)
+            first = 0;
+        if (last > in)
+            last = in;
+        if (last - first > weights->taps)
+            last = first + weights->taps;
+
+        double total = 0;
+        for (int j = first; j < last; j++) {
+            values[j - first] = filter_value(filter, (j + 0.5 - center) / stretch);
+            total += values[j - first];
+        }
+
+        weights->start[i] = first;
+        weights->count[i] = last - first;
+        /* a kerekítés hibáját a legnagyobb súlyhoz adjuk, így egyszínű terület nem változik */
+        int *coeffs = weights->coeffs + i * weights->taps;
+        int sum = 0, largest = 0;
+        for (int j = 0; j < last - first; j++) {
+            coeffs[j] = (int) lround(values[j] / total * (1 << WEIGHT_BITS));
+            sum += coeffs[j];
+            if (coeffs[j] > coeffs[largest])
+                largest = j;
+        }
+        coeffs[largest] += (1 << WEIGHT_BITS) - sum;
+    }
+    mem_free(values);
+    return true;
+}
+
+static void freeweights(Weights weights) {
+    mem_free(weights.start);
+    mem_free(weights.count);
+    mem_free(weights.coeffs);
+}
+
+/**
+ * @brief a fixpontos értéket 0 és 255 közé eső egésszé kerekíti
+ * @param[in] value az érték
+ * @param[in] bits az érték törtbitjeinek száma
+ */
+static inline unsigned char fixed_to_byte(int value, int bits) {
+    value = (value + (1 << (bits - 1))) >> bits;
+    return (unsigned char) (value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+/**
+ * @brief vízszintes átméretezés a [first, last) sorokon
+ *
+ * Az eredményt nem vágjuk le 0 és 255 közé, mert a Lanczos szűrő túllövéseit a függőleges lépés negatív súlyai részben visszahúzzák. Ha a szélesség nem változik, csak átmásoljuk a sort.
+ */
+static void resample_rows(int first, int last, void *data) {
+    ResampleJob *job = (ResampleJob *) data;
+    Weights *weights = job->weights_x;
+    int channels = job->channels;
+    int width = job->new_x * channels;
+
+    for (int y = first; y < last; y++) {
+        unsigned char *src = job->src[y][0];
+        short *mid = job->mid + (size_t) y * width;
+        if (weights == NULL) {
+            for (int i = 0; i < width; i++)
+                mid[i] = (short) (src[i] << MID_BITS);
+            continue;
+        }
+        for (int x = 0; x < job->new_x; x++) {
+            const int *coeffs = weights->coeffs + x * weights->taps;
+            const unsigned char *pixel = src + weights->start[x] * channels;
+            int count = weights->count[x];
+            for (int color = 0; color < channels; color++) {
+                int sum = 0;
+                for (int k = 0; k < count; k++)
+                    sum += coeffs[k] * pixel[k * channels + color];
+                sum = (sum + (1 << (WEIGHT_BITS - MID_BITS - 1))) >> (WEIGHT_BITS - MID_BITS);
+                mid[x * channels + color] = (short) (sum < SHRT_MIN ? SHRT_MIN : (sum > SHRT_MAX ? SHRT_MAX : sum));
+            }
+        }
+    }
+}
+
+/**
+ * @brief függőleges átméretezés a kimenet [first, last) sorain
+ *
+ * Egy kimeneti sor a köztes sorok súlyozott összege, így a belső ciklus egy teljes soron halad végig, amit a fordító vektorizálni tud.
+ */
+static void resample_columns(int first, int last, void *data) {
+    ResampleJob *job = (ResampleJob *) data;
+    Weights *weights = job->weights_y;
+    int width = job->new_x * job->channels;
+    int *sums = (int *) mem_alloc(width * sizeof(int));
+
+    for (int y = first; y < last; y++) {
+        unsigned char *dst = job->dst[y][0];
+        if (weights == NULL) {
+            const short *mid = job->mid + (size_t) y * width;
+            for (int i = 0; i < width; i++)
+                dst[i] = fixed_to_byte(mid[i], MID_BITS);
+            continue;
+        }
+        const int *coeffs = weights->coeffs + y * weights->taps;
+        if (sums == NULL) {
+            /* ha a sorpuffert nem sikerült lefoglalni, pixelenként összegzünk, lassabban, de munkaterület nélkül */
+            for (int i = 0; i < width; i++) {
+                int sum = 0;
+                for (int k = 0; k < weights->count[y]; k++)
+                    sum += coeffs[k] * job->mid[(size_t) (weights->start[y] + k) * width + i];
+                dst[i] = fixed_to_byte(sum, WEIGHT_BITS + MID_BITS);
+            }
+            continue;
+        }
+        memset(sums, 0, width * sizeof(int));
+        for (int k = 0; k < weights->count[y]; k++) {
+            const short *mid = job->mid + (size_t) (weights->start[y] + k) * width;
+            int coeff = coeffs[k];
+            for (int i = 0; i < width; i++)
+                sums[i] += coeff * mid[i];
+        }
+        for (int i = 0; i < width; i++)
+            dst[i] = fixed_to_byte(sums[i], WEIGHT_BITS + MID_BITS);
+    }
+    mem_free(sums);
+}
+
+/**
+ * @brief átméretezi a képet egy már lefoglalt kimeneti képbe
+ * @param[in] ***src a bemeneti kép
+ * @param[in] size_x a bemenet oszlopainak száma
+ * @param[in] size_y a bemenet sorainak száma
+ * @param[in] ***dst a kimeneti kép, new_x * new_y méretű és ugyanannyi csatornás, mint a bemenet
+ * @param[in] new_x a kimenet oszlopainak száma
+ * @param[in] new_y a kimenet sorainak száma
+ * @param[in] channels a színcsatornák száma
+ * @param[in] filter a szűrő
+ * @param[out] success false ha nem sikerült lefoglalni a köztes tárolót vagy a súlyokat, ekkor a kimenet nem változik
+ *
+ * A szűrő szeparálható, ezért először a sorokat méretezzük át vízszintesen egy 16 bites köztes tárolóba, majd ennek az oszlopait függőlegesen. A súlyokat irányonként egyszer, kimeneti soronként és oszloponként előre kiszámoljuk. Mindkét lépésben a sorok egymástól függetlenek, ezeket sávokra osztva párhuzamosan dolgozzuk fel.
+ * A be- és a kimenetnek csak a sorain belül kell folytonosnak lennie.
+ * @see parallel_rows
+ */
+bool resample_image(unsigned char ***src, int size_x, int size_y, unsigned char ***dst, int new_x, int new_y, int channels, resample_filter filter) {
+    ResampleJob job;
+    job.mid = (short *) mem_alloc((size_t) size_y * new_x * channels * sizeof(short));
+    if (job.mid == NULL)
+        return false;
+
+    Weights weights_x, weights_y;
+    job.src = src;
+    job.dst = dst;
+    job.size_x = size_x;
+    job.new_x = new_x;
+    job.channels = channels;
+    job.weights_x = NULL;
+    job.weights_y = NULL;
+    bool success = true;
+    if (new_x != size_x) {
+        success = setweights(size_x, new_x, filter, &weights_x);
+        job.weights_x = success ? &weights_x : NULL;
+    }
+    if (success && new_y != size_y) {
+        success = setweights(size_y, new_y, filter, &weights_y);
+        job.weights_y = success ? &weights_y : NULL;
+    }
+
+    if (success) {
+        parallel_rows(size_y, resample_rows, &job);
+        parallel_rows(new_y, resample_columns, &job);
+    }
+
+    mem_free(job.mid);
+    if (job.weights_x != NULL)
+        freeweights(weights_x);
+    if (job.weights_y != NULL)
+        freeweights(weights_y);
+    return success;
+}
+
+/**
+ * @brief a resample_image munkaterületének becslése
+ * @param[in] size_x a bemenet oszlopainak száma
+ * @param[in] size_y a bemenet sorainak száma
+ * @param[in] new_x a kimenet oszlopainak száma
+ * @param[in] new_y a kimenet sorainak száma
+ * @param[in] channels a színcsatornák száma
+ * @param[in] filter a szűrő
+ * @param[out] bytes a köztes tároló és a két irány súlyai együtt, bájtban (a kimeneti kép nélkül)
+ * @see setweights
+ */
+long long resample_bytes(int size_x, int size_y, int new_x, int new_y, int channels, resample_filter filter) {
+    long long bytes = (long long) size_y * new_x * channels * sizeof(short);
+    int in[2] = {size_x, size_y};
+    int out[2] = {new_x, new_y};
+    for (int axis = 0; axis < 2; axis++) {
+        double scale = (double) in[axis] / out[axis];
+        int taps = (int) ceil(filter_support(filter) * ((scale > 1.0) ? scale : 1.0)) * 2 + 1;
+        bytes += (long long) out[axis] * (2 + taps) * sizeof(int) + taps * sizeof(double);
+    }
+    return bytes;
+}
+
+/**
+ * @brief átméretezi a képet
+ * @param[in] *image az átméretezendő kép, a helyére kerül az új
+ * @param[in] new_x az új kép oszlopainak száma
+ * @param[in] new_y az új kép sorainak száma
+ * @param[in] filter a szűrő
+ * @see resample_image
+ */
+void resize_image(PPM_Image *image, int new_x, int new_y, resample_filter filter) {
+    if (new_x <= 0 || new_y <= 0 || (new_x == image->size_x && new_y == image->size_y))
+        return;
+
+    unsigned char ***dst = allocateimage_channels(new_x, new_y, image->channels);
+    if (dst == NULL || !resample_image(image->image_data, image->size_x, image->size_y, dst, new_x, new_y, image->channels, filter)) {
+        perror("error allocating image");
+        abort();
+    }
+
+    freeimage(image->image_data, image->size_x, image->size_y);
+    image->image_data = dst;
+    image->size_x = new_x;
+    image->size_y = new_y;
+}
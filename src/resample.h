@@ -0,0 +1,19 @@
+#ifndef RESAMPLE
+#define RESAMPLE
+
+#include "ppm.h"
+
+/**
+ * @brief az átméretezésnél használt szűrő
+ */
+typedef enum resample_filter {
+  box_filter, /**< a lefedett pixelek átlaga */
+  bilinear_filter, /**< lineáris interpoláció, kicsinyítésnél háromszög szűrő */
+  lanczos_filter /**< Lanczos-3, a legélesebb, de a legdrágább */
+} resample_filter;
+
+bool resample_image(unsigned char ***src, int size_x, int size_y, unsigned char ***dst, int new_x, int new_y, int channels, resample_filter filter);
+long long resample_bytes(int size_x, int size_y, int new_x, int new_y, int channels, resample_filter filter);
+void resize_image(PPM_Image *image, int new_x, int new_y, resample_filter filter);
+
+#endif
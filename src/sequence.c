@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "ppm.h"
+#include "imageio.h"
+#include "sequence.h"
+#include "trace.h"
+
+/**
+ * @file
+ * @brief Egymás után fűzött PPM (P1-P6) vagy QOI képkockák (pl. videó) feldolgozása
+ */
+
+#define FRAME_QUEUE_SIZE 4 /**< legfeljebb ennyi képkocka várakozhat két szál között */
+
+/**
+ * @brief korlátos méretű sor, amin keresztül a szálak a képkockákat egymásnak átadják
+ */
+typedef struct FrameQueue {
+    PPM_Image *frames[FRAME_QUEUE_SIZE]; /**< a várakozó képkockák körkörös tömbje */
+    int head; /**< a legrégebbi képkocka indexe */
+    int count; /**< a várakozó képkockák száma */
+    bool closed; /**< true ha már nem érkezik több képkocka */
+    pthread_mutex_t lock; /**< a sor zárja */
+    pthread_cond_t not_empty; /**< jelez, ha érkezett képkocka */
+    pthread_cond_t not_full; /**< jelez, ha felszabadult hely */
+} FrameQueue;
+
+/**
+ * @brief a szálak közös adatai
+ */
+typedef struct Sequence {
+    FILE *in; /**< a bemeneti fájl */
+    FILE *out; /**< a kimeneti fájl */
+    int shrink; /**< a képkockák kicsinyítésének mértéke beolvasáskor */
+    image_format format; /**< a kimeneti képkockák formátuma */
+    FrameQueue decoded; /**< a beolvasott, feldolgozásra váró képkockák */
+    FrameQueue processed; /**< a feldolgozott, kiírásra váró képkockák */
+} Sequence;
+
+static void queue_init(FrameQueue *queue) {
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = false;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+static void queue_destroy(FrameQueue *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+}
+
+/**
+ * @brief betesz egy képkockát a sor végére, ha a sor tele van akkor megvárja amíg lesz hely
+ * @param[in] *queue a sor
+ * @param[in] *frame a képkocka
+ */
+static void queue_push(FrameQueue *queue, PPM_Image *frame) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == FRAME_QUEUE_SIZE)
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    queue->frames[(queue->head + queue->count) % FRAME_QUEUE_SIZE] = frame;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief jelzi, hogy a sorba nem érkezik több képkocka
+ * @param[in] *queue a sor
+ */
+static void queue_close(FrameQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief kiveszi a sor elején lévő képkockát, ha a sor üres akkor megvárja a következőt
+ * @param[in] *queue a sor
+ * @param[out] frame a képkocka, vagy NULL ha a sor le van zárva és üres
+ */
+static PPM_Image *queue_pop(FrameQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed)
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    PPM_Image *frame = NULL;
+    if (queue->count > 0) {
+        frame = queue->frames[queue->head];
+        queue->head = (queue->head + 1) % FRAME_QUEUE_SIZE;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return frame;
+}
+
+/**
+ * @brief a beolvasó szál: sorban beolvassa a képkockákat és átadja őket feldolgozásra
+ * @param[in] *arg a Sequence
+ */
+static void *reader_thread(void *arg) {
+    Sequence *sequence = (Sequence *) arg;
+    trace_thread_name("beolvasó");
+    while (1) {
+        PPM_Image *frame = (PPM_Image *) malloc(sizeof(PPM_Image));
+        if (!Image_ReadFrameScaled(sequence->in, frame, sequence->shrink)) {
+            free(frame);
+            break;
+        }
+        queue_push(&sequence->decoded, frame);
+    }
+    queue_close(&sequence->decoded);
+    return NULL;
+}
+
+/**
+ * @brief az író szál: a feldolgozott képkockákat sorrendben kiírja, majd felszabadítja
+ * @param[in] *arg a Sequence
+ */
+static void *writer_thread(void *arg) {
+    Sequence *sequence = (Sequence *) arg;
+    trace_thread_name("író");
+    PPM_Image *frame;
+    while ((frame = queue_pop(&sequence->processed)) != NULL) {
+        Image_WriteFrame(sequence->out, frame, sequence->format);
+        freeimage(frame->image_data, frame->size_x, frame->size_y);
+        free(frame);
+    }
+    fflush(sequence->out);
+    return NULL;
+}
+
+/**
+ * @brief egymás után fűzött P1-P6/QOI képkockák feldolgozása
+ * @param[in] in_fname[] a bemeneti fájl, "-" esetén a standard bemenet
+ * @param[in] out_fname[] a kimeneti fájl, "-" esetén a standard kimenet
+ * @param[in] shrink a képkockák kicsinyítésének mértéke beolvasáskor, 1 esetén az eredeti méret
+ * @param[in] format a kimeneti képkockák formátuma, format_auto esetén a bemeneti képkockáké
+ * @param[in] process a képkockánként végrehajtandó feldolgozás
+ * @param[in] *data a process-nek átadott adat
+ * @param[out] frames a feldolgozott képkockák száma
+ *
+ * A beolvasás, a feldolgozás és a kiírás külön szálon fut, így a három lépés különböző képkockákon átfedésben történik. A szálak között korlátos méretű sorokon keresztül mennek a képkockák, így egyszerre legfeljebb néhány képkocka van a memóriában.
+ * A feldolgozás a hívó szálon, a képkockák sorrendjében történik, tehát a véletlenszám-generátort csak ez a szál használja.
+ * Ha a kimenet a standard kimenet, akkor a program többi üzenete a standard hibakimenetre kerül, hogy ne keveredjen a képkockákkal.
+ *
+ * @see Image_ReadFrameScaled
+ * @see Image_WriteFrame
+ */
+int PPM_Sequence(char in_fname[], char out_fname[], int shrink, image_format format, frame_func process, void *data) {
+    Sequence sequence;
+    sequence.shrink = shrink;
+    sequence.format = format;
+
+    if (strcmp(in_fname, "-") == 0)
+        sequence.in = stdin;
+    else
+        sequence.in = fopen(in_fname, "rb");
+    if (sequence.in == NULL) {
+        perror("error reading file");
+        abort();
+    }
+
+    if (strcmp(out_fname, "-") == 0) {
+        fflush(stdout);
+        sequence.out = fdopen(dup(STDOUT_FILENO), "wb");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    else
+        sequence.out = fopen(out_fname, "wb");
+    if (sequence.out == NULL) {
+        perror("error writing file");
+        abort();
+    }
+
+    queue_init(&sequence.decoded);
+    queue_init(&sequence.processed);
+
+    pthread_t reader, writer;
+    pthread_create(&reader, NULL, reader_thread, &sequence);
+    pthread_create(&writer, NULL, writer_thread, &sequence);
+
+    int frames = 0;
+    PPM_Image *frame;
+    while ((frame = queue_pop(&sequence.decoded)) != NULL) {
+        process(frame, data);
+        queue_push(&sequence.processed, frame);
+        frames++;
+    }
+    queue_close(&sequence.processed);
+
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    queue_destroy(&sequence.decoded);
+    queue_destroy(&sequence.processed);
+
+    if (sequence.in != stdin)
+        fclose(sequence.in);
+    fclose(sequence.out);
+    return frames;
+}
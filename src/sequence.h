@@ -0,0 +1,15 @@
+#ifndef SEQUENCE
+#define SEQUENCE
+
+#include "ppm.h"
+#include "imageio.h"
+
+/**
+ * @brief egy képkockán végrehajtandó feldolgozás
+ * @see PPM_Sequence
+ */
+typedef void (*frame_func)(PPM_Image *image, void *data);
+
+int PPM_Sequence(char in_fname[], char out_fname[], int shrink, image_format format, frame_func process, void *data);
+
+#endif
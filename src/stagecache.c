@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <utime.h>
+
+#include "ppm.h"
+#include "qoi.h"
+#include "stagecache.h"
+
+/**
+ * @file
+ * @brief A feldolgozási lépések eredményeinek gyorsítótára
+ *
+ * Minden bejegyzés egy köztes kép, a kulcsa a bemeneti fájl tartalmának és az addig végrehajtott lépések paramétereinek hash-e.
+ * A képeket egy rövid fejléc után QOI formátumban tároljuk, így a beolvasásuk sokkal gyorsabb mint egy P3 fájlé, és a nyers pixeleknél jóval kevesebb helyet foglalnak, tehát több bejegyzés fér el a gyorsítótárban.
+ * A legrégebben használt bejegyzéseket töröljük, ha a gyorsítótár mérete átlépi a megadott korlátot. A használat idejét a fájl módosítási ideje jelzi.
+ */
+
+#define CACHE_MAGIC "IPC2" /**< a gyorsítótár fájljainak azonosítója, a formátum változásakor át kell írni */
+#define CACHE_EXT ".ipc" /**< a gyorsítótár fájljainak kiterjesztése */
+
+/**
+ * @brief a gyorsítótár fájljainak fejléce
+ */
+typedef struct CacheHeader {
+    char magic[4]; /**< CACHE_MAGIC */
+    int size_x; /**< a kép oszlopainak száma */
+    int size_y; /**< a kép sorainak száma */
+    int channels; /**< a kép színcsatornáinak száma */
+    char image_magic[2+1]; /**< a kép eredeti magic-je, ebben a formátumban kell kiírni */
+} CacheHeader;
+
+/**
+ * @brief FNV-1a hash, ami egy korábbi hash értékből folytatható
+ * @param[in] hash az eddigi hash (az első híváskor 0)
+ * @param[in] *data a hozzáadandó adat
+ * @param[in] size az adat mérete bájtban
+ * @param[out] hash az új hash
+ */
+uint64_t cache_hash(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    if (hash == 0)
+        hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief egy fájl teljes tartalmának hash-e
+ * @param[in] filename[] a fájl neve
+ * @param[out] hash a fájl hash-e
+ */
+uint64_t cache_hash_file(char filename[]) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        perror("error reading file");
+        abort();
+    }
+    uint64_t hash = cache_hash(0, CACHE_MAGIC, 4);
+    unsigned char buffer[65536];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        hash = cache_hash(hash, buffer, got);
+    fclose(fp);
+    return hash;
+}
+
+/**
+ * @brief a kulcshoz tartozó fájl elérési útja
+ * @param[in] path[] ide kerül az útvonal
+ * @param[in] size a path mérete
+ * @param[in] *dir a gyorsítótár könyvtára
+ * @param[in] key a bejegyzés kulcsa
+ */
+static void cache_path(char path[], size_t size, const char *dir, uint64_t key) {
+    snprintf(path, size, "%s/%016llx" CACHE_EXT, dir, (unsigned long long) key);
+}
+
+/**
+ * @brief beolvas egy képet a gyorsítótárból
+ * @param[in] *dir a gyorsítótár könyvtára
+ * @param[in] key a keresett bejegyzés kulcsa
+ * @param[in] *image ide kerül a kép
+ * @param[out] found true ha volt ilyen, hibátlan bejegyzés
+ *
+ * Sikeres beolvasás után frissítjük a fájl módosítási idejét, így a bejegyzés a legutóbb használtak közé kerül.
+ * A csonka vagy sérült bejegyzést (pl. hibás fejléc, kevesebb pixel, hiányzó lezárás, vagy a kép utáni adat) nem találatnak tekintjük és töröljük, így a lépés újra lefut és a helyes eredmény kerül a helyére.
+ * @see QOI_ReadPixels
+ */
+bool cache_load(const char *dir, uint64_t key, PPM_Image *image) {
+    char path[4096];
+    cache_path(path, sizeof(path), dir, key);
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return false;
+
+    CacheHeader header;
+    PPM_Image stored;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, CACHE_MAGIC, 4) != 0
+        || header.size_x <= 0 || header.size_y <= 0 || (header.channels != 1 && header.channels != 3)
+        || QOI_ReadHeader(fp, &stored) != ppm_ok || stored.size_x != header.size_x || stored.size_y != header.size_y) {
+        fclose(fp);
+        remove(path);
+        return false;
+    }
+
+    stored.image_data = allocateimage(stored.size_x, stored.size_y);
+    if (stored.image_data == NULL) {
+        fclose(fp);
+        return false;
+    }
+    bool complete = QOI_ReadPixels(fp, &stored, stored.image_data) == ppm_ok && getc(fp) == EOF;
+    fclose(fp);
+    if (!complete) {
+        freeimage(stored.image_data, stored.size_x, stored.size_y);
+        remove(path);
+        return false;
+    }
+
+    /* a QOI mindig RGB, az egycsatornás képnek csak az egyik színét tartjuk meg */
+    if (header.channels == 1) {
+        unsigned char ***gray = allocateimage_channels(header.size_x, header.size_y, 1);
+        if (gray == NULL) {
+            freeimage(stored.image_data, stored.size_x, stored.size_y);
+            return false;
+        }
+        for (int line = 0; line < header.size_y; line++)
+            for (int col = 0; col < header.size_x; col++)
+                gray[line][col][0] = stored.image_data[line][col][0];
+        freeimage(stored.image_data, stored.size_x, stored.size_y);
+        stored.image_data = gray;
+    }
+
+    image->image_data = stored.image_data;
+    image->size_x = header.size_x;
+    image->size_y = header.size_y;
+    image->channels = header.channels;
+    image->maxval = 255;
+    header.image_magic[2] = '\0';
+    strcpy(image->magic, header.image_magic);
+
+    utime(path, NULL);
+    return true;
+}
+
+/**
+ * @brief elment egy képet a gyorsítótárba
+ * @param[in] *dir a gyorsítótár könyvtára, ha nem létezik létrehozzuk
+ * @param[in] key a bejegyzés kulcsa
+ * @param[in] *image a mentendő kép
+ *
+ * Először egy ideiglenes fájlba írunk, amit csak a végén nevezünk át, így egy félbeszakadt írás nem hagy hibás bejegyzést. Ha az írás nem sikerül, a gyorsítótár egyszerűen nem kap új bejegyzést.
+ */
+void cache_store(const char *dir, uint64_t key, PPM_Image *image) {
+    mkdir(dir, 0755);
+
+    char path[4096];
+    char temppath[4096 + 8];
+    cache_path(path, sizeof(path), dir, key);
+    snprintf(temppath, sizeof(temppath), "%s.tmp", path);
+
+    FILE *fp = fopen(temppath, "wb");
+    if (fp == NULL)
+        return;
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.size_x = image->size_x;
+    header.size_y = image->size_y;
+    header.channels = image->channels;
+    memcpy(header.image_magic, image->magic, 2);
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (ok) {
+        QOI_WriteFrame(fp, image);
+        ok = !ferror(fp);
+    }
+    if (fclose(fp) != 0)
+        ok = false;
+
+    if (!ok || rename(temppath, path) != 0)
+        remove(temppath);
+}
+
+/**
+ * @brief a gyorsítótár egy bejegyzése a törléshez
+ */
+typedef struct CacheEntry {
+    char name[256]; /**< a fájl neve */
+    long long size; /**< a fájl mérete */
+    time_t used; /**< a legutóbbi használat ideje */
+} CacheEntry;
+
+static int compare_entries(const void *a, const void *b) {
+    const CacheEntry *ea = (const CacheEntry *) a;
+    const CacheEntry *eb = (const CacheEntry *) b;
+    return (ea->used > eb->used) - (ea->used < eb->used);
+}
+
+/**
+ * @brief törli a legrégebben használt bejegyzéseket, amíg a gyorsítótár mérete a korlát fölött van
+ * @param[in] *dir a gyorsítótár könyvtára
+ * @param[in] max_bytes a gyorsítótár legnagyobb megengedett mérete bájtban
+ *
+ * Ha a bejegyzések listájának nem sikerült memóriát foglalni, most nem törlünk semmit: a gyorsítótár csak ideiglenesen lépi át a korlátot.
+ */
+void cache_evict(const char *dir, long long max_bytes) {
+    DIR *directory = opendir(dir);
+    if (directory == NULL)
+        return;
+
+    int count = 0;
+    int capacity = 64;
+    CacheEntry *entries = (CacheEntry *) malloc(capacity * sizeof(CacheEntry));
+    if (entries == NULL) {
+        closedir(directory);
+        return;
+    }
+    long long total = 0;
+    char path[4096];
+
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length < strlen(CACHE_EXT) || length >= sizeof(entries[0].name)
+            || strcmp(entry->d_name + length - strlen(CACHE_EXT), CACHE_EXT) != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct stat info;
+        if (stat(path, &info) != 0)
+            continue;
+        if (count == capacity) {
+            CacheEntry *grown = (CacheEntry *) realloc(entries, 2 * capacity * sizeof(CacheEntry));
+            if (grown == NULL) {
+                closedir(directory);
+                free(entries);
+                return;
+            }
+            entries = grown;
+            capacity *= 2;
+        }
+        strcpy(entries[count].name, entry->d_name);
+        entries[count].size = info.st_size;
+        entries[count].used = info.st_mtime;
+        total += info.st_size;
+        count++;
+    }
+    closedir(directory);
+
+    qsort(entries, count, sizeof(CacheEntry), compare_entries);
+    for (int i = 0; i < count && total > max_bytes; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+        if (remove(path) == 0)
+            total -= entries[i].size;
+    }
+    free(entries);
+}
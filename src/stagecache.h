@@ -0,0 +1,15 @@
+#ifndef STAGECACHE
+#define STAGECACHE
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ppm.h"
+
+uint64_t cache_hash(uint64_t hash, const void *data, size_t size);
+uint64_t cache_hash_file(char filename[]);
+bool cache_load(const char *dir, uint64_t key, PPM_Image *image);
+void cache_store(const char *dir, uint64_t key, PPM_Image *image);
+void cache_evict(const char *dir, long long max_bytes);
+
+#endif
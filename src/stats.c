@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ppm.h"
+#include "stats.h"
+#include "parallel.h"
+
+/**
+ * @file
+ * @brief A kép statisztikái, amik alapján a presetek a paramétereiket választhatják
+ */
+
+#define EDGE_STEP 32 /**< ennél nagyobb Lightness ugrást tekintünk élnek (0-255 skálán) */
+
+/**
+ * @brief a statisztika számításának adatai a szálak számára
+ */
+typedef struct StatsJob {
+    PPM_Image *image; /**< a vizsgált kép */
+    long long histogram[3][256]; /**< a sávok összesített hisztogramjai */
+    long long lightness[256]; /**< a sávok összesített Lightness hisztogramja */
+    long long sum[3]; /**< színenként az értékek összege */
+    long long squares[3]; /**< színenként az értékek négyzetösszege */
+    long long edges; /**< az élek száma */
+    pthread_mutex_t lock; /**< a sávok eredményeinek összesítéséhez */
+} StatsJob;
+
+/**
+ * @brief a [first, last) sorok statisztikái
+ *
+ * A sáv a saját, lokális számlálóiba gyűjt, és csak a végén adja hozzá őket a közös eredményhez. Egycsatornás képnél mindhárom szín ugyanaz.
+ */
+static void stats_rows(int first, int last, void *data) {
+    StatsJob *job = (StatsJob *) data;
+    PPM_Image *image = job->image;
+    int channels = image->channels;
+    long long histogram[3][256];
+    long long lightness[256];
+    long long sum[3] = {0, 0, 0};
+    long long squares[3] = {0, 0, 0};
+    long long edges = 0;
+    memset(histogram, 0, sizeof(histogram));
+    memset(lightness, 0, sizeof(lightness));
+
+    for (int line = first; line < last; line++) {
+        unsigned char *pixel = image->image_data[line][0];
+        int previous = -1;
+        for (int col = 0; col < image->size_x; col++, pixel += channels) {
+            int r = pixel[0];
+            int g = pixel[(channels == 1) ? 0 : 1];
+            int b = pixel[(channels == 1) ? 0 : 2];
+            histogram[0][r]++;
+            histogram[1][g]++;
+            histogram[2][b]++;
+            sum[0] += r;
+            sum[1] += g;
+            sum[2] += b;
+            squares[0] += r * r;
+            squares[1] += g * g;
+            squares[2] += b * b;
+
+            int high = (r > g) ? r : g;
+            high = (b > high) ? b : high;
+            int low = (r < g) ? r : g;
+            low = (b < low) ? b : low;
+            int light = (high + low + 1) / 2;
+            lightness[light]++;
+            if (previous >= 0 && (light - previous > EDGE_STEP || previous - light > EDGE_STEP))
+                edges++;
+            previous = light;
+        }
+    }
+
+    pthread_mutex_lock(&job->lock);
+    for (int color = 0; color < 3; color++) {
+        for (int value = 0; value < 256; value++)
+            job->histogram[color][value] += histogram[color][value];
+        job->sum[color] += sum[color];
+        job->squares[color] += squares[color];
+    }
+    for (int value = 0; value < 256; value++)
+        job->lightness[value] += lightness[value];
+    job->edges += edges;
+    pthread_mutex_unlock(&job->lock);
+}
+
+/**
+ * @brief kiszámolja a kép statisztikáit
+ * @param[in] *image a vizsgált kép
+ * @param[in] *stats ide kerülnek a statisztikák
+ *
+ * Egyetlen menetben, soronként párhuzamosan gyűjtjük a színenkénti és a Lightness hisztogramot, az összegeket és az élek számát, ezekből számoljuk az átlagot, a szórásnégyzetet és az élek sűrűségét.
+ * @see parallel_rows
+ */
+void image_stats(PPM_Image *image, ImageStats *stats) {
+    StatsJob job;
+    memset(&job, 0, sizeof(job));
+    job.image = image;
+    pthread_mutex_init(&job.lock, NULL);
+    parallel_rows(image->size_y, stats_rows, &job);
+    pthread_mutex_destroy(&job.lock);
+
+    memset(stats, 0, sizeof(ImageStats));
+    stats->pixels = (long long) image->size_x * image->size_y;
+    memcpy(stats->histogram, job.histogram, sizeof(job.histogram));
+    memcpy(stats->lightness, job.lightness, sizeof(job.lightness));
+    if (stats->pixels == 0)
+        return;
+
+    for (int color = 0; color < 3; color++) {
+        stats->mean[color] = (double) job.sum[color] / stats->pixels;
+        stats->variance[color] = (double) job.squares[color] / stats->pixels - stats->mean[color] * stats->mean[color];
+    }
+    long long light_sum = 0;
+    for (int value = 0; value < 256; value++)
+        light_sum += value * job.lightness[value];
+    stats->mean_lightness = (double) light_sum / stats->pixels;
+
+    long long pairs = (long long) (image->size_x - 1) * image->size_y;
+    stats->edge_density = (pairs > 0) ? (double) job.edges / pairs : 0;
+}
+
+/**
+ * @brief a hisztogram egy percentilise
+ * @param[in] histogram[] a hisztogram
+ * @param[in] total az elemek száma a hisztogramban
+ * @param[in] fraction 0 és 1 közötti arány
+ * @param[out] value a legkisebb érték, aminél az elemek legalább fraction része nem nagyobb
+ */
+int stats_percentile(const long long histogram[256], long long total, double fraction) {
+    long long count = 0;
+    for (int value = 0; value < 256; value++) {
+        count += histogram[value];
+        if (count > 0 && count >= fraction * total)
+            return value;
+    }
+    return 255;
+}
+
+/**
+ * @brief kiírja a statisztikákat
+ * @param[in] *fp ide írunk
+ * @param[in] *stats a statisztikák
+ *
+ * Soronként egy "kulcs: érték" pár, hogy más programok is könnyen feldolgozhassák.
+ */
+void print_stats(FILE *fp, ImageStats *stats) {
+    fprintf(fp, "pixelek: %lld\n", stats->pixels);
+    fprintf(fp, "átlag: %.2f %.2f %.2f\n", stats->mean[0], stats->mean[1], stats->mean[2]);
+    fprintf(fp, "szórásnégyzet: %.2f %.2f %.2f\n", stats->variance[0], stats->variance[1], stats->variance[2]);
+    fprintf(fp, "lightness átlag: %.2f\n", stats->mean_lightness);
+    fprintf(fp, "lightness percentilisek (10 50 90): %d %d %d\n",
+        stats_percentile(stats->lightness, stats->pixels, 0.1),
+        stats_percentile(stats->lightness, stats->pixels, 0.5),
+        stats_percentile(stats->lightness, stats->pixels, 0.9));
+    fprintf(fp, "élsűrűség: %.4f\n", stats->edge_density);
+}
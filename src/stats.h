@@ -0,0 +1,26 @@
+#ifndef STATS
+#define STATS
+
+#include <stdio.h>
+
+#include "ppm.h"
+
+/**
+ * @brief a kép tartalmát leíró statisztikák
+ * @see image_stats
+ */
+typedef struct ImageStats {
+    long long pixels; /**< a pixelek száma */
+    long long histogram[3][256]; /**< színenként az értékek hisztogramja */
+    long long lightness[256]; /**< a HSL Lightness hisztogramja 0-255 közötti értékekre skálázva */
+    double mean[3]; /**< színenként az átlag */
+    double variance[3]; /**< színenként a szórásnégyzet */
+    double mean_lightness; /**< a HSL Lightness átlaga 0-255 között */
+    double edge_density; /**< a vízszintesen szomszédos pixelpárok közül azok aránya, amelyeknél a Lightness ugrása nagyobb EDGE_STEP-nél */
+} ImageStats;
+
+void image_stats(PPM_Image *image, ImageStats *stats);
+int stats_percentile(const long long histogram[256], long long total, double fraction);
+void print_stats(FILE *fp, ImageStats *stats);
+
+#endif
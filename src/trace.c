@@ -0,0 +1,175 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "trace.h"
+
+/**
+ * @file
+ * @brief A feldolgozás idővonalának rögzítése Chrome Trace Event formátumban
+ *
+ * Minden szál a saját gyűrűpufferébe írja az eseményeit (egy lépés, egy sáv, egy kiírt darab kezdete és vége), így az írás nem jár zárral. Ha a puffer megtelt, a legrégebbi eseményeket írjuk felül. A puffereket a program végén egyszerre írjuk ki a fájlba, ami a chrome://tracing vagy a Perfetto felületén megnyitható.
+ * Ha a rögzítés nincs bekapcsolva, a trace_begin egyetlen ellenőrzés, a trace_end pedig semmit nem csinál.
+ */
+
+#define TRACE_EVENTS 65536 /**< egy szál legfeljebb ennyi eseményét őrizzük meg */
+#define TRACE_NAME_SIZE 32 /**< a szál nevének legnagyobb hossza */
+
+/**
+ * @brief egy rögzített esemény
+ */
+typedef struct TraceEvent {
+    const char *name; /**< az esemény neve, statikus szöveg */
+    long long start; /**< a kezdete nanoszekundumban */
+    long long end; /**< a vége nanoszekundumban */
+    int first; /**< a feldolgozott sorok közül az első, -1 ha nincs */
+    int last; /**< az utolsó utáni sor */
+} TraceEvent;
+
+/**
+ * @brief egy szál eseményei
+ */
+typedef struct TraceBuffer {
+    struct TraceBuffer *next; /**< a következő szál puffere */
+    int tid; /**< a szál sorszáma a kimenetben */
+    char name[TRACE_NAME_SIZE]; /**< a szál neve */
+    long long count; /**< az eddig rögzített események száma, a pufferben csak az utolsó TRACE_EVENTS van meg */
+    TraceEvent events[TRACE_EVENTS]; /**< gyűrűpuffer */
+} TraceBuffer;
+
+static atomic_bool enabled = false; /**< be van-e kapcsolva a rögzítés */
+static FILE *output = NULL; /**< ide írjuk ki az eseményeket a végén */
+static long long origin = 0; /**< a rögzítés kezdete, az időpontokat ehhez képest írjuk ki */
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER; /**< a pufferek listájához */
+static TraceBuffer *buffers = NULL; /**< az összes szál puffere */
+static int threads = 0; /**< az eddig regisztrált szálak száma */
+static _Thread_local TraceBuffer *local = NULL; /**< a szál saját puffere */
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief a szál puffere, az első használatkor lefoglalva
+ * @param[out] buffer a puffer, NULL ha nem sikerült lefoglalni
+ */
+static TraceBuffer *local_buffer(void) {
+    if (local != NULL)
+        return local;
+    TraceBuffer *buffer = (TraceBuffer *) malloc(sizeof(TraceBuffer));
+    if (buffer == NULL)
+        return NULL;
+    buffer->count = 0;
+    pthread_mutex_lock(&buffers_lock);
+    buffer->tid = ++threads;
+    snprintf(buffer->name, TRACE_NAME_SIZE, "szál %d", buffer->tid);
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&buffers_lock);
+    local = buffer;
+    return buffer;
+}
+
+/**
+ * @brief bekapcsolja a rögzítést
+ * @param[in] *filename ebbe a fájlba írjuk ki az eseményeket a program végén
+ * @param[out] success false ha a fájlt nem lehet létrehozni
+ *
+ * A hívó szál lesz a főszál. A kiírás a program végén, az atexit-tel regisztrált trace_close-ban történik.
+ */
+bool trace_open(const char *filename) {
+    output = fopen(filename, "w");
+    if (output == NULL)
+        return false;
+    origin = now_ns();
+    atomic_store(&enabled, true);
+    trace_thread_name("főszál");
+    atexit(trace_close);
+    return true;
+}
+
+/** @brief be van-e kapcsolva a rögzítés */
+bool trace_enabled(void) {
+    return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+/**
+ * @brief egy esemény kezdete
+ * @param[out] start a kezdet időpontja, amit a trace_end-nek kell átadni, 0 ha a rögzítés nincs bekapcsolva
+ */
+long long trace_begin(void) {
+    return trace_enabled() ? now_ns() : 0;
+}
+
+/**
+ * @brief egy sorokhoz tartozó esemény vége
+ * @param[in] *name az esemény neve, statikus szöveg (csak a mutatóját tároljuk)
+ * @param[in] start a trace_begin eredménye
+ * @param[in] first az első feldolgozott sor
+ * @param[in] last az utolsó utáni feldolgozott sor
+ */
+void trace_end_range(const char *name, long long start, int first, int last) {
+    if (start == 0)
+        return;
+    TraceBuffer *buffer = local_buffer();
+    if (buffer == NULL)
+        return;
+    buffer->events[buffer->count % TRACE_EVENTS] = (TraceEvent) {name, start, now_ns(), first, last};
+    buffer->count++;
+}
+
+/**
+ * @brief egy esemény vége
+ * @param[in] *name az esemény neve, statikus szöveg (csak a mutatóját tároljuk)
+ * @param[in] start a trace_begin eredménye
+ */
+void trace_end(const char *name, long long start) {
+    trace_end_range(name, start, -1, -1);
+}
+
+/**
+ * @brief elnevezi a hívó szálat az idővonalon
+ * @param[in] *name a szál neve, legfeljebb TRACE_NAME_SIZE - 1 bájt marad meg belőle
+ */
+void trace_thread_name(const char *name) {
+    if (!trace_enabled())
+        return;
+    TraceBuffer *buffer = local_buffer();
+    if (buffer != NULL)
+        snprintf(buffer->name, TRACE_NAME_SIZE, "%s", name);
+}
+
+/**
+ * @brief kiírja a rögzített eseményeket, és kikapcsolja a rögzítést
+ *
+ * A program végén, amikor már egyik szál sem dolgozik, az atexit hívja. Minden szálhoz egy thread_name metaadat, és minden eseményhez egy "X" (kezdet és időtartam) esemény kerül a fájlba, mikroszekundumban.
+ */
+void trace_close(void) {
+    if (!atomic_exchange(&enabled, false) || output == NULL)
+        return;
+    fprintf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool comma = false;
+    pthread_mutex_lock(&buffers_lock);
+    for (TraceBuffer *buffer = buffers; buffer != NULL; buffer = buffer->next) {
+        fprintf(output, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", comma ? ",\n" : "", buffer->tid, buffer->name);
+        comma = true;
+        long long first = (buffer->count > TRACE_EVENTS) ? buffer->count - TRACE_EVENTS : 0;
+        for (long long i = first; i < buffer->count; i++) {
+            TraceEvent *event = &buffer->events[i % TRACE_EVENTS];
+            fprintf(output, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", event->name, buffer->tid, (event->start - origin) / 1e3, (event->end - event->start) / 1e3);
+            if (event->first >= 0)
+                fprintf(output, ",\"args\":{\"first\":%d,\"last\":%d}", event->first, event->last);
+            fprintf(output, "}");
+        }
+    }
+    pthread_mutex_unlock(&buffers_lock);
+    fprintf(output, "\n]}\n");
+    fclose(output);
+    output = NULL;
+}
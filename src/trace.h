@@ -0,0 +1,14 @@
+#ifndef TRACE
+#define TRACE
+
+#include <stdbool.h>
+
+bool trace_open(const char *filename);
+bool trace_enabled(void);
+long long trace_begin(void);
+void trace_end(const char *name, long long start);
+void trace_end_range(const char *name, long long start, int first, int last);
+void trace_thread_name(const char *name);
+void trace_close(void);
+
+#endif
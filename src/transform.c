@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ppm.h"
+#include "transform.h"
+#include "parallel.h"
+#include "memusage.h"
+#include "isa.h"
+
+/**
+ * @file
+ * @brief A kép pixeleinek átrendezése: transzponálás, forgatás és nyírás
+ */
+
+#define TRANSPOSE_BLOCK 32 /**< a transzponálás csempéinek mérete pixelben, a csempe forrás és cél sorai is elférnek az L1 gyorsítótárban */
+
+/**
+ * @brief a transzponálás és a nyírás adatai a szálak számára
+ */
+typedef struct TransformJob {
+    unsigned char ***src; /**< a bemeneti kép */
+    unsigned char ***dst; /**< a kimeneti kép */
+    int size_x; /**< a bemenet oszlopainak száma */
+    int size_y; /**< a bemenet sorainak száma */
+    int channels; /**< a színcsatornák száma */
+    const int *shift; /**< nyírásnál az oszloponkénti eltolás */
+} TransformJob;
+
+/**
+ * @brief a [first, last) csempesorok transzponálása
+ *
+ * A sávok a kimenet sorai (a bemenet oszlopai) szerint vannak felosztva, így a szálak a kimenet diszjunkt részeit írják.
+ */
+static void transpose_rows(int first, int last, void *data) {
+    TransformJob *job = (TransformJob *) data;
+    int x0 = first * TRANSPOSE_BLOCK;
+    int x1 = (last * TRANSPOSE_BLOCK < job->size_x) ? last * TRANSPOSE_BLOCK : job->size_x;
+    const IsaKernels *kernels = isa_kernels();
+
+    for (int bx = x0; bx < x1; bx += TRANSPOSE_BLOCK) {
+        int bx1 = (bx + TRANSPOSE_BLOCK < x1) ? bx + TRANSPOSE_BLOCK : x1;
+        for (int by = 0; by < job->size_y; by += TRANSPOSE_BLOCK) {
+            int by1 = (by + TRANSPOSE_BLOCK < job->size_y) ? by + TRANSPOSE_BLOCK : job->size_y;
+            kernels->transpose_tile(job->src, job->dst, by, by1, bx, bx1, job->channels);
+        }
+    }
+}
+
+/**
+ * @brief a kép transzponáltját a dst-be másolja: dst[j][i] = src[i][j]
+ * @param[in] ***src a bemeneti kép
+ * @param[in] size_x a bemenet oszlopainak száma
+ * @param[in] size_y a bemenet sorainak száma
+ * @param[in] ***dst a kimeneti kép, size_y oszloppal és size_x sorral; a sorai bárhol lehetnek a memóriában
+ * @param[in] channels a színcsatornák száma
+ *
+ * Egy oszlop bejárása soronként más memórialapra ugrik, ezért TRANSPOSE_BLOCK méretű csempékben dolgozunk: a csempe forrássorai és célsorai is a gyorsítótárban maradnak, amíg végzünk velük. A csempéket a transpose_tile kernel másolja, a csempesorokat párhuzamosan dolgozzuk fel.
+ * @see parallel_rows
+ */
+void transpose_copy(unsigned char ***src, int size_x, int size_y, unsigned char ***dst, int channels) {
+    TransformJob job = {src, dst, size_x, size_y, channels, NULL};
+    parallel_rows((size_x + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK, transpose_rows, &job);
+}
+
+/**
+ * @brief a nyírás [first, last) kimeneti sorai
+ *
+ * Mivel két szomszédos oszlop eltolása legfeljebb 1-gyel tér el, az azonos eltolású oszlopok összefüggő szakaszokat alkotnak, ezeket egyben másoljuk.
+ */
+static void shear_rows(int first, int last, void *data) {
+    TransformJob *job = (TransformJob *) data;
+    int channels = job->channels;
+
+    for (int line = first; line < last; line++) {
+        unsigned char *out = job->dst[line][0];
+        int x = 0;
+        while (x < job->size_x) {
+            int end = x + 1;
+            while (end < job->size_x && job->shift[end] == job->shift[x])
+                end++;
+            int row = line + job->shift[x];
+            if (row >= 0 && row < job->size_y)
+                memcpy(out + x * channels, job->src[row][x], (end - x) * channels);
+            else
+                memset(out + x * channels, 0, (end - x) * channels);
+            x = end;
+        }
+    }
+}
+
+/**
+ * @brief függőleges nyírás: dst[i][x] = src[i + shift[x]][x]
+ * @param[in] ***src a bemeneti kép
+ * @param[in] src_rows a bemenet sorainak száma
+ * @param[in] ***dst a kimeneti kép
+ * @param[in] dst_rows a kimenet sorainak száma
+ * @param[in] size_x a két kép oszlopainak száma
+ * @param[in] channels a színcsatornák száma
+ * @param[in] shift[] oszloponként az eltolás, a szomszédos oszlopoké legfeljebb 1-gyel térhet el
+ *
+ * A kimenet azon pixelei, amiknek a forrása kívül esik a bemeneten, feketék lesznek. A -shift eltolással ugyanez a függvény visszaállítja a bemenetet. A kimenet sorai párhuzamosan készülnek, és mindegyik a bemenet néhány egymás melletti sorának folytonos szakaszaiból áll.
+ */
+void shear_columns(unsigned char ***src, int src_rows, unsigned char ***dst, int dst_rows, int size_x, int channels, const int shift[]) {
+    TransformJob job = {src, dst, size_x, src_rows, channels, shift};
+    parallel_rows(dst_rows, shear_rows, &job);
+}
+
+/**
+ * @brief a 180 fokos forgatás [first, last) kimeneti sorai
+ */
+static void rotate180_rows(int first, int last, void *data) {
+    TransformJob *job = (TransformJob *) data;
+    int channels = job->channels;
+
+    for (int line = first; line < last; line++) {
+        const unsigned char *in = job->src[job->size_y - 1 - line][0];
+        unsigned char *out = job->dst[line][0];
+        for (int x = 0; x < job->size_x; x++)
+            memcpy(out + x * channels, in + (job->size_x - 1 - x) * channels, channels);
+    }
+}
+
+/**
+ * @brief a kép elforgatottját a dst-be másolja
+ * @param[in] ***src a bemeneti kép
+ * @param[in] size_x a bemenet oszlopainak száma
+ * @param[in] size_y a bemenet sorainak száma
+ * @param[in] ***dst a kimeneti kép; 90 és 270 foknál size_y oszloppal és size_x sorral, 180 foknál a bemenettel azonos méretű
+ * @param[in] channels a színcsatornák száma
+ * @param[in] degrees a forgatás szöge az óramutató járásával megegyező irányban: 90, 180 vagy 270
+ * @param[out] success false ha nem sikerült lefoglalni a memóriát, vagy a szög hibás
+ *
+ * A 90 fokos forgatás a fordított sorrendű bemenet transzponáltja, a 270 fokos a transzponált fordított sorrendben. Ehhez elég a sorok mutatóinak fordított sorrendű tömbjét átadni a transpose_copy-nak, így mindkét eset ugyanazzal a csempénkénti transzponálással, egyetlen menetben készül.
+ * @see transpose_copy
+ */
+bool rotate_copy(unsigned char ***src, int size_x, int size_y, unsigned char ***dst, int channels, int degrees) {
+    if (degrees == 180) {
+        TransformJob job = {src, dst, size_x, size_y, channels, NULL};
+        parallel_rows(size_y, rotate180_rows, &job);
+        return true;
+    }
+    if (degrees != 90 && degrees != 270)
+        return false;
+
+    /* 90 foknál a bemenet, 270 foknál a kimenet sorait fordítjuk meg */
+    unsigned char ***rows = (degrees == 90) ? src : dst;
+    int count = (degrees == 90) ? size_y : size_x;
+    unsigned char ***reversed = (unsigned char ***) mem_alloc(count * sizeof(unsigned char **));
+    if (reversed == NULL)
+        return false;
+    for (int i = 0; i < count; i++)
+        reversed[i] = rows[count - 1 - i];
+    if (degrees == 90)
+        transpose_copy(reversed, size_x, size_y, dst, channels);
+    else
+        transpose_copy(src, size_x, size_y, reversed, channels);
+    mem_free(reversed);
+    return true;
+}
+
+/** @brief két pixel tartalmának cseréje */
+static inline void swap_pixels(unsigned char *a, unsigned char *b, int channels) {
+    for (int color = 0; color < channels; color++) {
+        unsigned char temp = a[color];
+        a[color] = b[color];
+        b[color] = temp;
+    }
+}
+
+/**
+ * @brief a helyben transzponálás egy csempesora: az átló feletti csempéket a tükörképükkel cseréljük
+ * @param[in] *job a kép (src), size_x a négyzet oldala
+ * @param[in] tile a csempesor sorszáma
+ */
+static void transpose_tile_row(TransformJob *job, int tile) {
+    int size = job->size_x;
+    int y0 = tile * TRANSPOSE_BLOCK;
+    int y1 = (y0 + TRANSPOSE_BLOCK < size) ? y0 + TRANSPOSE_BLOCK : size;
+
+    for (int x0 = y0; x0 < size; x0 += TRANSPOSE_BLOCK) {
+        int x1 = (x0 + TRANSPOSE_BLOCK < size) ? x0 + TRANSPOSE_BLOCK : size;
+        for (int y = y0; y < y1; y++) {
+            /* az átlón lévő csempében csak az átló feletti pixeleket cseréljük, különben visszacserélnénk őket */
+            for (int x = (x0 == y0) ? y + 1 : x0; x < x1; x++)
+                swap_pixels(job->src[y][x], job->src[x][y], job->channels);
+        }
+    }
+}
+
+/**
+ * @brief a helyben transzponálás [first, last) csempesor-párjai
+ *
+ * Az i. csempesorban az átló miatt egyre kevesebb csempe van, ezért az i. és az utolsó előtti i. csempesort párba állítjuk, így minden pár ugyanannyi munka.
+ */
+static void transpose_square_rows(int first, int last, void *data) {
+    TransformJob *job = (TransformJob *) data;
+    int tiles = (job->size_x + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+
+    for (int pair = first; pair < last; pair++) {
+        transpose_tile_row(job, pair);
+        if (tiles - 1 - pair != pair)
+            transpose_tile_row(job, tiles - 1 - pair);
+    }
+}
+
+/**
+ * @brief négyzetes kép transzponálása a helyén, másolat nélkül
+ * @param[in] ***image a kép
+ * @param[in] size a kép oszlopainak és sorainak száma
+ * @param[in] channels a színcsatornák száma
+ * @see transpose_copy
+ */
+void transpose_square(unsigned char ***image, int size, int channels) {
+    TransformJob job = {image, image, size, size, channels, NULL};
+    int tiles = (size + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+    parallel_rows((tiles + 1) / 2, transpose_square_rows, &job);
+}
+
+/** @brief a [first, last) sorok megfordítása a helyükön (tükrözés a függőleges tengelyre) */
+static void reverse_rows(int first, int last, void *data) {
+    TransformJob *job = (TransformJob *) data;
+    for (int line = first; line < last; line++) {
+        for (int x = 0; x < job->size_x / 2; x++)
+            swap_pixels(job->src[line][x], job->src[line][job->size_x - 1 - x], job->channels);
+    }
+}
+
+/** @brief a [first, last) sorok cseréje a tükörképükkel (tükrözés a vízszintes tengelyre), first és last a kép felső felében */
+static void swap_rows(int first, int last, void *data) {
+    TransformJob *job = (TransformJob *) data;
+    for (int line = first; line < last; line++) {
+        unsigned char *a = job->src[line][0];
+        unsigned char *b = job->src[job->size_y - 1 - line][0];
+        for (int k = 0; k < job->size_x * job->channels; k++) {
+            unsigned char temp = a[k];
+            a[k] = b[k];
+            b[k] = temp;
+        }
+    }
+}
+
+/**
+ * @brief a kép forgatása a helyén, másolat nélkül
+ * @param[in] *image a kép; 90 és 270 foknál négyzetesnek kell lennie
+ * @param[in] degrees a forgatás szöge az óramutató járásával megegyező irányban: 90, 180 vagy 270
+ *
+ * A 90 fokos forgatás a transzponált soronként megfordítva, a 270 fokos a transzponált fordított sorrendben, a 180 fokos pedig mindkét tükrözés egymás után.
+ * @see rotate_copy
+ */
+static void rotate_inplace(PPM_Image *image, int degrees) {
+    TransformJob job = {image->image_data, image->image_data, image->size_x, image->size_y, image->channels, NULL};
+    if (degrees != 180)
+        transpose_square(image->image_data, image->size_x, image->channels);
+    if (degrees != 270)
+        parallel_rows(image->size_y, reverse_rows, &job);
+    if (degrees != 90)
+        parallel_rows(image->size_y / 2, swap_rows, &job);
+}
+
+/**
+ * @brief transzponálja a képet (a bal felső - jobb alsó átlóra tükrözi)
+ * @param[in] *image a kép, a helyére kerül az új, felcserélt méretekkel
+ *
+ * Az új kép mellett csak a régi van a memóriában, amit a másolás után felszabadítunk. Ha az új képet nem lehet lefoglalni (pl. a memóriakorlát miatt), a négyzetes képet a helyén transzponáljuk.
+ * @see transpose_copy
+ * @see transpose_square
+ */
+void transpose_image(PPM_Image *image) {
+    unsigned char ***dst = allocateimage_channels(image->size_y, image->size_x, image->channels);
+    if (dst == NULL && image->size_x == image->size_y) {
+        transpose_square(image->image_data, image->size_x, image->channels);
+        return;
+    }
+    if (dst == NULL) {
+        perror("error allocating image");
+        abort();
+    }
+    transpose_copy(image->image_data, image->size_x, image->size_y, dst, image->channels);
+
+    freeimage(image->image_data, image->size_x, image->size_y);
+    image->image_data = dst;
+    int size_x = image->size_x;
+    image->size_x = image->size_y;
+    image->size_y = size_x;
+}
+
+/**
+ * @brief elforgatja a képet
+ * @param[in] *image a kép, a helyére kerül az új; 90 és 270 foknál felcserélt méretekkel
+ * @param[in] degrees a forgatás szöge az óramutató járásával megegyező irányban: 90, 180 vagy 270, más értéknél a kép nem változik
+ *
+ * Ha az új képet nem lehet lefoglalni, a 180 fokos forgatást és a négyzetes kép forgatását a helyén végezzük el.
+ * @see rotate_copy
+ * @see rotate_inplace
+ */
+void rotate_image(PPM_Image *image, int degrees) {
+    if (degrees != 90 && degrees != 180 && degrees != 270)
+        return;
+    int new_x = (degrees == 180) ? image->size_x : image->size_y;
+    int new_y = (degrees == 180) ? image->size_y : image->size_x;
+    unsigned char ***dst = allocateimage_channels(new_x, new_y, image->channels);
+    if (dst == NULL && (degrees == 180 || image->size_x == image->size_y)) {
+        rotate_inplace(image, degrees);
+        return;
+    }
+    if (dst == NULL || !rotate_copy(image->image_data, image->size_x, image->size_y, dst, image->channels, degrees)) {
+        perror("error allocating image");
+        abort();
+    }
+
+    freeimage(image->image_data, image->size_x, image->size_y);
+    image->image_data = dst;
+    image->size_x = new_x;
+    image->size_y = new_y;
+}
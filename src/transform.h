@@ -0,0 +1,13 @@
+#ifndef TRANSFORM
+#define TRANSFORM
+
+#include "ppm.h"
+
+void transpose_copy(unsigned char ***src, int size_x, int size_y, unsigned char ***dst, int channels);
+void transpose_square(unsigned char ***image, int size, int channels);
+bool rotate_copy(unsigned char ***src, int size_x, int size_y, unsigned char ***dst, int channels, int degrees);
+void transpose_image(PPM_Image *image);
+void rotate_image(PPM_Image *image, int degrees);
+void shear_columns(unsigned char ***src, int src_rows, unsigned char ***dst, int dst_rows, int size_x, int channels, const int shift[]);
+
+#endif
@@ -0,0 +1,628 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ppm.h"
+#include "imagefunc.h"
+#include "resample.h"
+#include "parallel.h"
+#include "isa.h"
+#include "memusage.h"
+#include "verify.h"
+
+/**
+ * @file
+ * @brief Az optimalizált függvények összevetése az egyszerű, soros referencia változatukkal
+ */
+
+/**
+ * @brief egy ellenőrzés: ugyanazon a képen lefuttatjuk az optimalizált és a referencia változatot
+ */
+typedef struct KernelCheck {
+    const char *name; /**< az ellenőrzés neve */
+    void (*optimised)(PPM_Image *image); /**< az éles kódban használt változat */
+    void (*reference)(PPM_Image *image); /**< az egyszerű, soros változat */
+    int tolerance; /**< a megengedett legnagyobb eltérés */
+} KernelCheck;
+
+/**
+ * @brief a referencia konvolúció: iterációnként a teljes képen, double összegzéssel
+ *
+ * Ez a convolve eredeti, csempék nélküli változata, bármennyi színcsatornára.
+ * @see convolve
+ */
+static void ref_convolve(unsigned char ***original, int size_x, int size_y, Filter filter, int times, int channels) {
+    unsigned char ***newmatrix = allocateimage_channels(size_x, size_y, channels);
+    int filterCenterX = filter.size_x / 2;
+    int filterCenterY = filter.size_y / 2;
+
+    for (int ttimes = 0; ttimes < times; ttimes++) {
+        for (int i = 0; i < size_y; i++) {
+            for (int j = 0; j < size_x; j++) {
+                double sum[3] = {0, 0, 0};
+                for (int k = 0; k < filter.size_y; k++) {
+                    int kk = filter.size_y - 1 - k;
+                    for (int l = 0; l < filter.size_x; l++) {
+                        int ll = filter.size_x - 1 - l;
+                        int ii = clamp(i + (filterCenterY - kk), 0, size_y-1);
+                        int jj = clamp(j + (filterCenterX - ll), 0, size_x-1);
+                        for (int color = 0; color < channels; color++)
+                            sum[color] += original[ii][jj][color] * filter.mult*filter.filt[kk][ll];
+                    }
+                }
+                for (int color = 0; color < channels; color++)
+                    newmatrix[i][j][color] = (unsigned char) clamp(sum[color], 0, 255);
+            }
+        }
+        memcpy(original[0][0], newmatrix[0][0], (size_t) size_x * size_y * channels);
+    }
+    freeimage(newmatrix, size_x, size_y);
+}
+
+/**
+ * @brief a referencia RGB shift: a színeket lépésenként, egyesével forgatjuk
+ * @see rgb_shift
+ */
+static void ref_rgb_shift(PPM_Image *image, RGB_SHIFT options) {
+    int shift_x[3] = {options.red_x, options.green_x, options.blue_x};
+    int shift_y[3] = {options.red_y, options.green_y, options.blue_y};
+    unsigned char ***data = image->image_data;
+
+    for (int color = 0; color < 3; color++) {
+        for (int line = 0; line < image->size_y; line++) {
+            for (int step = 0; step < abs(shift_x[color]); step++) {
+                if (shift_x[color] > 0) {
+                    unsigned char last = data[line][image->size_x-1][color];
+                    for (int col = image->size_x-1; col > 0; col--)
+                        data[line][col][color] = data[line][col-1][color];
+                    data[line][0][color] = last;
+                }
+                else {
+                    unsigned char first = data[line][0][color];
+                    for (int col = 0; col < image->size_x-1; col++)
+                        data[line][col][color] = data[line][col+1][color];
+                    data[line][image->size_x-1][color] = first;
+                }
+            }
+        }
+        for (int col = 0; col < image->size_x; col++) {
+            for (int step = 0; step < abs(shift_y[color]); step++) {
+                if (shift_y[color] > 0) {
+                    unsigned char last = data[image->size_y-1][col][color];
+                    for (int line = image->size_y-1; line > 0; line--)
+                        data[line][col][color] = data[line-1][col][color];
+                    data[0][col][color] = last;
+                }
+                else {
+                    unsigned char first = data[0][col][color];
+                    for (int line = 0; line < image->size_y-1; line++)
+                        data[line][col][color] = data[line+1][col][color];
+                    data[image->size_y-1][col][color] = first;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief a referencia átméretezés: double pontosságú súlyokkal, kerekítés csak a végén
+ * @see resize_image
+ */
+static void ref_resize(PPM_Image *image, int new_x, int new_y, resample_filter filter) {
+    int channels = image->channels;
+    int sizes_in[2] = {image->size_x, image->size_y};
+    int sizes_out[2] = {new_x, new_y};
+    double *weights[2];
+    int *starts[2];
+    int *counts[2];
+    int taps[2];
+
+    for (int axis = 0; axis < 2; axis++) {
+        int in = sizes_in[axis], out = sizes_out[axis];
+        double scale = (double) in / out;
+        double stretch = (scale > 1.0) ? scale : 1.0;
+        double support = ((filter == box_filter) ? 0.5 : (filter == bilinear_filter) ? 1.0 : 3.0) * stretch;
+        taps[axis] = (int) ceil(support) * 2 + 1;
+        weights[axis] = (double *) calloc(out * taps[axis], sizeof(double));
+        starts[axis] = (int *) malloc(out * sizeof(int));
+        counts[axis] = (int *) malloc(out * sizeof(int));
+        for (int i = 0; i < out; i++) {
+            double center = (i + 0.5) * scale;
+            int first = (int) floor(center - support + 0.5);
+            int last = (int) floor(center + support + 0.5);
+            first = (first < 0) ? 0 : first;
+            last = (last > in) ? in : last;
+            if (last - first > taps[axis])
+                last = first + taps[axis];
+            double total = 0;
+            for (int j = first; j < last; j++) {
+                double x = (j + 0.5 - center) / stretch;
+                double value;
+                if (filter == box_filter)
+                    value = (x > -0.5 && x <= 0.5) ? 1.0 : 0.0;
+                else if (filter == bilinear_filter)
+                    value = (fabs(x) < 1.0) ? 1.0 - fabs(x) : 0.0;
+                else if (x == 0.0)
+                    value = 1.0;
+                else if (fabs(x) < 3.0)
+                    value = sin(M_PI * x) / (M_PI * x) * sin(M_PI * x / 3.0) / (M_PI * x / 3.0);
+                else
+                    value = 0.0;
+                weights[axis][i * taps[axis] + j - first] = value;
+                total += value;
+            }
+            for (int j = 0; j < last - first; j++)
+                weights[axis][i * taps[axis] + j] /= total;
+            starts[axis][i] = first;
+            counts[axis][i] = last - first;
+        }
+    }
+
+    double *rows = (double *) calloc((size_t) new_x * image->size_y * channels, sizeof(double));
+    for (int y = 0; y < image->size_y; y++) {
+        for (int x = 0; x < new_x; x++) {
+            for (int k = 0; k < counts[0][x]; k++) {
+                for (int color = 0; color < channels; color++)
+                    rows[(y * new_x + x) * channels + color] += weights[0][x * taps[0] + k] * image->image_data[y][starts[0][x] + k][color];
+            }
+        }
+    }
+    unsigned char ***result = allocateimage_channels(new_x, new_y, channels);
+    for (int y = 0; y < new_y; y++) {
+        for (int x = 0; x < new_x; x++) {
+            for (int color = 0; color < channels; color++) {
+                double sum = 0;
+                for (int k = 0; k < counts[1][y]; k++)
+                    sum += weights[1][y * taps[1] + k] * rows[((starts[1][y] + k) * new_x + x) * channels + color];
+                result[y][x][color] = (unsigned char) clamp(round(sum), 0, 255);
+            }
+        }
+    }
+    free(rows);
+    for (int axis = 0; axis < 2; axis++) {
+        free(weights[axis]);
+        free(starts[axis]);
+        free(counts[axis]);
+    }
+    freeimage(image->image_data, image->size_x, image->size_y);
+    image->image_data = result;
+    image->size_x = new_x;
+    image->size_y = new_y;
+}
+
+/**
+ * @brief a referencia kicsinyített beolvasás: teljes méretű beolvasás, majd blokkonkénti átlag
+ * @see PPM_ReadFrameScaled
+ */
+static void ref_preview(PPM_Image *image, const char *magic, int shrink) {
+    FILE *fp = tmpfile();
+    strcpy(image->magic, magic);
+    if (!PPM_WriteFrame(fp, image)) {
+        perror("error allocating buffer");
+        abort();
+    }
+    rewind(fp);
+    PPM_Image full;
+    PPM_ReadFrame(fp, &full);
+    fclose(fp);
+
+    int out_x = (full.size_x + shrink - 1) / shrink;
+    int out_y = (full.size_y + shrink - 1) / shrink;
+    unsigned char ***result = allocateimage(out_x, out_y);
+    for (int y = 0; y < out_y; y++) {
+        for (int x = 0; x < out_x; x++) {
+            for (int color = 0; color < 3; color++) {
+                int sum = 0, count = 0;
+                for (int i = y * shrink; i < y * shrink + shrink && i < full.size_y; i++) {
+                    for (int j = x * shrink; j < x * shrink + shrink && j < full.size_x; j++) {
+                        sum += full.image_data[i][j][color];
+                        count++;
+                    }
+                }
+                result[y][x][color] = (sum + count / 2) / count;
+            }
+        }
+    }
+    freeimage(full.image_data, full.size_x, full.size_y);
+    freeimage(image->image_data, image->size_x, image->size_y);
+    image->image_data = result;
+    image->size_x = out_x;
+    image->size_y = out_y;
+    image->channels = 3;
+}
+
+/** @brief a kicsinyített beolvasás egy ideiglenes fájlon keresztül */
+static void opt_preview(PPM_Image *image, const char *magic, int shrink) {
+    FILE *fp = tmpfile();
+    strcpy(image->magic, magic);
+    if (!PPM_WriteFrame(fp, image)) {
+        perror("error allocating buffer");
+        abort();
+    }
+    rewind(fp);
+    freeimage(image->image_data, image->size_x, image->size_y);
+    PPM_ReadFrameScaled(fp, image, shrink);
+    fclose(fp);
+}
+
+/** @brief a blur és a sharpen filtere */
+static Filter check_filter(bool blur) {
+    Filter filter;
+    if (blur)
+        setfilter(&filter, (int[]) {1, 2, 1, 2, 4, 2, 1, 2, 1}, 1/16.0, 3, 3);
+    else
+        setfilter(&filter, (int[]) {0, -1, 0, -1, 5, -1, 0, -1, 0}, 1, 3, 3);
+    return filter;
+}
+
+static void opt_blur(PPM_Image *image) {
+    Filter filter = check_filter(true);
+    convolve(image->image_data, image->size_x, image->size_y, filter, 11, image->channels);
+    freefilter(filter);
+}
+static void ref_blur(PPM_Image *image) {
+    Filter filter = check_filter(true);
+    ref_convolve(image->image_data, image->size_x, image->size_y, filter, 11, image->channels);
+    freefilter(filter);
+}
+static void opt_blur_gray(PPM_Image *image) {
+    grayscale_image(image);
+    opt_blur(image);
+}
+static void ref_blur_gray(PPM_Image *image) {
+    grayscale_image(image);
+    ref_blur(image);
+}
+/**
+ * @brief a convolve sávonkénti változata: a korlát miatt a kép másolatát nem tudja lefoglalni
+ *
+ * A korlátba a csempék és a sávok pufferei még beleférnek, egy újabb kép (a mutatóival együtt) már nem.
+ */
+static void opt_blur_banded(PPM_Image *image) {
+    long long limit = mem_limit();
+    mem_set_limit(mem_current() + convolve_bytes(image->size_x, image->size_y, 11, image->channels, true) + 64);
+    opt_blur(image);
+    mem_set_limit(limit);
+}
+static void opt_sharpen(PPM_Image *image) {
+    Filter filter = check_filter(false);
+    convolve(image->image_data, image->size_x, image->size_y, filter, 3, image->channels);
+    freefilter(filter);
+}
+static void ref_sharpen(PPM_Image *image) {
+    Filter filter = check_filter(false);
+    ref_convolve(image->image_data, image->size_x, image->size_y, filter, 3, image->channels);
+    freefilter(filter);
+}
+
+static const RGB_SHIFT check_shift = {7, -3, -250, 0, 1, 161};
+static void opt_rgb_shift(PPM_Image *image) {
+    rgb_shift(image, check_shift);
+}
+static void ref_rgb_shift_check(PPM_Image *image) {
+    ref_rgb_shift(image, check_shift);
+}
+
+static void opt_colors(PPM_Image *image) {
+    light_contrast_hue(image, 17, -12, 40);
+}
+static void ref_colors(PPM_Image *image) {
+    for (int i = 0; i < image->size_y; i++) {
+        for (int j = 0; j < image->size_x; j++) {
+            change_light(image->image_data[i][j], 17);
+            contrast(image->image_data[i][j], -12);
+            hue_shift(image->image_data[i][j], 40);
+        }
+    }
+}
+static void ref_colors_generic(PPM_Image *image) {
+    isa_level level = isa_current();
+    int threads = parallel_threads();
+    isa_select(isa_generic);
+    parallel_set_threads(1);
+    opt_colors(image);
+    parallel_set_threads(threads);
+    isa_select(level);
+}
+
+/** @brief a pixelsort referenciája ugyanaz a függvény egy szálon, ugyanazzal a kezdőértékkel */
+static void opt_pixelsort(PPM_Image *image) {
+    PsOptions options = {hsl_l, ran, 0, 30, 40, 100, ran, image->size_x/30, image->size_x/10 + 1, 0.5, 0};
+    srand(1);
+    pixelsort(image->image_data, image->size_x, image->size_y, options, NULL);
+}
+static void ref_pixelsort(PPM_Image *image) {
+    int threads = parallel_threads();
+    parallel_set_threads(1);
+    opt_pixelsort(image);
+    parallel_set_threads(threads);
+}
+static void opt_pixelsort_edges(PPM_Image *image) {
+    PsOptions options;
+    options.pstype = edges;
+    options.angle = 0;
+    pixelsort(image->image_data, image->size_x, image->size_y, options, NULL);
+}
+static void ref_pixelsort_edges(PPM_Image *image) {
+    int threads = parallel_threads();
+    parallel_set_threads(1);
+    opt_pixelsort_edges(image);
+    parallel_set_threads(threads);
+}
+
+/** @brief a függőleges pixelsort referenciája: oszloponként, csempék nélkül transzponálunk, és a vízszintes pixelsortot futtatjuk egy szálon */
+static void opt_pixelsort_vertical(PPM_Image *image) {
+    PsOptions options = {hsl_l, ran, 0, 30, 40, 100, ran, image->size_y/30, image->size_y/10 + 1, 0.5, 90};
+    srand(1);
+    pixelsort(image->image_data, image->size_x, image->size_y, options, NULL);
+}
+static void ref_pixelsort_vertical(PPM_Image *image) {
+    unsigned char ***columns = allocateimage(image->size_y, image->size_x);
+    for (int i = 0; i < image->size_y; i++)
+        for (int j = 0; j < image->size_x; j++)
+            memcpy(columns[j][i], image->image_data[i][j], 3);
+    PsOptions options = {hsl_l, ran, 0, 30, 40, 100, ran, image->size_y/30, image->size_y/10 + 1, 0.5, 0};
+    int threads = parallel_threads();
+    parallel_set_threads(1);
+    srand(1);
+    pixelsort(columns, image->size_y, image->size_x, options, NULL);
+    parallel_set_threads(threads);
+    for (int i = 0; i < image->size_y; i++)
+        for (int j = 0; j < image->size_x; j++)
+            memcpy(image->image_data[i][j], columns[j][i], 3);
+    freeimage(columns, image->size_y, image->size_x);
+}
+static void opt_pixelsort_angle(PPM_Image *image) {
+    PsOptions options;
+    options.pstype = edges;
+    options.angle = 120;
+    pixelsort(image->image_data, image->size_x, image->size_y, options, NULL);
+}
+static void ref_pixelsort_angle(PPM_Image *image) {
+    int threads = parallel_threads();
+    parallel_set_threads(1);
+    opt_pixelsort_angle(image);
+    parallel_set_threads(threads);
+}
+
+/**
+ * @brief a referencia medián szűrő: minden pixelnél a teljes ablak hisztogramjából
+ * @see median_filter
+ */
+static void ref_median(PPM_Image *image, int radius) {
+    unsigned char ***result = allocateimage_channels(image->size_x, image->size_y, image->channels);
+    int target = (2 * radius + 1) * (2 * radius + 1) / 2;
+    for (int i = 0; i < image->size_y; i++) {
+        for (int j = 0; j < image->size_x; j++) {
+            for (int color = 0; color < image->channels; color++) {
+                int histogram[256] = {0};
+                for (int k = -radius; k <= radius; k++)
+                    for (int l = -radius; l <= radius; l++)
+                        histogram[image->image_data[(int) clamp(i + k, 0, image->size_y - 1)][(int) clamp(j + l, 0, image->size_x - 1)][color]]++;
+                int value = 0;
+                for (int sum = histogram[0]; sum <= target; sum += histogram[++value]);
+                result[i][j][color] = (unsigned char) value;
+            }
+        }
+    }
+    memcpy(image->image_data[0][0], result[0][0], (size_t) image->size_x * image->size_y * image->channels);
+    freeimage(result, image->size_x, image->size_y);
+}
+static void opt_median(PPM_Image *image) {
+    median_filter(image->image_data, image->size_x, image->size_y, image->channels, 2);
+}
+static void ref_median_check(PPM_Image *image) {
+    ref_median(image, 2);
+}
+static void opt_median_wide(PPM_Image *image) {
+    median_filter(image->image_data, image->size_x, image->size_y, image->channels, 11);
+}
+static void ref_median_wide(PPM_Image *image) {
+    ref_median(image, 11);
+}
+
+static void opt_resize_box(PPM_Image *image) {
+    resize_image(image, image->size_x * 2 / 5 + 1, image->size_y * 2 / 5 + 1, box_filter);
+}
+static void ref_resize_box(PPM_Image *image) {
+    ref_resize(image, image->size_x * 2 / 5 + 1, image->size_y * 2 / 5 + 1, box_filter);
+}
+static void opt_resize_bilinear(PPM_Image *image) {
+    resize_image(image, image->size_x * 2 / 5 + 1, image->size_y * 3 / 2 + 1, bilinear_filter);
+}
+static void ref_resize_bilinear(PPM_Image *image) {
+    ref_resize(image, image->size_x * 2 / 5 + 1, image->size_y * 3 / 2 + 1, bilinear_filter);
+}
+static void opt_resize_lanczos(PPM_Image *image) {
+    resize_image(image, image->size_x * 3 / 2 + 1, image->size_y / 3 + 1, lanczos_filter);
+}
+static void ref_resize_lanczos(PPM_Image *image) {
+    ref_resize(image, image->size_x * 3 / 2 + 1, image->size_y / 3 + 1, lanczos_filter);
+}
+
+static void opt_preview_p6(PPM_Image *image) {
+    opt_preview(image, "P6", 2);
+}
+static void ref_preview_p6(PPM_Image *image) {
+    ref_preview(image, "P6", 2);
+}
+static void opt_preview_p3(PPM_Image *image) {
+    opt_preview(image, "P3", 8);
+}
+static void ref_preview_p3(PPM_Image *image) {
+    ref_preview(image, "P3", 8);
+}
+
+/**
+ * @brief a regisztrált ellenőrzések
+ *
+ * Az átméretezés fixpontos súlyokkal számol, ezért térhet el 1-gyel a referenciától. A light_contrast_hue utasításkészletenként lefordított változatainak az általános változattal egy szálon is bitre meg kell egyezniük (colors-isa).
+ */
+static const KernelCheck checks[] = {
+    {"blur", opt_blur, ref_blur, 0},
+    {"blur-gray", opt_blur_gray, ref_blur_gray, 0},
+    {"blur-banded", opt_blur_banded, ref_blur, 0},
+    {"sharpen", opt_sharpen, ref_sharpen, 0},
+    {"rgb-shift", opt_rgb_shift, ref_rgb_shift_check, 0},
+    {"colors", opt_colors, ref_colors, 0},
+    {"colors-isa", opt_colors, ref_colors_generic, 0},
+    {"pixelsort", opt_pixelsort, ref_pixelsort, 0},
+    {"pixelsort-edges", opt_pixelsort_edges, ref_pixelsort_edges, 0},
+    {"pixelsort-vert", opt_pixelsort_vertical, ref_pixelsort_vertical, 0},
+    {"pixelsort-angle", opt_pixelsort_angle, ref_pixelsort_angle, 0},
+    {"median", opt_median, ref_median_check, 0},
+    {"median-wide", opt_median_wide, ref_median_wide, 0},
+    {"resize-box", opt_resize_box, ref_resize_box, 1},
+    {"resize-bilinear", opt_resize_bilinear, ref_resize_bilinear, 1},
+    {"resize-lanczos", opt_resize_lanczos, ref_resize_lanczos, 1},
+    {"preview-p6", opt_preview_p6, ref_preview_p6, 0},
+    {"preview-p3", opt_preview_p3, ref_preview_p3, 0},
+};
+
+static const int check_sizes[][2] = {{1, 1}, {2, 3}, {17, 13}, {64, 64}, {203, 151}, {640, 480}}; /**< a szintetikus képek méretei */
+static const int check_threads[] = {1, 2, 3, 8}; /**< ennyi szálon futtatjuk az optimalizált változatot */
+
+/**
+ * @brief előállít egy szintetikus képet
+ * @param[in] size_x a kép oszlopainak száma
+ * @param[in] size_y a kép sorainak száma
+ *
+ * A kép színátmenetekből, zajból és éles szélű téglalapokból áll, így a küszöbök, az élek és a szűrők is dolgoznak rajta.
+ */
+static PPM_Image synthetic_image(int size_x, int size_y) {
+    PPM_Image image;
+    image.size_x = size_x;
+    image.size_y = size_y;
+    image.channels = 3;
+    image.maxval = 255;
+    strcpy(image.magic, "P6");
+    image.image_data = allocateimage(size_x, size_y);
+    unsigned int seed = size_x * 7919u + size_y;
+    for (int i = 0; i < size_y; i++) {
+        for (int j = 0; j < size_x; j++) {
+            bool block = ((i / 9) + (j / 13)) % 3 == 0;
+            for (int color = 0; color < 3; color++) {
+                int value = (j * 255 / size_x + i * (color + 1) * 97 / size_y) % 256;
+                value = block ? 255 - value : value;
+                value += rand_r(&seed) % 31 - 15;
+                image.image_data[i][j][color] = (unsigned char) clamp(value, 0, 255);
+            }
+        }
+    }
+    return image;
+}
+
+/** @brief a kép másolata */
+static PPM_Image copyimage(PPM_Image *image) {
+    PPM_Image copy = *image;
+    copy.image_data = allocateimage_channels(image->size_x, image->size_y, image->channels);
+    memcpy(copy.image_data[0][0], image->image_data[0][0], (size_t) image->size_x * image->size_y * image->channels);
+    return copy;
+}
+
+/**
+ * @brief két kép összevetése
+ * @param[in] *a az egyik kép
+ * @param[in] *b a másik kép
+ * @param[in] *first ide kerül az első eltérés helye (oszlop, sor, szín), ha van
+ * @param[out] difference a legnagyobb eltérés, -1 ha a méretük sem egyezik
+ */
+static int compare_images(PPM_Image *a, PPM_Image *b, int first[3]) {
+    if (a->size_x != b->size_x || a->size_y != b->size_y || a->channels != b->channels)
+        return -1;
+    int difference = 0;
+    for (int i = 0; i < a->size_y; i++) {
+        for (int j = 0; j < a->size_x; j++) {
+            for (int color = 0; color < a->channels; color++) {
+                int d = abs(a->image_data[i][j][color] - b->image_data[i][j][color]);
+                if (d > 0 && difference == 0) {
+                    first[0] = j;
+                    first[1] = i;
+                    first[2] = color;
+                }
+                difference = (d > difference) ? d : difference;
+            }
+        }
+    }
+    return difference;
+}
+
+/**
+ * @brief egy ellenőrzés egy képen, az összes támogatott utasításkészlettel és szálszámmal
+ * @param[out] success false ha az eltérés nagyobb a megengedettnél
+ *
+ * A referencia változat a hívó szálszámával fut (pl. --threads), ezt az optimalizált futások után visszaállítjuk.
+ */
+static bool run_check(const KernelCheck *check, PPM_Image *input) {
+    PPM_Image reference = copyimage(input);
+    check->reference(&reference);
+
+    isa_level selected = isa_current();
+    int threads = parallel_threads();
+    int worst = 0;
+    int worst_threads = 0;
+    const char *worst_isa = "";
+    int first[3] = {0, 0, 0};
+    for (int level = isa_generic; level < isa_count; level++) {
+        if (!isa_supported((isa_level) level))
+            continue;
+        isa_select((isa_level) level);
+        for (size_t t = 0; t < sizeof(check_threads) / sizeof(check_threads[0]); t++) {
+            parallel_set_threads(check_threads[t]);
+            PPM_Image optimised = copyimage(input);
+            check->optimised(&optimised);
+            int location[3] = {0, 0, 0};
+            int difference = compare_images(&optimised, &reference, location);
+            if (difference < 0 || (worst >= 0 && difference > worst)) {
+                worst = difference;
+                worst_threads = check_threads[t];
+                worst_isa = isa_kernels()->name;
+                memcpy(first, location, sizeof(first));
+            }
+            freeimage(optimised.image_data, optimised.size_x, optimised.size_y);
+        }
+    }
+    isa_select(selected);
+    parallel_set_threads(threads);
+    freeimage(reference.image_data, reference.size_x, reference.size_y);
+
+    bool success = (worst >= 0 && worst <= check->tolerance);
+    if (worst < 0)
+        printf("%-16s %4dx%-4d eltérő méret (%s, %d szál)  HIBA\n", check->name, input->size_x, input->size_y, worst_isa, worst_threads);
+    else if (worst == 0)
+        printf("%-16s %4dx%-4d max eltérés: 0  OK\n", check->name, input->size_x, input->size_y);
+    else
+        printf("%-16s %4dx%-4d max eltérés: %d (%s, %d szál), első eltérés: (%d, %d) szín %d  %s\n", check->name, input->size_x, input->size_y,
+            worst, worst_isa, worst_threads, first[0], first[1], first[2], success ? "OK" : "HIBA");
+    return success;
+}
+
+/**
+ * @brief az optimalizált függvények ellenőrzése
+ * @param[in] *input a vizsgált kép, NULL esetén szintetikus képek több méretben
+ * @param[out] failures a sikertelen ellenőrzések száma
+ *
+ * Minden regisztrált ellenőrzésnél a referencia változatot egyszer, az optimalizáltat minden támogatott utasításkészlettel és több szálszámmal futtatjuk ugyanazon a képen, és kiírjuk a legnagyobb eltérést és az első eltérő minta helyét.
+ * @see KernelCheck
+ */
+int verify_kernels(PPM_Image *input) {
+    int failures = 0;
+    size_t count = sizeof(checks) / sizeof(checks[0]);
+
+    if (input != NULL) {
+        expand_rgb(input);
+        for (size_t i = 0; i < count; i++)
+            failures += !run_check(&checks[i], input);
+    }
+    else {
+        for (size_t s = 0; s < sizeof(check_sizes) / sizeof(check_sizes[0]); s++) {
+            PPM_Image image = synthetic_image(check_sizes[s][0], check_sizes[s][1]);
+            for (size_t i = 0; i < count; i++)
+                failures += !run_check(&checks[i], &image);
+            freeimage(image.image_data, image.size_x, image.size_y);
+        }
+    }
+    printf("%d hibás ellenőrzés\n", failures);
+    return failures;
+}
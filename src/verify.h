@@ -0,0 +1,8 @@
+#ifndef VERIFY
+#define VERIFY
+
+#include "ppm.h"
+
+int verify_kernels(PPM_Image *input);
+
+#endif
@@ -0,0 +1,27 @@
+#!/bin/sh
+# A gyorsítótár kulcsa a véletlenszerű lépéseknél a --seed értékétől is függ:
+# két különböző kezdőérték ugyanazzal a gyorsítótárral különböző képet ad, és a
+# gyorsítótárból kapott kép ugyanaz, mint a gyorsítótár nélkül kiszámolt.
+# Használat: cache_seed.sh <imageproc>
+set -e
+exe="$1"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# egy kis színátmenetes P3 kép
+awk 'BEGIN { print "P3"; print "64 48"; print "255";
+             for (y = 0; y < 48; y++) for (x = 0; x < 64; x++) print x * 4, y * 5, (x * y) % 256 }' > "$dir/in.ppm"
+mkdir "$dir/cache"
+
+"$exe" -i "$dir/in.ppm" --corrupt --seed 1 --cache "$dir/cache" -o "$dir/seed1.ppm" > /dev/null
+"$exe" -i "$dir/in.ppm" --corrupt --seed 2 --cache "$dir/cache" -o "$dir/seed2.ppm" > /dev/null
+"$exe" -i "$dir/in.ppm" --corrupt --seed 2 -o "$dir/seed2_nocache.ppm" > /dev/null
+
+if cmp -s "$dir/seed1.ppm" "$dir/seed2.ppm"; then
+    echo "a --seed 2 a --seed 1 gyorsítótárazott eredményét kapta"
+    exit 1
+fi
+if ! cmp -s "$dir/seed2.ppm" "$dir/seed2_nocache.ppm"; then
+    echo "a gyorsítótárral kapott kép eltér a gyorsítótár nélkülitől"
+    exit 1
+fi
@@ -0,0 +1,35 @@
+#!/bin/sh
+# A csonka gyorsítótár-bejegyzés nem találat: a lépés újra lefut, a kép ugyanaz,
+# mint a gyorsítótár nélkül kiszámolt, és a hibás bejegyzés helyére a teljes kerül.
+# Használat: cache_truncated.sh <imageproc>
+set -e
+exe="$1"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# egy kis színátmenetes P3 kép
+awk 'BEGIN { print "P3"; print "64 48"; print "255";
+             for (y = 0; y < 48; y++) for (x = 0; x < 64; x++) print x * 4, y * 5, (x * y) % 256 }' > "$dir/in.ppm"
+mkdir "$dir/cache"
+
+"$exe" -i "$dir/in.ppm" --blur 1 --lightness 10 -o "$dir/nocache.ppm" > /dev/null
+"$exe" -i "$dir/in.ppm" --blur 1 --lightness 10 --cache "$dir/cache" -o "$dir/first.ppm" > /dev/null
+
+# minden bejegyzés végéről levágunk 20 bájtot (a lezárást és néhány pixelt)
+for entry in "$dir"/cache/*.ipc; do
+    size=$(wc -c < "$entry")
+    head -c $((size - 20)) "$entry" > "$entry.cut"
+    mv "$entry.cut" "$entry"
+done
+
+"$exe" -i "$dir/in.ppm" --blur 1 --lightness 10 --cache "$dir/cache" -o "$dir/second.ppm" > /dev/null
+
+if ! cmp -s "$dir/second.ppm" "$dir/nocache.ppm"; then
+    echo "a csonka bejegyzésből kapott kép eltér a gyorsítótár nélkülitől"
+    exit 1
+fi
+"$exe" -i "$dir/in.ppm" --blur 1 --lightness 10 --cache "$dir/cache" -o "$dir/third.ppm" > /dev/null
+if ! cmp -s "$dir/third.ppm" "$dir/nocache.ppm"; then
+    echo "a csonka bejegyzés helyére nem a teljes került"
+    exit 1
+fi